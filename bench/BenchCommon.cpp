@@ -0,0 +1,135 @@
+#include "BenchCommon.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "Resources.h"
+
+#ifndef CLGLPARTICLES_SOURCE_DIR
+#define CLGLPARTICLES_SOURCE_DIR "."
+#endif
+
+bool parseUnsigned(const char* value, unsigned int& result)
+{
+	if (value == nullptr)
+		return false;
+
+	char* end = nullptr;
+	const unsigned long parsed = std::strtoul(value, &end, 10);
+	if (end == value || *end != '\0')
+	{
+		std::cerr << "Invalid number '" << value << "'" << std::endl;
+		return false;
+	}
+	result = static_cast<unsigned int>(parsed);
+	return true;
+}
+
+bool parseList(const char* value, std::vector<size_t>& list)
+{
+	if (value == nullptr)
+		return false;
+
+	list.clear();
+	const char* begin = value;
+	while (true)
+	{
+		char* end = nullptr;
+		const unsigned long long parsed = std::strtoull(begin, &end, 10);
+		if (end == begin || (*end != ',' && *end != '\0'))
+		{
+			std::cerr << "Invalid list '" << value << "'" << std::endl;
+			return false;
+		}
+		list.push_back(static_cast<size_t>(parsed));
+		if (*end == '\0')
+			return true;
+		begin = end + 1;
+	}
+}
+
+BenchOptionResult parseCommonBenchOption(const char* option, const char* value, CommonBenchOptions& options)
+{
+	bool parsed = true;
+	if (std::strcmp(option, "--warmup") == 0)
+		parsed = parseUnsigned(value, options.numWarmups);
+	else if (std::strcmp(option, "--repetitions") == 0)
+		parsed = parseUnsigned(value, options.numRepetitions) && options.numRepetitions > 0;
+	else if (std::strcmp(option, "--device") == 0)
+		options.deviceFilter = value;
+	else if (std::strcmp(option, "--output-dir") == 0)
+		options.outputDirectory = value;
+	else if (std::strcmp(option, "--resources") == 0)
+		setResourceDirectory(value);
+	else
+		return BenchOptionResult::Unknown;
+
+	return parsed ? BenchOptionResult::Parsed : BenchOptionResult::Invalid;
+}
+
+void printCommonBenchUsage(const CommonBenchOptions& options, const std::string& resultPrefix)
+{
+	std::cout
+		<< "  --warmup <n>            untimed runs per configuration (default " << options.numWarmups << ")" << std::endl
+		<< "  --repetitions <n>       timed runs per configuration (default " << options.numRepetitions << ")" << std::endl
+		<< "  --device <name>         only devices whose name contains this string" << std::endl
+		<< "  --output-dir <dir>      directory of the " << resultPrefix << "<device>.json results (default " << options.outputDirectory << ")" << std::endl
+		<< "  --resources <dir>       directory holding cl/ and bench/ (default the source tree)" << std::endl;
+}
+
+bool parseBenchArguments(int argc, char* argv[], CommonBenchOptions& options, void (*printUsage)(const char* executable),
+	const std::function<BenchOptionResult(const char* option, const char* value)>& parseOption)
+{
+	setResourceDirectory(CLGLPARTICLES_SOURCE_DIR);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		if (std::strcmp(option, "--help") == 0)
+		{
+			printUsage(argv[0]);
+			std::exit(EXIT_SUCCESS);
+		}
+
+		const char* value = i + 1 < argc ? argv[++i] : nullptr;
+		if (value == nullptr)
+		{
+			std::cerr << "Missing value for option " << option << std::endl;
+			return false;
+		}
+
+		BenchOptionResult result = parseCommonBenchOption(option, value, options);
+		if (result == BenchOptionResult::Unknown)
+		{
+			result = parseOption(option, value);
+		}
+
+		if (result == BenchOptionResult::Unknown)
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return false;
+		}
+		if (result == BenchOptionResult::Invalid)
+			return false;
+	}
+	return true;
+}
+
+std::string getResultFileName(const std::string& resultPrefix, const std::string& deviceName)
+{
+	std::string fileName = resultPrefix;
+	for (char c : deviceName)
+	{
+		const bool isAlphanumeric = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+		if (isAlphanumeric)
+		{
+			fileName += c;
+		}
+		else if (fileName.back() != '_')
+		{
+			fileName += '_';
+		}
+	}
+	return fileName + ".json";
+}
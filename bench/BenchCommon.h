@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// option parsing and result file naming shared by the device benchmarks (particle_bench, bvh_bench, force_volume_bench)
+
+// options every device benchmark takes: --warmup, --repetitions, --device, --output-dir and --resources
+struct CommonBenchOptions
+{
+	unsigned int numWarmups = 3;
+	unsigned int numRepetitions = 20;
+	std::string deviceFilter;
+	std::string outputDirectory = ".";
+};
+
+enum class BenchOptionResult { Parsed, Invalid, Unknown };
+
+// prints an error when the value is not an unsigned decimal number
+bool parseUnsigned(const char* value, unsigned int& result);
+// comma separated unsigned numbers
+bool parseList(const char* value, std::vector<size_t>& list);
+
+// one of the common options and its value, Unknown for the others
+BenchOptionResult parseCommonBenchOption(const char* option, const char* value, CommonBenchOptions& options);
+// usage lines of the common options, the defaults are those of options
+void printCommonBenchUsage(const CommonBenchOptions& options, const std::string& resultPrefix);
+
+// parses options that all take a single value, the common ones here and the others through parseOption
+// --help prints the usage and exits, the resource directory defaults to the source tree
+bool parseBenchArguments(int argc, char* argv[], CommonBenchOptions& options, void (*printUsage)(const char* executable),
+	const std::function<BenchOptionResult(const char* option, const char* value)>& parseOption);
+
+// resultPrefix followed by the device name, with every run of characters other than letters and digits replaced by '_'
+std::string getResultFileName(const std::string& resultPrefix, const std::string& deviceName);
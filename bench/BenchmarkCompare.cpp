@@ -0,0 +1,310 @@
+#include "BenchmarkCompare.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+// just enough JSON for the FrameStats files: objects, strings, numbers and null
+struct JsonValue
+{
+	enum class Type { Null, Number, String, Object };
+
+	Type type = Type::Null;
+	double number = 0.0;
+	std::string string;
+	// members in file order
+	std::vector<std::pair<std::string, JsonValue>> members;
+
+	const JsonValue* find(const std::string& key) const
+	{
+		for (const std::pair<std::string, JsonValue>& member : members)
+		{
+			if (member.first == key)
+				return &member.second;
+		}
+		return nullptr;
+	}
+
+	double getNumber(const std::string& key) const
+	{
+		const JsonValue* value = find(key);
+		return value != nullptr && value->type == Type::Number ? value->number : 0.0;
+	}
+
+	// FrameStats writes null for non-finite values
+	bool hasNumber(const std::string& key) const
+	{
+		const JsonValue* value = find(key);
+		return value != nullptr && value->type == Type::Number;
+	}
+};
+
+class JsonParser
+{
+public:
+	explicit JsonParser(const std::string& text) : text(text) {}
+
+	bool parse(JsonValue& value)
+	{
+		return parseValue(value) && (skipWhitespace(), position == text.size());
+	}
+
+private:
+	void skipWhitespace()
+	{
+		while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+			++position;
+	}
+
+	bool consume(char c)
+	{
+		skipWhitespace();
+		if (position < text.size() && text[position] == c)
+		{
+			++position;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseValue(JsonValue& value)
+	{
+		skipWhitespace();
+		if (position >= text.size())
+			return false;
+
+		if (text[position] == '{')
+		{
+			value.type = JsonValue::Type::Object;
+			return parseObject(value);
+		}
+		if (text[position] == '"')
+		{
+			value.type = JsonValue::Type::String;
+			return parseString(value.string);
+		}
+		if (text.compare(position, 4, "null") == 0)
+		{
+			value.type = JsonValue::Type::Null;
+			position += 4;
+			return true;
+		}
+
+		const char* begin = text.c_str() + position;
+		char* end = nullptr;
+		value.number = std::strtod(begin, &end);
+		if (end == begin)
+			return false;
+		value.type = JsonValue::Type::Number;
+		position += end - begin;
+		return true;
+	}
+
+	bool parseObject(JsonValue& value)
+	{
+		++position;
+		if (consume('}'))
+			return true;
+
+		do
+		{
+			std::pair<std::string, JsonValue> member;
+			skipWhitespace();
+			if (!parseString(member.first) || !consume(':') || !parseValue(member.second))
+				return false;
+			value.members.push_back(std::move(member));
+		} while (consume(','));
+
+		return consume('}');
+	}
+
+	// escapes other than \uXXXX are kept verbatim, the names only need to compare equal
+	bool parseString(std::string& string)
+	{
+		if (position >= text.size() || text[position] != '"')
+			return false;
+
+		for (++position; position < text.size(); ++position)
+		{
+			const char c = text[position];
+			if (c == '"')
+			{
+				++position;
+				return true;
+			}
+			if (c == '\\' && position + 1 < text.size())
+			{
+				++position;
+				switch (text[position])
+				{
+				case 'n': string += '\n'; break;
+				case 't': string += '\t'; break;
+				default: string += text[position]; break;
+				}
+				continue;
+			}
+			string += c;
+		}
+		return false;
+	}
+
+	const std::string& text;
+	size_t position = 0;
+};
+
+static bool loadBenchmark(const std::string& filePath, JsonValue& benchmark)
+{
+	std::ifstream file(filePath.c_str(), std::ifstream::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Unable to open file '" << filePath << "'" << std::endl;
+		return false;
+	}
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	const std::string text = buffer.str();
+	JsonParser parser(text);
+	if (!parser.parse(benchmark) || benchmark.type != JsonValue::Type::Object)
+	{
+		std::cerr << "'" << filePath << "' is not valid benchmark JSON" << std::endl;
+		return false;
+	}
+
+	const JsonValue* stages = benchmark.find("stages");
+	if (stages == nullptr || stages->type != JsonValue::Type::Object)
+	{
+		std::cerr << "'" << filePath << "' has no stages" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static std::string getInfoString(const JsonValue& benchmark, const std::string& key)
+{
+	const JsonValue* value = benchmark.find(key);
+	return value != nullptr && value->type == JsonValue::Type::String ? value->string : std::string();
+}
+
+// two-sided 95% quantile of Student's t distribution
+static double getTQuantile95(double degreesOfFreedom)
+{
+	static const double QUANTILES[] =
+	{
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+	const size_t numQuantiles = sizeof(QUANTILES) / sizeof(QUANTILES[0]);
+	if (degreesOfFreedom < 1.0)
+		return QUANTILES[0];
+	if (degreesOfFreedom <= static_cast<double>(numQuantiles))
+		return QUANTILES[static_cast<size_t>(degreesOfFreedom) - 1];
+	// converges to the normal quantile
+	return 1.960 + 2.4 / degreesOfFreedom;
+}
+
+bool compareBenchmarks(const std::string& baselinePath, const std::string& runPath, const CompareOptions& options)
+{
+	JsonValue baseline;
+	JsonValue run;
+	if (!loadBenchmark(baselinePath, baseline) || !loadBenchmark(runPath, run))
+		return false;
+
+	const std::string baselineDevice = getInfoString(baseline, "device");
+	const std::string runDevice = getInfoString(run, "device");
+	if (baselineDevice != runDevice && !options.ignoreDevice)
+	{
+		std::cerr << "The baseline was measured on '" << baselineDevice << "' and the run on '" << runDevice << "'" << std::endl;
+		return false;
+	}
+
+	std::printf("%-56s %10s %10s %9s %21s\n", "stage (mean ms)", "baseline", "run", "change", "95% interval");
+	unsigned int numRegressions = 0;
+	unsigned int numImprovements = 0;
+	unsigned int numMissing = 0;
+	const JsonValue& runStages = *run.find("stages");
+	for (const std::pair<std::string, JsonValue>& baselineStage : baseline.find("stages")->members)
+	{
+		const JsonValue* runStage = runStages.find(baselineStage.first);
+		if (runStage == nullptr)
+		{
+			std::printf("%-56s missing from the run%s\n", baselineStage.first.c_str(), options.allowMissing ? "" : " MISSING");
+			++numMissing;
+			continue;
+		}
+
+		bool hasStatistics = true;
+		for (const char* key : { "count", "mean", "stddev" })
+		{
+			hasStatistics &= baselineStage.second.hasNumber(key) && runStage->hasNumber(key);
+		}
+		if (!hasStatistics)
+		{
+			std::printf("%-56s no finite statistics\n", baselineStage.first.c_str());
+			continue;
+		}
+
+		const double baselineCount = baselineStage.second.getNumber("count");
+		const double baselineMean = baselineStage.second.getNumber("mean");
+		const double baselineDeviation = baselineStage.second.getNumber("stddev");
+		const double runCount = runStage->getNumber("count");
+		const double runMean = runStage->getNumber("mean");
+		const double runDeviation = runStage->getNumber("stddev");
+		if (baselineCount < 2.0 || runCount < 2.0 || baselineMean <= 0.0)
+		{
+			std::printf("%-56s not enough samples\n", baselineStage.first.c_str());
+			continue;
+		}
+
+		// Welch's interval of the difference of the means, the variances of two runs are not assumed equal
+		const double baselineVariance = baselineDeviation * baselineDeviation / baselineCount;
+		const double runVariance = runDeviation * runDeviation / runCount;
+		const double standardError = std::sqrt(baselineVariance + runVariance);
+		const double degreesOfFreedom = standardError > 0.0
+			? (baselineVariance + runVariance) * (baselineVariance + runVariance)
+				/ (baselineVariance * baselineVariance / (baselineCount - 1.0) + runVariance * runVariance / (runCount - 1.0))
+			: baselineCount + runCount - 2.0;
+		const double margin = getTQuantile95(degreesOfFreedom) * standardError;
+		const double difference = runMean - baselineMean;
+		const double lower = (difference - margin) / baselineMean;
+		const double upper = (difference + margin) / baselineMean;
+
+		const char* status = "";
+		if (lower > options.threshold)
+		{
+			status = "REGRESSION";
+			++numRegressions;
+		}
+		else if (lower > 0.0)
+		{
+			status = "slower";
+		}
+		else if (upper < 0.0)
+		{
+			status = "faster";
+			++numImprovements;
+		}
+
+		std::printf("%-56s %10.4f %10.4f %+8.2f%% [%+8.2f%%, %+8.2f%%] %s\n", baselineStage.first.c_str(),
+			baselineMean, runMean, difference / baselineMean * 100.0, lower * 100.0, upper * 100.0, status);
+	}
+
+	for (const std::pair<std::string, JsonValue>& runStage : runStages.members)
+	{
+		if (baseline.find("stages")->find(runStage.first) == nullptr)
+		{
+			std::printf("%-56s not in the baseline\n", runStage.first.c_str());
+		}
+	}
+
+	std::printf("%u regressions past %.1f%%, %u significant improvements, %u stages missing from the run\n",
+		numRegressions, options.threshold * 100.0, numImprovements, numMissing);
+	// a stage that stopped being measured would otherwise hide its regression
+	return numRegressions == 0 && (numMissing == 0 || options.allowMissing);
+}
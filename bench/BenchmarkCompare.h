@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+// compares two benchmark JSON files written by FrameStats (particle_bench and CLGLParticles --benchmark)
+// a stage regresses when the 95% confidence interval of its mean slowdown lies entirely above the threshold,
+// a single slow sample or a noisy stage cannot fail the comparison on its own
+struct CompareOptions
+{
+	// relative slowdown of the mean, 0.05 is 5%
+	double threshold = 0.05;
+	// compare runs of different devices anyway
+	bool ignoreDevice = false;
+	// a baseline stage missing from the run is only reported instead of failing the comparison
+	bool allowMissing = false;
+};
+
+// prints one line per stage, returns false on regressions, on baseline stages missing from the run
+// or if the files cannot be compared
+bool compareBenchmarks(const std::string& baselinePath, const std::string& runPath, const CompareOptions& options);
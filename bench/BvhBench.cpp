@@ -0,0 +1,350 @@
+// triangle mesh collision benchmark: LBVH build time and swept-segment query throughput of cl/bvh.cl
+// the meshes are displaced grids of the requested triangle counts covering the spawn area, the particles move
+// through them in random directions; one JSON of per configuration statistics is written per device
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BenchCommon.h"
+#include "CLUtils.h"
+#include "FrameStats.h"
+#include "MeshBvh.h"
+#include "ParticleState.h"
+#include "Random.h"
+#include "Resources.h"
+
+struct BenchOptions : CommonBenchOptions
+{
+	std::vector<size_t> triangleCounts = { 10000, 100000, 1000000 };
+	size_t numParticles = 1000000;
+};
+
+static const char* RESULT_PREFIX = "bvh_bench_";
+
+static void printUsage(const char* executable)
+{
+	std::cout
+		<< "Usage: " << executable << " [options]" << std::endl
+		<< "  --triangles <n,...>     mesh sizes (default 10000,100000,1000000)" << std::endl
+		<< "  --particles <n>         particles traced through each mesh (default 1000000)" << std::endl;
+	printCommonBenchUsage(BenchOptions(), RESULT_PREFIX);
+}
+
+static bool parseBenchOptions(int argc, char* argv[], BenchOptions& options)
+{
+	return parseBenchArguments(argc, argv, options, printUsage, [&options](const char* option, const char* value)
+	{
+		if (std::strcmp(option, "--triangles") == 0)
+			return parseList(value, options.triangleCounts) ? BenchOptionResult::Parsed : BenchOptionResult::Invalid;
+
+		if (std::strcmp(option, "--particles") == 0)
+		{
+			unsigned int numParticles = 0;
+			if (!parseUnsigned(value, numParticles) || numParticles == 0)
+				return BenchOptionResult::Invalid;
+			options.numParticles = numParticles;
+			return BenchOptionResult::Parsed;
+		}
+		return BenchOptionResult::Unknown;
+	});
+}
+
+// two triangles per cell of a square grid over the spawn cylinder, rippled so that the hierarchy is not flat
+static std::vector<cl_float4> createGridMesh(size_t numTriangles)
+{
+	const size_t cellsPerSide = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(numTriangles) / 2.0)));
+	const float size = 100.f;
+	const float cellSize = size / static_cast<float>(cellsPerSide);
+	auto vertex = [cellSize, size](size_t x, size_t z)
+	{
+		const float worldX = static_cast<float>(x) * cellSize - size * 0.5f;
+		const float worldZ = static_cast<float>(z) * cellSize - size * 0.5f;
+		const float height = std::sin(worldX * 0.2f) * std::cos(worldZ * 0.15f) * 4.f;
+		return cl_float4{ { worldX, height, worldZ, 1.f } };
+	};
+
+	std::vector<cl_float4> triangles;
+	triangles.reserve(cellsPerSide * cellsPerSide * 6);
+	for (size_t z = 0; z < cellsPerSide; ++z)
+	{
+		for (size_t x = 0; x < cellsPerSide; ++x)
+		{
+			triangles.push_back(vertex(x, z));
+			triangles.push_back(vertex(x + 1, z));
+			triangles.push_back(vertex(x + 1, z + 1));
+			triangles.push_back(vertex(x, z));
+			triangles.push_back(vertex(x + 1, z + 1));
+			triangles.push_back(vertex(x, z + 1));
+		}
+	}
+	return triangles;
+}
+
+// alive particles around the mesh, each having moved one 60 Hz step at up to 60 units per second
+static std::vector<ParticleState> createParticles(size_t numParticles)
+{
+	Pcg32 rng;
+	rng.seed(1, 1);
+	auto random = [&rng](float min, float max)
+	{
+		return min + static_cast<float>(rng.next()) / 4294967295.f * (max - min);
+	};
+
+	std::vector<ParticleState> particles(numParticles);
+	for (ParticleState& particle : particles)
+	{
+		particle = ParticleState();
+		particle.position = { { random(-50.f, 50.f), random(-6.f, 6.f), random(-50.f, 50.f), 0.f } };
+		particle.velocity = { { random(-60.f, 60.f), random(-60.f, 60.f), random(-60.f, 60.f), 0.f } };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			particle.previousPosition.s[axis] = particle.position.s[axis] - particle.velocity.s[axis] / 60.f;
+		}
+		particle.isAlive = 1;
+	}
+	return particles;
+}
+
+class DeviceBench
+{
+public:
+	DeviceBench(const cl::Device& device, const BenchOptions& options)
+		: device(device), options(options)
+	{
+	}
+
+	bool run(FrameStats& stats)
+	{
+		cl_int code = CL_SUCCESS;
+		context = cl::Context(device, nullptr, nullptr, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Context"))
+			return false;
+
+		commandQueue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &code);
+		if (!checkErrorCode(code, "cl::CommandQueue"))
+			return false;
+
+		if (!buildProgram() || !createParticleBuffers())
+			return false;
+
+		for (size_t numTriangles : options.triangleCounts)
+		{
+			if (numTriangles > 0 && !runMesh(numTriangles, stats))
+				return false;
+		}
+		return true;
+	}
+
+private:
+	bool buildProgram()
+	{
+		std::string particleSource;
+		std::string bvhSource;
+		if (!loadResource("cl/particle.cl", particleSource) || !loadResource("cl/bvh.cl", bvhSource))
+			return false;
+
+		cl::Program::Sources sources = { particleSource + "\n" + bvhSource };
+		cl_int code = CL_SUCCESS;
+		program = cl::Program(context, sources, &code);
+		if (!checkErrorCode(code, "cl::Program"))
+			return false;
+
+		// the traversal counts the particles whose stack overflowed, a deeper hierarchy than the stack would skip nodes
+		code = program.build({ device }, "-DPARTICLE_MESH_COLLISION -DBVH_COUNT_STACK_OVERFLOWS");
+		if (code != CL_SUCCESS)
+		{
+			std::cerr << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			return checkErrorCode(code, "clBuildProgram");
+		}
+		return true;
+	}
+
+	// the collisions move the particles, every run starts again from the same pristine copy
+	bool createParticleBuffers()
+	{
+		const std::vector<ParticleState> particles = createParticles(options.numParticles);
+		const size_t size = particles.size() * sizeof(ParticleState);
+		cl_int code = CL_SUCCESS;
+		initialParticlesBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, const_cast<ParticleState*>(particles.data()), &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		particlesBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, size, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		stackOverflowsBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), nullptr, &code);
+		return checkErrorCode(code, "cl::Buffer");
+	}
+
+	bool runMesh(size_t requestedTriangles, FrameStats& stats)
+	{
+		const std::vector<cl_float4> triangles = createGridMesh(requestedTriangles);
+		MeshBvh bvh;
+		if (!bvh.create(context, device, program, triangles))
+			return false;
+
+		// the whole build, host enqueue overhead of the sort passes included
+		const std::string meshName = "triangles=" + std::to_string(bvh.getNumTriangles());
+		const std::string buildStage = "build " + meshName;
+		std::vector<double> buildSamples;
+		for (unsigned int i = 0; i < options.numWarmups + options.numRepetitions; ++i)
+		{
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (!bvh.build(commandQueue))
+				return false;
+			const cl_int code = commandQueue.finish();
+			if (!checkErrorCode(code, "finish"))
+				return false;
+
+			if (i >= options.numWarmups)
+			{
+				buildSamples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
+		}
+		for (double sample : buildSamples)
+		{
+			stats.add(buildStage, sample);
+		}
+		const FrameStats::Summary buildSummary = FrameStats::summarize(buildSamples);
+		const double trianglesPerSecond = buildSummary.p50 > 0.0 ? static_cast<double>(bvh.getNumTriangles()) / (buildSummary.p50 * 1e-3) : 0.0;
+		stats.setStageValue(buildStage, "triangles", static_cast<double>(bvh.getNumTriangles()));
+		stats.setStageValue(buildStage, "trianglesPerSecond", trianglesPerSecond);
+		std::printf("  %-48s p50 %9.4f ms  mean %9.4f +- %8.4f ms  %8.2f Mtri/s\n", buildStage.c_str(), buildSummary.p50, buildSummary.mean,
+			buildSummary.stddev, trianglesPerSecond * 1e-6);
+
+		// kernel time only, from profiling events
+		cl_int code = CL_SUCCESS;
+		cl::Kernel collideKernel(program, "collideParticlesWithMesh", &code);
+		code |= collideKernel.setArg(0, particlesBuffer);
+		code |= collideKernel.setArg(1, bvh.getNodesBuffer());
+		code |= collideKernel.setArg(2, bvh.getTrianglesBuffer());
+		code |= collideKernel.setArg(3, 0.4f);
+		code |= collideKernel.setArg(4, 0.2f);
+		code |= collideKernel.setArg(5, stackOverflowsBuffer);
+		if (!checkErrorCode(code, "collideParticlesWithMesh"))
+			return false;
+
+		const cl_uint zero = 0;
+		code = commandQueue.enqueueWriteBuffer(stackOverflowsBuffer, CL_TRUE, 0, sizeof(cl_uint), &zero);
+		if (!checkErrorCode(code, "enqueueWriteBuffer"))
+			return false;
+
+		const std::string queryStage = "collide " + meshName + " particles=" + std::to_string(options.numParticles);
+		const size_t particlesSize = options.numParticles * sizeof(ParticleState);
+		std::vector<double> querySamples;
+		for (unsigned int i = 0; i < options.numWarmups + options.numRepetitions; ++i)
+		{
+			code = commandQueue.enqueueCopyBuffer(initialParticlesBuffer, particlesBuffer, 0, 0, particlesSize);
+			if (!checkErrorCode(code, "enqueueCopyBuffer"))
+				return false;
+
+			cl::Event event;
+			code = commandQueue.enqueueNDRangeKernel(collideKernel, cl::NullRange, cl::NDRange(options.numParticles), cl::NullRange, nullptr, &event);
+			code |= event.wait();
+			if (!checkErrorCode(code, "collideParticlesWithMesh"))
+				return false;
+
+			if (i >= options.numWarmups)
+			{
+				const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+				const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+				querySamples.push_back(static_cast<double>(end - start) * 1e-6);
+			}
+		}
+		for (double sample : querySamples)
+		{
+			stats.add(queryStage, sample);
+		}
+		// over every run, warmups included
+		cl_uint stackOverflows = 0;
+		code = commandQueue.enqueueReadBuffer(stackOverflowsBuffer, CL_TRUE, 0, sizeof(cl_uint), &stackOverflows);
+		if (!checkErrorCode(code, "enqueueReadBuffer"))
+			return false;
+		stats.setStageValue(queryStage, "stackOverflows", static_cast<double>(stackOverflows));
+		if (stackOverflows > 0)
+		{
+			std::cerr << "  " << stackOverflows << " traversals overflowed the BVH stack and skipped nodes" << std::endl;
+		}
+
+		const FrameStats::Summary querySummary = FrameStats::summarize(querySamples);
+		const double queriesPerSecond = querySummary.p50 > 0.0 ? static_cast<double>(options.numParticles) / (querySummary.p50 * 1e-3) : 0.0;
+		stats.setStageValue(queryStage, "triangles", static_cast<double>(bvh.getNumTriangles()));
+		stats.setStageValue(queryStage, "particles", static_cast<double>(options.numParticles));
+		stats.setStageValue(queryStage, "queriesPerSecond", queriesPerSecond);
+		std::printf("  %-48s p50 %9.4f ms  mean %9.4f +- %8.4f ms  %8.2f Mquery/s\n", queryStage.c_str(), querySummary.p50, querySummary.mean,
+			querySummary.stddev, queriesPerSecond * 1e-6);
+		return true;
+	}
+
+	cl::Device device;
+	const BenchOptions& options;
+	cl::Context context;
+	cl::CommandQueue commandQueue;
+	cl::Program program;
+	cl::Buffer initialParticlesBuffer;
+	cl::Buffer particlesBuffer;
+	cl::Buffer stackOverflowsBuffer;
+};
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options;
+	if (!parseBenchOptions(argc, argv, options))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+	unsigned int numDevices = 0;
+	for (const cl::Platform& platform : platforms)
+	{
+		std::vector<cl::Device> devices;
+		if (platform.getDevices(CL_DEVICE_TYPE_ALL, &devices) != CL_SUCCESS)
+			continue;
+
+		for (const cl::Device& device : devices)
+		{
+			const std::string deviceName = device.getInfo<CL_DEVICE_NAME>();
+			if (!options.deviceFilter.empty() && deviceName.find(options.deviceFilter) == std::string::npos)
+				continue;
+
+			++numDevices;
+			std::cout << deviceName << " (" << platform.getInfo<CL_PLATFORM_NAME>() << ")" << std::endl;
+
+			FrameStats stats;
+			stats.setInfo("benchmark", "bvh_bench");
+			stats.setInfo("device", deviceName);
+			stats.setInfo("platform", platform.getInfo<CL_PLATFORM_NAME>());
+			stats.setInfo("driverVersion", device.getInfo<CL_DRIVER_VERSION>());
+			stats.setInfo("computeUnits", static_cast<double>(device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()));
+			stats.setInfo("warmupRuns", static_cast<double>(options.numWarmups));
+			stats.setInfo("repetitions", static_cast<double>(options.numRepetitions));
+
+			DeviceBench bench(device, options);
+			if (!bench.run(stats))
+			{
+				std::cerr << "Benchmark failed on " << deviceName << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			if (!stats.writeJson(options.outputDirectory + "/" + getResultFileName(RESULT_PREFIX, deviceName)))
+			{
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	if (numDevices == 0)
+	{
+		std::cerr << "No OpenCL device found" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,355 @@
+// force volume benchmark: updateParticleState step time against the number of bounded attractors, wind boxes and vortices
+// the volumes drift every frame and are binned again before each step, as a scene animating them would; the binned grid
+// is compared with a single cell evaluating every volume for every particle; one JSON of per configuration statistics
+// is written per device
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BenchCommon.h"
+#include "CLUtils.h"
+#include "ForceVolumes.h"
+#include "FrameStats.h"
+#include "ParticleState.h"
+#include "Random.h"
+#include "Resources.h"
+
+struct BenchOptions : CommonBenchOptions
+{
+	std::vector<size_t> volumeCounts = { 1, 10, 100, 1000, 10000 };
+	size_t numParticles = 1000000;
+	// the single cell runs grow with volumes * particles, larger counts only run binned
+	size_t maxBruteForceVolumes = 1000;
+};
+
+static const char* RESULT_PREFIX = "force_volume_bench_";
+
+static void printBenchUsage(const char* executable)
+{
+	std::cout
+		<< "Usage: " << executable << " [options]" << std::endl
+		<< "  --volumes <n,...>       force volume counts (default 1,10,100,1000,10000)" << std::endl
+		<< "  --particles <n>         particles stepped per run (default 1000000)" << std::endl
+		<< "  --brute-force-max <n>   largest count also run without binning (default 1000)" << std::endl;
+	printCommonBenchUsage(BenchOptions(), RESULT_PREFIX);
+}
+
+static bool parseBenchOptions(int argc, char* argv[], BenchOptions& options)
+{
+	return parseBenchArguments(argc, argv, options, printBenchUsage, [&options](const char* option, const char* value)
+	{
+		if (std::strcmp(option, "--volumes") == 0)
+			return parseList(value, options.volumeCounts) ? BenchOptionResult::Parsed : BenchOptionResult::Invalid;
+
+		unsigned int number = 0;
+		if (std::strcmp(option, "--particles") == 0)
+		{
+			if (!parseUnsigned(value, number) || number == 0)
+				return BenchOptionResult::Invalid;
+			options.numParticles = number;
+			return BenchOptionResult::Parsed;
+		}
+		if (std::strcmp(option, "--brute-force-max") == 0)
+		{
+			if (!parseUnsigned(value, number))
+				return BenchOptionResult::Invalid;
+			options.maxBruteForceVolumes = number;
+			return BenchOptionResult::Parsed;
+		}
+		return BenchOptionResult::Unknown;
+	});
+}
+
+// a third of each type scattered over the particles, sized like local effects of a scene
+// the size does not shrink with the count, more volumes overlap each particle as the count grows
+static std::vector<ForceVolumeParams> createVolumes(size_t numVolumes)
+{
+	Pcg32 rng;
+	rng.seed(2, 1);
+	auto random = [&rng](float min, float max)
+	{
+		return min + static_cast<float>(rng.next()) / 4294967295.f * (max - min);
+	};
+
+	std::vector<ForceVolumeParams> volumes(numVolumes);
+	for (size_t i = 0; i < numVolumes; ++i)
+	{
+		ForceVolumeSource source;
+		source.type = static_cast<ForceVolumeType>(i % 3);
+		source.values[0] = random(-50.f, 50.f);
+		source.values[1] = random(0.f, 40.f);
+		source.values[2] = random(-50.f, 50.f);
+		switch (source.type)
+		{
+		case ForceVolumeType::Attractor:
+			source.values[3] = random(2.f, 8.f);
+			source.values[4] = random(-40.f, 40.f);
+			break;
+		case ForceVolumeType::Wind:
+			source.values[3] = random(2.f, 8.f);
+			source.values[4] = random(2.f, 8.f);
+			source.values[5] = random(2.f, 8.f);
+			source.values[6] = random(-20.f, 20.f);
+			source.values[7] = random(-5.f, 20.f);
+			source.values[8] = random(-20.f, 20.f);
+			break;
+		case ForceVolumeType::Vortex:
+			source.values[3] = random(2.f, 8.f);
+			source.values[4] = random(4.f, 12.f);
+			source.values[5] = random(-40.f, 40.f);
+			break;
+		}
+		makeForceVolume(source, volumes[i]);
+	}
+	return volumes;
+}
+
+// alive particles filling the volumes' region and a margin around it
+static std::vector<ParticleState> createParticles(size_t numParticles)
+{
+	Pcg32 rng;
+	rng.seed(1, 1);
+	auto random = [&rng](float min, float max)
+	{
+		return min + static_cast<float>(rng.next()) / 4294967295.f * (max - min);
+	};
+
+	std::vector<ParticleState> particles(numParticles);
+	for (ParticleState& particle : particles)
+	{
+		particle = ParticleState();
+		particle.position = { { random(-60.f, 60.f), random(-10.f, 50.f), random(-60.f, 60.f), 0.f } };
+		particle.velocity = { { random(-5.f, 5.f), random(-5.f, 5.f), random(-5.f, 5.f), 0.f } };
+		particle.isAlive = 1;
+	}
+	return particles;
+}
+
+class DeviceBench
+{
+public:
+	DeviceBench(const cl::Device& device, const BenchOptions& options)
+		: device(device), options(options)
+	{
+	}
+
+	bool run(FrameStats& stats)
+	{
+		cl_int code = CL_SUCCESS;
+		context = cl::Context(device, nullptr, nullptr, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Context"))
+			return false;
+
+		commandQueue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &code);
+		if (!checkErrorCode(code, "cl::CommandQueue"))
+			return false;
+
+		if (!buildProgram() || !createParticleBuffers())
+			return false;
+
+		for (size_t numVolumes : options.volumeCounts)
+		{
+			if (numVolumes == 0)
+				continue;
+
+			const std::vector<ForceVolumeParams> volumes = createVolumes(numVolumes);
+			if (!runVolumes(volumes, ForceVolumeSet::MAX_CELLS_PER_AXIS, stats))
+				return false;
+			if (numVolumes <= options.maxBruteForceVolumes && !runVolumes(volumes, 1, stats))
+				return false;
+		}
+		return true;
+	}
+
+private:
+	bool buildProgram()
+	{
+		std::string source;
+		if (!loadResource("cl/particle.cl", source))
+			return false;
+
+		cl::Program::Sources sources = { source };
+		cl_int code = CL_SUCCESS;
+		program = cl::Program(context, sources, &code);
+		if (!checkErrorCode(code, "cl::Program"))
+			return false;
+
+		code = program.build({ device }, "-DPARTICLE_FORCE_VOLUMES");
+		if (code != CL_SUCCESS)
+		{
+			std::cerr << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			return checkErrorCode(code, "clBuildProgram");
+		}
+
+		updateKernel = cl::Kernel(program, "updateParticleState", &code);
+		return checkErrorCode(code, "cl::Kernel");
+	}
+
+	// the steps move the particles, every run starts again from the same pristine copy
+	bool createParticleBuffers()
+	{
+		const std::vector<ParticleState> particles = createParticles(options.numParticles);
+		const size_t size = particles.size() * sizeof(ParticleState);
+		cl_int code = CL_SUCCESS;
+		initialParticlesBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, const_cast<ParticleState*>(particles.data()), &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		particlesBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, size, nullptr, &code);
+		return checkErrorCode(code, "cl::Buffer");
+	}
+
+	bool runVolumes(const std::vector<ForceVolumeParams>& volumes, unsigned int maxCellsPerAxis, FrameStats& stats)
+	{
+		const bool binned = maxCellsPerAxis > 1;
+		const std::string configuration = "volumes=" + std::to_string(volumes.size()) + (binned ? " grid" : " single cell");
+		const std::string binStage = "bin " + configuration;
+		const std::string stepStage = "step " + configuration + " particles=" + std::to_string(options.numParticles);
+		const size_t particlesSize = options.numParticles * sizeof(ParticleState);
+		const float deltaTime = 1.f / 60.f;
+
+		ForceVolumeSet forceVolumes;
+		std::vector<ForceVolumeParams> movedVolumes = volumes;
+		std::vector<double> binSamples;
+		std::vector<double> stepSamples;
+		for (unsigned int i = 0; i < options.numWarmups + options.numRepetitions; ++i)
+		{
+			// a slow drift, enough to change the binning from frame to frame
+			const float time = static_cast<float>(i) * deltaTime;
+			for (size_t volume = 0; volume < volumes.size(); ++volume)
+			{
+				const float phase = time * 2.f + static_cast<float>(volume);
+				movedVolumes[volume].a.s[0] = volumes[volume].a.s[0] + std::sin(phase) * 4.f;
+				movedVolumes[volume].a.s[2] = volumes[volume].a.s[2] + std::cos(phase) * 4.f;
+			}
+
+			// host binning and the blocking uploads
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (!forceVolumes.update(commandQueue, movedVolumes, maxCellsPerAxis))
+				return false;
+			const double binTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			cl_int code = updateKernel.setArg(0, particlesBuffer);
+			code |= updateKernel.setArg(1, static_cast<cl_int>(i));
+			code |= updateKernel.setArg(2, deltaTime);
+			code |= updateKernel.setArg(3, forceVolumes.getGridBuffer());
+			code |= updateKernel.setArg(4, forceVolumes.getVolumesBuffer());
+			code |= updateKernel.setArg(5, forceVolumes.getCellsBuffer());
+			code |= updateKernel.setArg(6, forceVolumes.getIndicesBuffer());
+			code |= commandQueue.enqueueCopyBuffer(initialParticlesBuffer, particlesBuffer, 0, 0, particlesSize);
+			if (!checkErrorCode(code, "setArg"))
+				return false;
+
+			// kernel time only, from profiling events
+			cl::Event event;
+			code = commandQueue.enqueueNDRangeKernel(updateKernel, cl::NullRange, cl::NDRange(options.numParticles), cl::NullRange, nullptr, &event);
+			code |= event.wait();
+			if (!checkErrorCode(code, "updateParticleState"))
+				return false;
+
+			if (i >= options.numWarmups)
+			{
+				const cl_ulong kernelStart = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+				const cl_ulong kernelEnd = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+				binSamples.push_back(binTime);
+				stepSamples.push_back(static_cast<double>(kernelEnd - kernelStart) * 1e-6);
+			}
+		}
+
+		for (double sample : binSamples)
+		{
+			stats.add(binStage, sample);
+		}
+		for (double sample : stepSamples)
+		{
+			stats.add(stepStage, sample);
+		}
+
+		const double referencesPerCell = static_cast<double>(forceVolumes.getNumIndices()) / static_cast<double>(forceVolumes.getNumCells());
+		for (const std::string& stage : { binStage, stepStage })
+		{
+			stats.setStageValue(stage, "volumes", static_cast<double>(volumes.size()));
+			stats.setStageValue(stage, "cells", static_cast<double>(forceVolumes.getNumCells()));
+			stats.setStageValue(stage, "referencesPerCell", referencesPerCell);
+		}
+		stats.setStageValue(stepStage, "particles", static_cast<double>(options.numParticles));
+
+		const FrameStats::Summary binSummary = FrameStats::summarize(binSamples);
+		const FrameStats::Summary stepSummary = FrameStats::summarize(stepSamples);
+		std::printf("  %-48s p50 %9.4f ms  mean %9.4f +- %8.4f ms  %8.2f volumes/cell\n", binStage.c_str(), binSummary.p50, binSummary.mean,
+			binSummary.stddev, referencesPerCell);
+		std::printf("  %-48s p50 %9.4f ms  mean %9.4f +- %8.4f ms\n", stepStage.c_str(), stepSummary.p50, stepSummary.mean, stepSummary.stddev);
+		return true;
+	}
+
+	cl::Device device;
+	const BenchOptions& options;
+	cl::Context context;
+	cl::CommandQueue commandQueue;
+	cl::Program program;
+	cl::Kernel updateKernel;
+	cl::Buffer initialParticlesBuffer;
+	cl::Buffer particlesBuffer;
+};
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options;
+	if (!parseBenchOptions(argc, argv, options))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+	unsigned int numDevices = 0;
+	for (const cl::Platform& platform : platforms)
+	{
+		std::vector<cl::Device> devices;
+		if (platform.getDevices(CL_DEVICE_TYPE_ALL, &devices) != CL_SUCCESS)
+			continue;
+
+		for (const cl::Device& device : devices)
+		{
+			const std::string deviceName = device.getInfo<CL_DEVICE_NAME>();
+			if (!options.deviceFilter.empty() && deviceName.find(options.deviceFilter) == std::string::npos)
+				continue;
+
+			++numDevices;
+			std::cout << deviceName << " (" << platform.getInfo<CL_PLATFORM_NAME>() << ")" << std::endl;
+
+			FrameStats stats;
+			stats.setInfo("benchmark", "force_volume_bench");
+			stats.setInfo("device", deviceName);
+			stats.setInfo("platform", platform.getInfo<CL_PLATFORM_NAME>());
+			stats.setInfo("driverVersion", device.getInfo<CL_DRIVER_VERSION>());
+			stats.setInfo("computeUnits", static_cast<double>(device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()));
+			stats.setInfo("warmupRuns", static_cast<double>(options.numWarmups));
+			stats.setInfo("repetitions", static_cast<double>(options.numRepetitions));
+
+			DeviceBench bench(device, options);
+			if (!bench.run(stats))
+			{
+				std::cerr << "Benchmark failed on " << deviceName << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			if (!stats.writeJson(options.outputDirectory + "/" + getResultFileName(RESULT_PREFIX, deviceName)))
+			{
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	if (numDevices == 0)
+	{
+		std::cerr << "No OpenCL device found" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
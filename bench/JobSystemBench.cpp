@@ -0,0 +1,134 @@
+// parallel-for over 1M particles: work-stealing job system against one std::async per chunk
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <vector>
+#include "JobSystem.h"
+
+struct BenchParticle
+{
+	float position[3];
+	float velocity[3];
+};
+
+static void updateParticles(BenchParticle* particles, size_t begin, size_t end, float deltaTime)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		BenchParticle& particle = particles[i];
+		particle.velocity[1] -= 9.81f * deltaTime;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			particle.velocity[axis] *= 1.f - 0.1f * deltaTime;
+			particle.position[axis] += particle.velocity[axis] * deltaTime;
+		}
+		if (particle.position[1] < 0.f)
+		{
+			particle.position[1] = -particle.position[1];
+			particle.velocity[1] = std::abs(particle.velocity[1]) * 0.5f;
+		}
+	}
+}
+
+template <class Function>
+static double medianMilliseconds(unsigned int numIterations, Function function)
+{
+	std::vector<double> times;
+	for (unsigned int i = 0; i < numIterations; ++i)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		function();
+		const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+		times.push_back(duration.count());
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main(int argc, char* argv[])
+{
+	const size_t NUM_PARTICLES = 1000000;
+	unsigned int numIterations = 100;
+	if (argc > 1)
+	{
+		// the medians need at least one sample
+		char* end = nullptr;
+		const unsigned long parsed = std::strtoul(argv[1], &end, 10);
+		if (end == argv[1] || *end != '\0' || parsed == 0)
+		{
+			std::cerr << "Usage: " << argv[0] << " [iterations > 0]" << std::endl;
+			return EXIT_FAILURE;
+		}
+		numIterations = static_cast<unsigned int>(parsed);
+	}
+	const float deltaTime = 1.f / 60.f;
+
+	std::vector<BenchParticle> particles(NUM_PARTICLES);
+	for (size_t i = 0; i < NUM_PARTICLES; ++i)
+	{
+		particles[i] = { { 0.f, 20.f, 0.f }, { static_cast<float>(i % 100) - 50.f, 0.f, static_cast<float>(i % 37) - 18.f } };
+	}
+
+	JobSystem jobSystem;
+	std::cout << "particles: " << NUM_PARTICLES << ", workers: " << jobSystem.getNumWorkers() << ", iterations: " << numIterations << std::endl;
+
+	const double serial = medianMilliseconds(numIterations, [&]()
+	{
+		updateParticles(particles.data(), 0, NUM_PARTICLES, deltaTime);
+	});
+	std::cout << "serial                    " << serial << " ms" << std::endl;
+
+	for (size_t grainSize : { 4096, 16384, 65536 })
+	{
+		const double jobs = medianMilliseconds(numIterations, [&]()
+		{
+			jobSystem.parallelFor("update", NUM_PARTICLES, grainSize, [&](size_t begin, size_t end)
+			{
+				updateParticles(particles.data(), begin, end, deltaTime);
+			});
+		});
+
+		const double async = medianMilliseconds(numIterations, [&]()
+		{
+			std::vector<std::future<void>> futures;
+			for (size_t begin = 0; begin < NUM_PARTICLES; begin += grainSize)
+			{
+				const size_t end = std::min(begin + grainSize, NUM_PARTICLES);
+				futures.push_back(std::async(std::launch::async, [&particles, begin, end, deltaTime]()
+				{
+					updateParticles(particles.data(), begin, end, deltaTime);
+				}));
+			}
+			for (std::future<void>& future : futures)
+			{
+				future.wait();
+			}
+		});
+
+		std::cout << "grain " << grainSize << std::endl
+			<< "  job system              " << jobs << " ms (" << serial / jobs << "x)" << std::endl
+			<< "  std::async per chunk    " << async << " ms (" << serial / async << "x)" << std::endl;
+	}
+
+	// per-job timing hook, the last parallel-for only
+	std::atomic<unsigned int> numJobs{ 0 };
+	std::atomic<double> totalJobMilliseconds{ 0.0 };
+	jobSystem.setTimingCallback([&](const char*, double milliseconds, int)
+	{
+		++numJobs;
+		double total = totalJobMilliseconds.load();
+		while (!totalJobMilliseconds.compare_exchange_weak(total, total + milliseconds))
+		{
+		}
+	});
+	jobSystem.parallelFor("update", NUM_PARTICLES, 16384, [&](size_t begin, size_t end)
+	{
+		updateParticles(particles.data(), begin, end, deltaTime);
+	});
+	std::cout << "timing hook: " << numJobs << " jobs, " << totalJobMilliseconds / numJobs << " ms per job" << std::endl;
+
+	return EXIT_SUCCESS;
+}
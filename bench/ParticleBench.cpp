@@ -0,0 +1,538 @@
+// OpenCL kernel microbenchmark: every kernel of cl/particle.cl and its main helpers timed in isolation with profiling events
+// sweeps particle counts and local sizes on every device, one JSON of per configuration statistics is written per device
+// --compare checks a result, of this or of the render benchmark, against a stored baseline of the same device
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BenchCommon.h"
+#include "BenchmarkCompare.h"
+#include "BuildProfiles.h"
+#include "CLUtils.h"
+#include "FrameStats.h"
+#include "ParticleState.h"
+#include "Resources.h"
+
+#ifndef CLGLPARTICLES_SOURCE_DIR
+#define CLGLPARTICLES_SOURCE_DIR "."
+#endif
+
+struct BenchOptions : CommonBenchOptions
+{
+	BenchOptions()
+	{
+		numWarmups = 5;
+		numRepetitions = 50;
+	}
+
+	// 10k to 16M, multiples of 1024 so that every local size divides them
+	std::vector<size_t> particleCounts = { 10240, 102400, 1048576, 4194304, 16777216 };
+	// 0 lets the driver choose
+	std::vector<size_t> localSizes = { 0, 32, 64, 128, 256 };
+	// helper calls per work item, enough for the call to dominate the dispatch
+	unsigned int numHelperIterations = 64;
+	const BuildProfile* buildProfile = &getBuildProfiles().front();
+	// results are compared against the baseline of their device in this directory, missing baselines are stored
+	std::string baselineDirectory;
+
+	// comparison only
+	std::string compareBaselinePath;
+	std::string compareRunPath;
+	CompareOptions compareOptions;
+};
+
+// bytes read and written per particle, from the ParticleState fields each kernel accesses
+struct KernelCase
+{
+	const char* name;
+	double bytesPerParticle;
+	bool helper;
+};
+
+static const KernelCase KERNEL_CASES[] =
+{
+	{ "initParticleState", 33.0, false },           // write position, velocity, isAlive
+	{ "initParticleStateFromPoints", 57.0, false }, // read a point, write position, velocity, spawnTime, lifetime, isAlive
+	{ "spawnParticle", 42.0, false },               // read isAlive, write position, velocity, spawnTime, lifetime, isAlive
+	{ "updateParticleState", 65.0, false },         // read isAlive, position, velocity, write position, velocity
+	{ "checkParticleDeath", 26.0, false },          // read isAlive, spawnTime, lifetime, write isAlive, position
+	{ "packRenderState", 41.0, false },             // read position, isAlive, spawnTime, lifetime, write a float4
+	{ "benchRandom01", 4.0, true },                 // write the sum
+	{ "benchRotateVector", 32.0, true },            // read and write a float4
+	{ "benchInitRandomOnCylinder", 12.0, true },    // write position
+};
+
+// the default spawn range of src/Options.h, every particle is dead at the checkParticleDeath time
+static const cl_float2 LIFETIME_RANGE = { { 4.f, 6.f } };
+
+static const char* RESULT_PREFIX = "particle_bench_";
+
+static void printUsage(const char* executable)
+{
+	std::cout
+		<< "Usage: " << executable << " [options]" << std::endl
+		<< "  --particles <n,...>     particle counts (default 10240,102400,1048576,4194304,16777216)" << std::endl
+		<< "  --local-sizes <n,...>   work-group sizes, 0 for the driver's choice (default 0,32,64,128,256)" << std::endl
+		<< "  --cl-profile <name>     OpenCL build profile: precise (default), mad, relaxed, fast, native, half" << std::endl;
+	printCommonBenchUsage(BenchOptions(), RESULT_PREFIX);
+	std::cout
+		<< "  --baseline-dir <dir>    compare each device's result against its baseline there, store it if there is none" << std::endl
+		<< "  --compare <base> <run>  only compare two result files, of this or of the render benchmark" << std::endl
+		<< "  --threshold <percent>   slowdown failing a comparison, at 95% confidence (default 5)" << std::endl
+		<< "  --ignore-device         compare results of different devices" << std::endl
+		<< "  --allow-missing         do not fail on baseline stages missing from the run" << std::endl
+		<< "Comparisons exit with a failure code on regressions and on baseline stages missing from the run." << std::endl;
+}
+
+static bool parseBenchOptions(int argc, char* argv[], BenchOptions& options)
+{
+	setResourceDirectory(CLGLPARTICLES_SOURCE_DIR);
+
+	// --ignore-device and --allow-missing take no value and --compare two, parseBenchArguments only handles single values
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (std::strcmp(option, "--help") == 0)
+		{
+			printUsage(argv[0]);
+			std::exit(EXIT_SUCCESS);
+		}
+		if (std::strcmp(option, "--ignore-device") == 0)
+		{
+			options.compareOptions.ignoreDevice = true;
+			continue;
+		}
+		if (std::strcmp(option, "--allow-missing") == 0)
+		{
+			options.compareOptions.allowMissing = true;
+			continue;
+		}
+
+		if (value == nullptr)
+		{
+			std::cerr << "Missing value for option " << option << std::endl;
+			return false;
+		}
+		++i;
+
+		const BenchOptionResult commonResult = parseCommonBenchOption(option, value, options);
+		if (commonResult == BenchOptionResult::Invalid)
+			return false;
+		if (commonResult == BenchOptionResult::Parsed)
+			continue;
+
+		if (std::strcmp(option, "--particles") == 0)
+		{
+			if (!parseList(value, options.particleCounts))
+				return false;
+		}
+		else if (std::strcmp(option, "--local-sizes") == 0)
+		{
+			if (!parseList(value, options.localSizes))
+				return false;
+		}
+		else if (std::strcmp(option, "--cl-profile") == 0)
+		{
+			options.buildProfile = findBuildProfile(value);
+			if (options.buildProfile == nullptr)
+				return false;
+		}
+		else if (std::strcmp(option, "--baseline-dir") == 0)
+		{
+			options.baselineDirectory = value;
+		}
+		else if (std::strcmp(option, "--compare") == 0)
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << "--compare needs a baseline and a run" << std::endl;
+				return false;
+			}
+			options.compareBaselinePath = value;
+			options.compareRunPath = argv[++i];
+		}
+		else if (std::strcmp(option, "--threshold") == 0)
+		{
+			char* end = nullptr;
+			const double threshold = std::strtod(value, &end);
+			if (end == value || *end != '\0' || threshold < 0.0)
+			{
+				std::cerr << "Invalid threshold '" << value << "'" << std::endl;
+				return false;
+			}
+			options.compareOptions.threshold = threshold * 0.01;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+	return true;
+}
+
+class DeviceBench
+{
+public:
+	DeviceBench(const cl::Device& device, const BenchOptions& options)
+		: device(device), options(options)
+	{
+	}
+
+	bool run(FrameStats& stats)
+	{
+		cl_int code = CL_SUCCESS;
+		context = cl::Context(device, nullptr, nullptr, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Context"))
+			return false;
+
+		commandQueue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &code);
+		if (!checkErrorCode(code, "cl::CommandQueue"))
+			return false;
+
+		if (!buildProgram())
+			return false;
+
+		const cl_ulong maxAllocationSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+		for (size_t numParticles : options.particleCounts)
+		{
+			if (numParticles == 0)
+				continue;
+
+			if (numParticles * sizeof(ParticleState) > maxAllocationSize)
+			{
+				std::cout << "  " << numParticles << " particles skipped, the state buffer exceeds CL_DEVICE_MAX_MEM_ALLOC_SIZE" << std::endl;
+				continue;
+			}
+
+			if (!createBuffers(numParticles))
+				return false;
+
+			for (size_t localSize : options.localSizes)
+			{
+				for (const KernelCase& kernelCase : KERNEL_CASES)
+				{
+					if (!runCase(kernelCase, numParticles, localSize, stats))
+						return false;
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	bool buildProgram()
+	{
+		std::string particleSource;
+		std::string benchSource;
+		if (!loadResource("cl/particle.cl", particleSource) || !loadResource("bench/particle_bench.cl", benchSource))
+			return false;
+
+		cl::Program::Sources sources = { particleSource + "\n" + benchSource };
+		cl_int code = CL_SUCCESS;
+		program = cl::Program(context, sources, &code);
+		if (!checkErrorCode(code, "cl::Program"))
+			return false;
+
+		code = program.build({ device }, options.buildProfile->options);
+		if (code != CL_SUCCESS)
+		{
+			std::cerr << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			return checkErrorCode(code, "clBuildProgram");
+		}
+		return true;
+	}
+
+	bool createBuffers(size_t numParticles)
+	{
+		// release the previous count's buffers first, the largest ones may not fit twice
+		particleStateBuffer = cl::Buffer();
+		float4Buffer = cl::Buffer();
+		pointsBuffer = cl::Buffer();
+
+		cl_int code = CL_SUCCESS;
+		particleStateBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numParticles * sizeof(ParticleState), nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		float4Buffer = cl::Buffer(context, CL_MEM_READ_WRITE, numParticles * sizeof(cl_float4), nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		// one point per particle on a unit grid, initParticleStateFromPoints then reads every point once
+		std::vector<cl_float4> points(numParticles);
+		for (size_t i = 0; i < numParticles; ++i)
+		{
+			points[i] = { { static_cast<float>(i % 1024), static_cast<float>(i / 1024 % 1024), static_cast<float>(i / 1048576), 1.f } };
+		}
+		pointsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, numParticles * sizeof(cl_float4), points.data(), &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		// rotated by benchRotateVector
+		code = commandQueue.enqueueWriteBuffer(float4Buffer, CL_TRUE, 0, numParticles * sizeof(cl_float4), points.data());
+		return checkErrorCode(code, "enqueueWriteBuffer");
+	}
+
+	// all particles dead, then half of them spawned at time 0
+	bool resetParticles(size_t numParticles, cl_uint numParticlesToSpawn)
+	{
+		cl_int code = CL_SUCCESS;
+		cl::Kernel initKernel(program, "initParticleState", &code);
+		code |= initKernel.setArg(0, particleStateBuffer);
+		code |= commandQueue.enqueueNDRangeKernel(initKernel, cl::NullRange, cl::NDRange(numParticles), cl::NullRange);
+		if (!checkErrorCode(code, "initParticleState"))
+			return false;
+
+		if (numParticlesToSpawn == 0)
+			return true;
+
+		cl::Kernel spawnKernel(program, "spawnParticle", &code);
+		const size_t maxLocalSize = spawnKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		code |= setSpawnArgs(spawnKernel, maxLocalSize, numParticlesToSpawn);
+		code |= commandQueue.enqueueNDRangeKernel(spawnKernel, cl::NullRange, cl::NDRange(numParticles), cl::NullRange);
+		return checkErrorCode(code, "spawnParticle");
+	}
+
+	cl_int setSpawnArgs(cl::Kernel& kernel, size_t localSize, cl_uint numParticlesToSpawn)
+	{
+		cl_int code = kernel.setArg(0, particleStateBuffer);
+		code |= kernel.setArg(1, localSize * sizeof(cl_uchar), nullptr);
+		code |= kernel.setArg(2, numParticlesToSpawn);
+		code |= kernel.setArg(3, static_cast<cl_int>(1234));
+		code |= kernel.setArg(4, 0.f);
+		code |= kernel.setArg(5, pointsBuffer);
+		// cylinder spawning, the default without a point cloud
+		code |= kernel.setArg(6, static_cast<cl_uint>(0));
+		code |= kernel.setArg(7, LIFETIME_RANGE);
+		return code;
+	}
+
+	bool runCase(const KernelCase& kernelCase, size_t numParticles, size_t localSize, FrameStats& stats)
+	{
+		cl_int code = CL_SUCCESS;
+		cl::Kernel kernel(program, kernelCase.name, &code);
+		if (!checkErrorCode(code, "cl::Kernel"))
+			return false;
+
+		if (localSize != 0)
+		{
+			const size_t maxLocalSize = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+			if (localSize > maxLocalSize || numParticles % localSize != 0)
+				return true;
+		}
+
+		const cl_uint halfParticles = static_cast<cl_uint>(numParticles / 2);
+		std::function<bool()> prepare;
+		const std::string kernelName = kernelCase.name;
+		if (kernelName == "initParticleState")
+		{
+			code = kernel.setArg(0, particleStateBuffer);
+		}
+		else if (kernelName == "initParticleStateFromPoints")
+		{
+			code = kernel.setArg(0, particleStateBuffer);
+			code |= kernel.setArg(1, pointsBuffer);
+			code |= kernel.setArg(2, static_cast<cl_uint>(numParticles));
+			code |= kernel.setArg(3, 0.f);
+			code |= kernel.setArg(4, LIFETIME_RANGE);
+		}
+		else if (kernelName == "spawnParticle")
+		{
+			// the local buffer holds one flag per work item of the group
+			const size_t spawnLocalSize = localSize != 0 ? localSize : kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+			code = setSpawnArgs(kernel, spawnLocalSize, halfParticles);
+			prepare = [this, numParticles]() { return resetParticles(numParticles, 0); };
+		}
+		else if (kernelName == "updateParticleState")
+		{
+			code = kernel.setArg(0, particleStateBuffer);
+			code |= kernel.setArg(1, static_cast<cl_int>(1234));
+			code |= kernel.setArg(2, 1.f / 60.f);
+			if (!resetParticles(numParticles, halfParticles))
+				return false;
+		}
+		else if (kernelName == "checkParticleDeath")
+		{
+			// every living particle is old enough to die
+			code = kernel.setArg(0, particleStateBuffer);
+			code |= kernel.setArg(1, 10.f);
+			prepare = [this, numParticles, halfParticles]() { return resetParticles(numParticles, halfParticles); };
+		}
+		else if (kernelName == "packRenderState")
+		{
+			code = kernel.setArg(0, particleStateBuffer);
+			code |= kernel.setArg(1, float4Buffer);
+			code |= kernel.setArg(2, 1.f);
+			if (!resetParticles(numParticles, halfParticles))
+				return false;
+		}
+		else if (kernelName == "benchRandom01")
+		{
+			code = kernel.setArg(0, float4Buffer);
+			code |= kernel.setArg(1, static_cast<cl_int>(1234));
+			code |= kernel.setArg(2, options.numHelperIterations);
+		}
+		else if (kernelName == "benchRotateVector")
+		{
+			code = kernel.setArg(0, float4Buffer);
+			code |= kernel.setArg(1, 0.01f);
+			code |= kernel.setArg(2, options.numHelperIterations);
+		}
+		else if (kernelName == "benchInitRandomOnCylinder")
+		{
+			code = kernel.setArg(0, particleStateBuffer);
+			code |= kernel.setArg(1, static_cast<cl_int>(1234));
+			code |= kernel.setArg(2, options.numHelperIterations);
+		}
+		if (!checkErrorCode(code, "setArg"))
+			return false;
+
+		const cl::NDRange localWorkSize = localSize != 0 ? cl::NDRange(localSize) : cl::NullRange;
+		std::vector<double> samples;
+		for (unsigned int i = 0; i < options.numWarmups + options.numRepetitions; ++i)
+		{
+			if (prepare && !prepare())
+				return false;
+
+			cl::Event event;
+			code = commandQueue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(numParticles), localWorkSize, nullptr, &event);
+			if (!checkErrorCode(code, kernelCase.name))
+				return false;
+
+			code = event.wait();
+			if (!checkErrorCode(code, "clWaitForEvents"))
+				return false;
+
+			if (i >= options.numWarmups)
+			{
+				const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+				const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+				samples.push_back(static_cast<double>(end - start) * 1e-6);
+			}
+		}
+
+		const std::string stage = std::string(kernelCase.name) + " n=" + std::to_string(numParticles)
+			+ " local=" + (localSize != 0 ? std::to_string(localSize) : std::string("auto"));
+		for (double sample : samples)
+		{
+			stats.add(stage, sample);
+		}
+
+		// derived from the median, a single slow run does not skew it
+		const FrameStats::Summary summary = FrameStats::summarize(samples);
+		const double seconds = summary.p50 * 1e-3;
+		const double numCalls = static_cast<double>(numParticles) * (kernelCase.helper ? options.numHelperIterations : 1);
+		const double gigabytesPerSecond = seconds > 0.0 ? kernelCase.bytesPerParticle * static_cast<double>(numParticles) / seconds * 1e-9 : 0.0;
+		const double callsPerSecond = seconds > 0.0 ? numCalls / seconds : 0.0;
+		stats.setStageValue(stage, "particles", static_cast<double>(numParticles));
+		stats.setStageValue(stage, "localSize", static_cast<double>(localSize));
+		stats.setStageValue(stage, "bytesPerParticle", kernelCase.bytesPerParticle);
+		stats.setStageValue(stage, "gbPerSecond", gigabytesPerSecond);
+		if (kernelCase.helper)
+		{
+			stats.setStageValue(stage, "callsPerSecond", callsPerSecond);
+		}
+
+		std::printf("  %-56s p50 %9.4f ms  mean %9.4f +- %8.4f ms  %8.2f GB/s\n", stage.c_str(), summary.p50, summary.mean, summary.stddev, gigabytesPerSecond);
+		return true;
+	}
+
+	cl::Device device;
+	const BenchOptions& options;
+	cl::Context context;
+	cl::CommandQueue commandQueue;
+	cl::Program program;
+	cl::Buffer particleStateBuffer;
+	// render records, helper results and rotated vectors
+	cl::Buffer float4Buffer;
+	cl::Buffer pointsBuffer;
+};
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options;
+	if (!parseBenchOptions(argc, argv, options))
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (!options.compareBaselinePath.empty())
+	{
+		return compareBenchmarks(options.compareBaselinePath, options.compareRunPath, options.compareOptions) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	std::vector<cl::Platform> platforms;
+	bool regressed = false;
+	cl::Platform::get(&platforms);
+	unsigned int numDevices = 0;
+	for (const cl::Platform& platform : platforms)
+	{
+		std::vector<cl::Device> devices;
+		if (platform.getDevices(CL_DEVICE_TYPE_ALL, &devices) != CL_SUCCESS)
+			continue;
+
+		for (const cl::Device& device : devices)
+		{
+			const std::string deviceName = device.getInfo<CL_DEVICE_NAME>();
+			if (!options.deviceFilter.empty() && deviceName.find(options.deviceFilter) == std::string::npos)
+				continue;
+
+			++numDevices;
+			std::cout << deviceName << " (" << platform.getInfo<CL_PLATFORM_NAME>() << ")" << std::endl;
+
+			FrameStats stats;
+			stats.setInfo("benchmark", "particle_bench");
+			stats.setInfo("device", deviceName);
+			stats.setInfo("platform", platform.getInfo<CL_PLATFORM_NAME>());
+			stats.setInfo("driverVersion", device.getInfo<CL_DRIVER_VERSION>());
+			stats.setInfo("computeUnits", static_cast<double>(device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()));
+			stats.setInfo("warmupRuns", static_cast<double>(options.numWarmups));
+			stats.setInfo("repetitions", static_cast<double>(options.numRepetitions));
+			stats.setInfo("helperIterations", static_cast<double>(options.numHelperIterations));
+			stats.setInfo("buildProfile", options.buildProfile->name);
+
+			DeviceBench bench(device, options);
+			if (!bench.run(stats))
+			{
+				std::cerr << "Benchmark failed on " << deviceName << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			// each profile has its own baseline
+			const bool isPreciseProfile = options.buildProfile == &getBuildProfiles().front();
+			const std::string resultFileName = getResultFileName(RESULT_PREFIX, isPreciseProfile ? deviceName : deviceName + " " + options.buildProfile->name);
+			const std::string resultPath = options.outputDirectory + "/" + resultFileName;
+			if (!stats.writeJson(resultPath))
+			{
+				return EXIT_FAILURE;
+			}
+
+			if (!options.baselineDirectory.empty())
+			{
+				const std::string baselinePath = options.baselineDirectory + "/" + resultFileName;
+				if (std::ifstream(baselinePath.c_str()).is_open())
+				{
+					regressed |= !compareBenchmarks(baselinePath, resultPath, options.compareOptions);
+				}
+				else if (stats.writeJson(baselinePath))
+				{
+					std::cout << "  stored as the baseline " << baselinePath << std::endl;
+				}
+			}
+		}
+	}
+
+	if (numDevices == 0)
+	{
+		std::cerr << "No OpenCL device found" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
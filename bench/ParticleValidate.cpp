@@ -0,0 +1,749 @@
+// cross-backend validation: the same spawn, update and death sequence from a fixed seed and time step
+// on the native C++ implementation and on every OpenCL device, particle states compared after every step
+// the native backend is the reference, a backend fails when a field leaves its tolerance
+// --profiles builds every OpenCL build profile on every device and reports its speed and drift against the precise profile
+// --curl-noise validates the PARTICLE_CURL_NOISE update that the application builds by default, the white noise one otherwise
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BenchCommon.h"
+#include "BuildProfiles.h"
+#include "CLUtils.h"
+#include "CurlNoise.h"
+#include "NativeParticles.h"
+#include "ParticleState.h"
+#include "Random.h"
+#include "Resources.h"
+
+#ifndef CLGLPARTICLES_SOURCE_DIR
+#define CLGLPARTICLES_SOURCE_DIR "."
+#endif
+
+struct ValidateOptions
+{
+	unsigned int numParticles = 65536;
+	// 6 seconds, every particle spawned in the first second dies once
+	unsigned int numSteps = 360;
+	unsigned int seed = 1;
+	unsigned int localSize = 64;
+	unsigned int numSpawnPoints = 0;
+	float spawnRate = 20000.f;
+	float deltaTime = 1.f / 60.f;
+	// the longest lifetime plus the first second of spawns fits in the steps
+	cl_float2 lifetimeRange = { { 4.f, 5.f } };
+	// passed to the OpenCL compiler, e.g. -cl-fast-relaxed-math
+	std::string buildOptions;
+	// the precise profile comes first, the others are compared against it
+	std::vector<const BuildProfile*> profiles;
+	// |value - reference| <= absolute + relative * |reference|
+	float positionAbsoluteTolerance = 1e-3f;
+	float velocityAbsoluteTolerance = 1e-3f;
+	float relativeTolerance = 1e-4f;
+	float spawnTimeTolerance = 0.f;
+	// strength of the application's curl-noise volume, 0 for the white noise update
+	float curlNoiseStrength = 0.f;
+};
+
+// inputs of one simulation step, identical for every backend
+struct StepInput
+{
+	cl_uint numParticlesToSpawn = 0;
+	cl_int spawnSeed = 0;
+	cl_int updateSeed = 0;
+	cl_float currentTime = 0.f;
+	cl_float deltaTime = 0.f;
+	cl_float4 curlNoiseTransform = { { 0.f, 0.f, 0.f, 0.f } };
+};
+
+class Backend
+{
+public:
+	virtual ~Backend() = default;
+
+	const std::string& getName() const { return name; }
+
+	// zeroed state, then initParticleState
+	virtual bool reset() = 0;
+	virtual bool step(const StepInput& input) = 0;
+	virtual bool readState(std::vector<ParticleState>& state) = 0;
+
+	// device time of the kernels, 0 when not measured
+	virtual double getMillisecondsPerStep() const { return 0.0; }
+
+protected:
+	std::string name;
+};
+
+class NativeBackend : public Backend
+{
+public:
+	NativeBackend(const ValidateOptions& options, const std::vector<cl_float4>& spawnPoints, const std::vector<cl_float4>& curlNoise)
+		: options(options), spawnPoints(spawnPoints), curlNoise(curlNoise)
+	{
+		name = "native C++";
+	}
+
+	bool reset() override
+	{
+		particles.assign(options.numParticles, ParticleState());
+		nativeInitParticleState(particles.data(), particles.size());
+		return true;
+	}
+
+	bool step(const StepInput& input) override
+	{
+		if (input.numParticlesToSpawn > 0)
+		{
+			nativeSpawnParticle(particles.data(), particles.size(), options.localSize, input.numParticlesToSpawn, input.spawnSeed,
+				input.currentTime, spawnPoints.data(), static_cast<cl_uint>(spawnPoints.size()), options.lifetimeRange);
+		}
+		if (curlNoise.empty())
+		{
+			nativeUpdateParticleState(particles.data(), particles.size(), input.updateSeed, input.deltaTime);
+		}
+		else
+		{
+			const NativeCurlNoise nativeCurlNoise = { curlNoise.data(), CURL_NOISE_SIZE, input.curlNoiseTransform, options.curlNoiseStrength };
+			nativeUpdateParticleState(particles.data(), particles.size(), input.updateSeed, input.deltaTime, &nativeCurlNoise);
+		}
+		nativeCheckParticleDeath(particles.data(), particles.size(), input.currentTime);
+		return true;
+	}
+
+	bool readState(std::vector<ParticleState>& state) override
+	{
+		state = particles;
+		return true;
+	}
+
+private:
+	const ValidateOptions& options;
+	const std::vector<cl_float4>& spawnPoints;
+	const std::vector<cl_float4>& curlNoise;
+	std::vector<ParticleState> particles;
+};
+
+class OpenCLBackend : public Backend
+{
+public:
+	OpenCLBackend(const cl::Device& device, const ValidateOptions& options, const std::string& buildOptions, const char* profileName)
+		: device(device), options(options), buildOptions(buildOptions)
+	{
+		const cl_device_type type = device.getInfo<CL_DEVICE_TYPE>();
+		name = std::string("OpenCL ") + (type & CL_DEVICE_TYPE_GPU ? "GPU" : type & CL_DEVICE_TYPE_CPU ? "CPU" : "device")
+			+ ": " + device.getInfo<CL_DEVICE_NAME>();
+		if (profileName != nullptr)
+		{
+			name += std::string(" [") + profileName + "]";
+		}
+	}
+
+	bool init(const std::string& source, const std::vector<cl_float4>& spawnPoints, const std::vector<cl_float4>& curlNoise)
+	{
+		if (!curlNoise.empty() && device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() != CL_TRUE)
+		{
+			std::cerr << "The curl noise needs image support" << std::endl;
+			return false;
+		}
+
+		cl_int code = CL_SUCCESS;
+		context = cl::Context(device, nullptr, nullptr, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Context"))
+			return false;
+
+		commandQueue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &code);
+		if (!checkErrorCode(code, "cl::CommandQueue"))
+			return false;
+
+		cl::Program::Sources sources = { source };
+		program = cl::Program(context, sources, &code);
+		if (!checkErrorCode(code, "cl::Program"))
+			return false;
+
+		const std::string programOptions = curlNoise.empty() ? buildOptions : buildOptions + " -DPARTICLE_CURL_NOISE";
+		code = program.build({ device }, programOptions.c_str());
+		if (code != CL_SUCCESS)
+		{
+			std::cerr << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			return checkErrorCode(code, "clBuildProgram");
+		}
+
+		particleStateBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, options.numParticles * sizeof(ParticleState), nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		// a buffer of size 0 is invalid, the kernel never reads it without spawn points
+		std::vector<cl_float4> spawnPointsData = spawnPoints;
+		spawnPointsData.resize(std::max<size_t>(spawnPointsData.size(), 1));
+		spawnPointsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, spawnPointsData.size() * sizeof(cl_float4), spawnPointsData.data(), &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+
+		cl::Kernel* kernels[] = { &initParticleStateKernel, &spawnParticleKernel, &updateParticleStateKernel, &checkParticleDeathKernel };
+		const char* kernelNames[] = { "initParticleState", "spawnParticle", "updateParticleState", "checkParticleDeath" };
+		for (size_t i = 0; i < 4; ++i)
+		{
+			*kernels[i] = cl::Kernel(program, kernelNames[i], &code);
+			if (!checkErrorCode(code, "cl::Kernel"))
+				return false;
+
+			code = kernels[i]->setArg(0, particleStateBuffer);
+			if (!checkErrorCode(code, "setArg"))
+				return false;
+		}
+
+		code = spawnParticleKernel.setArg(1, options.localSize * sizeof(cl_uchar), nullptr);
+		code |= spawnParticleKernel.setArg(5, spawnPointsBuffer);
+		code |= spawnParticleKernel.setArg(6, static_cast<cl_uint>(spawnPoints.size()));
+		code |= spawnParticleKernel.setArg(7, options.lifetimeRange);
+		if (!checkErrorCode(code, "setArg"))
+			return false;
+
+		if (!curlNoise.empty())
+		{
+			curlNoiseImage = cl::Image3D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cl::ImageFormat(CL_RGBA, CL_FLOAT),
+				CURL_NOISE_SIZE, CURL_NOISE_SIZE, CURL_NOISE_SIZE, 0, 0, const_cast<cl_float4*>(curlNoise.data()), &code);
+			if (!checkErrorCode(code, "cl::Image3D"))
+				return false;
+
+			// the transform follows the simulation time, set per step
+			code = updateParticleStateKernel.setArg(3, curlNoiseImage);
+			code |= updateParticleStateKernel.setArg(5, options.curlNoiseStrength);
+			if (!checkErrorCode(code, "setArg"))
+				return false;
+		}
+		hasCurlNoise = !curlNoise.empty();
+		return true;
+	}
+
+	bool reset() override
+	{
+		// spawnTime, lifetime and the padding are not written by initParticleState
+		const std::vector<ParticleState> zeroed(options.numParticles, ParticleState());
+		cl_int code = commandQueue.enqueueWriteBuffer(particleStateBuffer, CL_FALSE, 0, zeroed.size() * sizeof(ParticleState), zeroed.data());
+		code |= enqueue(initParticleStateKernel);
+		code |= commandQueue.finish();
+		stepEvents.clear();
+		return checkErrorCode(code, "reset");
+	}
+
+	bool step(const StepInput& input) override
+	{
+		cl_int code = CL_SUCCESS;
+		if (input.numParticlesToSpawn > 0)
+		{
+			code |= spawnParticleKernel.setArg(2, input.numParticlesToSpawn);
+			code |= spawnParticleKernel.setArg(3, input.spawnSeed);
+			code |= spawnParticleKernel.setArg(4, input.currentTime);
+			code |= enqueue(spawnParticleKernel);
+		}
+		code |= updateParticleStateKernel.setArg(1, input.updateSeed);
+		code |= updateParticleStateKernel.setArg(2, input.deltaTime);
+		if (hasCurlNoise)
+		{
+			code |= updateParticleStateKernel.setArg(4, input.curlNoiseTransform);
+		}
+		code |= enqueue(updateParticleStateKernel);
+		code |= checkParticleDeathKernel.setArg(1, input.currentTime);
+		code |= enqueue(checkParticleDeathKernel);
+		return checkErrorCode(code, "step");
+	}
+
+	bool readState(std::vector<ParticleState>& state) override
+	{
+		state.resize(options.numParticles);
+		cl_int code = commandQueue.enqueueReadBuffer(particleStateBuffer, CL_TRUE, 0, state.size() * sizeof(ParticleState), state.data());
+		if (!checkErrorCode(code, "enqueueReadBuffer"))
+			return false;
+
+		// the step's kernels are done once the blocking read returns
+		if (!stepEvents.empty())
+		{
+			for (const cl::Event& event : stepEvents)
+			{
+				const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+				const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+				kernelMilliseconds += static_cast<double>(end - start) * 1e-6;
+			}
+			stepEvents.clear();
+			++numTimedSteps;
+		}
+		return true;
+	}
+
+	double getMillisecondsPerStep() const override
+	{
+		return numTimedSteps > 0 ? kernelMilliseconds / numTimedSteps : 0.0;
+	}
+
+private:
+	// the spawn distribution depends on the work-group size, every backend uses the same
+	cl_int enqueue(const cl::Kernel& kernel)
+	{
+		cl::Event event;
+		const cl_int code = commandQueue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(options.numParticles), cl::NDRange(options.localSize), nullptr, &event);
+		stepEvents.push_back(event);
+		return code;
+	}
+
+	cl::Device device;
+	const ValidateOptions& options;
+	std::string buildOptions;
+	cl::Context context;
+	cl::CommandQueue commandQueue;
+	cl::Program program;
+	cl::Buffer particleStateBuffer;
+	cl::Buffer spawnPointsBuffer;
+	cl::Image3D curlNoiseImage;
+	bool hasCurlNoise = false;
+	cl::Kernel initParticleStateKernel;
+	cl::Kernel spawnParticleKernel;
+	cl::Kernel updateParticleStateKernel;
+	cl::Kernel checkParticleDeathKernel;
+	std::vector<cl::Event> stepEvents;
+	double kernelMilliseconds = 0.0;
+	unsigned int numTimedSteps = 0;
+};
+
+// divergence of one field against the reference
+struct FieldStats
+{
+	const char* name = "";
+	double maxError = 0.0;
+	double sumError = 0.0;
+	double sumSquaredError = 0.0;
+	size_t numCompared = 0;
+	size_t numOutOfTolerance = 0;
+	size_t worstParticle = 0;
+
+	void add(size_t particle, double error, bool withinTolerance)
+	{
+		if (error > maxError)
+		{
+			maxError = error;
+			worstParticle = particle;
+		}
+		sumError += error;
+		sumSquaredError += error * error;
+		++numCompared;
+		numOutOfTolerance += withinTolerance ? 0 : 1;
+	}
+
+	void print() const
+	{
+		const double count = static_cast<double>(std::max<size_t>(numCompared, 1));
+		std::printf("    %-10s max %12.6g (particle %zu)  mean %12.6g  rms %12.6g  out of tolerance %zu\n",
+			name, maxError, worstParticle, sumError / count, std::sqrt(sumSquaredError / count), numOutOfTolerance);
+	}
+};
+
+struct Divergence
+{
+	FieldStats position;
+	FieldStats velocity;
+	FieldStats spawnTime;
+	FieldStats lifetime;
+	FieldStats isAlive;
+
+	Divergence()
+	{
+		position.name = "position";
+		velocity.name = "velocity";
+		spawnTime.name = "spawnTime";
+		lifetime.name = "lifetime";
+		isAlive.name = "isAlive";
+	}
+
+	size_t getNumOutOfTolerance() const
+	{
+		return position.numOutOfTolerance + velocity.numOutOfTolerance + spawnTime.numOutOfTolerance + lifetime.numOutOfTolerance
+			+ isAlive.numOutOfTolerance;
+	}
+};
+
+static double getVectorError(const cl_float3& value, const cl_float3& reference, double& referenceLength)
+{
+	double squaredError = 0.0;
+	double squaredLength = 0.0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const double difference = static_cast<double>(value.s[axis]) - reference.s[axis];
+		squaredError += difference * difference;
+		squaredLength += static_cast<double>(reference.s[axis]) * reference.s[axis];
+	}
+	referenceLength = std::sqrt(squaredLength);
+	return std::sqrt(squaredError);
+}
+
+// dead particles only hold their reset position, the other fields are compared for living particles
+static Divergence compareStates(const std::vector<ParticleState>& state, const std::vector<ParticleState>& reference, const ValidateOptions& options)
+{
+	Divergence divergence;
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		const ParticleState& particle = state[i];
+		const ParticleState& referenceParticle = reference[i];
+		const bool isAliveMatches = (particle.isAlive != 0) == (referenceParticle.isAlive != 0);
+		divergence.isAlive.add(i, isAliveMatches ? 0.0 : 1.0, isAliveMatches);
+
+		double referenceLength = 0.0;
+		const double positionError = getVectorError(particle.position, referenceParticle.position, referenceLength);
+		divergence.position.add(i, positionError, positionError <= options.positionAbsoluteTolerance + options.relativeTolerance * referenceLength);
+
+		if (!referenceParticle.isAlive || !isAliveMatches)
+			continue;
+
+		const double velocityError = getVectorError(particle.velocity, referenceParticle.velocity, referenceLength);
+		divergence.velocity.add(i, velocityError, velocityError <= options.velocityAbsoluteTolerance + options.relativeTolerance * referenceLength);
+
+		const double spawnTimeError = std::abs(static_cast<double>(particle.spawnTime) - referenceParticle.spawnTime);
+		divergence.spawnTime.add(i, spawnTimeError, spawnTimeError <= options.spawnTimeTolerance);
+
+		const double lifetimeError = std::abs(static_cast<double>(particle.lifetime) - referenceParticle.lifetime);
+		divergence.lifetime.add(i, lifetimeError, lifetimeError <= options.relativeTolerance * referenceParticle.lifetime);
+	}
+	return divergence;
+}
+
+static bool parseFloat(const char* value, float& result)
+{
+	char* end = nullptr;
+	const float parsed = std::strtof(value, &end);
+	if (end == value || *end != '\0' || parsed < 0.f)
+	{
+		std::cerr << "Invalid number '" << value << "'" << std::endl;
+		return false;
+	}
+	result = parsed;
+	return true;
+}
+
+// all, or comma separated names, the precise profile is always added first
+static bool parseProfiles(const char* value, std::vector<const BuildProfile*>& profiles)
+{
+	profiles = { &getBuildProfiles().front() };
+	if (std::strcmp(value, "all") == 0)
+	{
+		for (size_t i = 1; i < getBuildProfiles().size(); ++i)
+		{
+			profiles.push_back(&getBuildProfiles()[i]);
+		}
+		return true;
+	}
+
+	std::string names = value;
+	size_t begin = 0;
+	while (begin <= names.size())
+	{
+		const size_t end = std::min(names.find(',', begin), names.size());
+		const BuildProfile* profile = findBuildProfile(names.substr(begin, end - begin));
+		if (profile == nullptr)
+			return false;
+		if (std::find(profiles.begin(), profiles.end(), profile) == profiles.end())
+		{
+			profiles.push_back(profile);
+		}
+		begin = end + 1;
+	}
+	return true;
+}
+
+static void printUsage(const char* executable)
+{
+	std::cout
+		<< "Usage: " << executable << " [options]" << std::endl
+		<< "  --particles <n>            number of particles, a multiple of the local size (default 65536)" << std::endl
+		<< "  --steps <n>                simulation steps (default 360)" << std::endl
+		<< "  --seed <n>                 seed of the per step kernel seeds (default 1)" << std::endl
+		<< "  --local-size <n>           work-group size of every backend (default 64)" << std::endl
+		<< "  --spawn-rate <n>           particles spawned per second (default 20000)" << std::endl
+		<< "  --spawn-points <n>         spawn from n points instead of the cylinder (default 0)" << std::endl
+		<< "  --build-options <options>  OpenCL compiler options, e.g. -cl-fast-relaxed-math, appended to each profile's" << std::endl
+		<< "  --profiles <all|a,b,...>   compare OpenCL build profiles against the precise one, see src/BuildProfiles.h" << std::endl
+		<< "  --position-tolerance <t>   absolute position tolerance (default 1e-3)" << std::endl
+		<< "  --velocity-tolerance <t>   absolute velocity tolerance (default 1e-3)" << std::endl
+		<< "  --relative-tolerance <t>   added relative tolerance of position and velocity (default 1e-4)" << std::endl
+		<< "  --spawn-time-tolerance <t> (default 0)" << std::endl
+		<< "  --curl-noise <strength>    validate the curl-noise update with the application's volume, 60 as in the application" << std::endl
+		<< "                             (default 0, the white noise update); devices may filter with reduced precision weights, the" << std::endl
+		<< "                             position and velocity tolerances may need loosening" << std::endl
+		<< "  --resources <dir>          directory holding cl/ (default the source tree)" << std::endl;
+}
+
+static bool parseValidateOptions(int argc, char* argv[], ValidateOptions& options)
+{
+	setResourceDirectory(CLGLPARTICLES_SOURCE_DIR);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		if (std::strcmp(option, "--help") == 0)
+		{
+			printUsage(argv[0]);
+			std::exit(EXIT_SUCCESS);
+		}
+
+		if (i + 1 >= argc)
+		{
+			std::cerr << "Missing value for option " << option << std::endl;
+			return false;
+		}
+		const char* value = argv[++i];
+
+		bool parsed = true;
+		if (std::strcmp(option, "--particles") == 0)
+			parsed = parseUnsigned(value, options.numParticles);
+		else if (std::strcmp(option, "--steps") == 0)
+			parsed = parseUnsigned(value, options.numSteps);
+		else if (std::strcmp(option, "--seed") == 0)
+			parsed = parseUnsigned(value, options.seed);
+		else if (std::strcmp(option, "--local-size") == 0)
+			parsed = parseUnsigned(value, options.localSize);
+		else if (std::strcmp(option, "--spawn-rate") == 0)
+			parsed = parseFloat(value, options.spawnRate);
+		else if (std::strcmp(option, "--spawn-points") == 0)
+			parsed = parseUnsigned(value, options.numSpawnPoints);
+		else if (std::strcmp(option, "--build-options") == 0)
+			options.buildOptions = value;
+		else if (std::strcmp(option, "--profiles") == 0)
+			parsed = parseProfiles(value, options.profiles);
+		else if (std::strcmp(option, "--position-tolerance") == 0)
+			parsed = parseFloat(value, options.positionAbsoluteTolerance);
+		else if (std::strcmp(option, "--velocity-tolerance") == 0)
+			parsed = parseFloat(value, options.velocityAbsoluteTolerance);
+		else if (std::strcmp(option, "--relative-tolerance") == 0)
+			parsed = parseFloat(value, options.relativeTolerance);
+		else if (std::strcmp(option, "--spawn-time-tolerance") == 0)
+			parsed = parseFloat(value, options.spawnTimeTolerance);
+		else if (std::strcmp(option, "--curl-noise") == 0)
+			parsed = parseFloat(value, options.curlNoiseStrength);
+		else if (std::strcmp(option, "--resources") == 0)
+			setResourceDirectory(value);
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return false;
+		}
+
+		if (!parsed)
+			return false;
+	}
+
+	if (options.localSize == 0 || options.numParticles == 0 || options.numParticles % options.localSize != 0)
+	{
+		std::cerr << "The particle count must be a non-zero multiple of the local size" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	ValidateOptions options;
+	if (!parseValidateOptions(argc, argv, options))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::string source;
+	if (!loadResource("cl/particle.cl", source))
+	{
+		return EXIT_FAILURE;
+	}
+
+	// a ring of points on the ground
+	std::vector<cl_float4> spawnPoints(options.numSpawnPoints);
+	for (size_t i = 0; i < spawnPoints.size(); ++i)
+	{
+		const float angle = static_cast<float>(i) / static_cast<float>(spawnPoints.size()) * 6.2831853f;
+		spawnPoints[i] = { { std::cos(angle) * 30.f, 0.f, std::sin(angle) * 30.f, 1.f } };
+	}
+
+	// the volume of the application, sampled with the same transform
+	std::vector<cl_float4> curlNoise;
+	if (options.curlNoiseStrength > 0.f)
+	{
+		curlNoise = bakeCurlNoise(CURL_NOISE_SIZE, CURL_NOISE_SEED);
+	}
+
+	std::vector<std::unique_ptr<Backend>> backends;
+	// the backend each one is compared against, the precise profile of the same device or else the native backend
+	std::vector<size_t> referenceIndices;
+	backends.push_back(std::make_unique<NativeBackend>(options, spawnPoints, curlNoise));
+	referenceIndices.push_back(0);
+
+	std::vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+	for (const cl::Platform& platform : platforms)
+	{
+		std::vector<cl::Device> devices;
+		if (platform.getDevices(CL_DEVICE_TYPE_ALL, &devices) != CL_SUCCESS)
+			continue;
+
+		for (const cl::Device& device : devices)
+		{
+			if (options.profiles.empty())
+			{
+				std::unique_ptr<OpenCLBackend> backend = std::make_unique<OpenCLBackend>(device, options, options.buildOptions, nullptr);
+				if (!backend->init(source, spawnPoints, curlNoise))
+				{
+					std::cerr << "Skipping " << backend->getName() << std::endl;
+					continue;
+				}
+				backends.push_back(std::move(backend));
+				referenceIndices.push_back(0);
+				continue;
+			}
+
+			// parseProfiles puts the precise profile first, without it the device has no reference for the others
+			size_t preciseIndex = 0;
+			for (const BuildProfile* profile : options.profiles)
+			{
+				const bool precise = profile == &getBuildProfiles().front();
+				std::string profileOptions = profile->options;
+				if (!options.buildOptions.empty())
+				{
+					profileOptions += " " + options.buildOptions;
+				}
+				std::unique_ptr<OpenCLBackend> backend = std::make_unique<OpenCLBackend>(device, options, profileOptions, profile->name);
+				if (!backend->init(source, spawnPoints, curlNoise))
+				{
+					std::cerr << "Skipping " << backend->getName() << std::endl;
+					if (precise)
+					{
+						std::cerr << "No precise reference on " << device.getInfo<CL_DEVICE_NAME>() << ", skipping its other profiles" << std::endl;
+						break;
+					}
+					continue;
+				}
+				if (precise)
+				{
+					// compared against the native backend, the strict reference
+					referenceIndices.push_back(0);
+					preciseIndex = backends.size();
+				}
+				else
+				{
+					referenceIndices.push_back(preciseIndex);
+				}
+				backends.push_back(std::move(backend));
+			}
+		}
+	}
+
+	if (backends.size() < 2)
+	{
+		std::cerr << "No OpenCL device to validate against the native backend" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	for (const std::unique_ptr<Backend>& backend : backends)
+	{
+		if (!backend->reset())
+			return EXIT_FAILURE;
+	}
+
+	std::cout << options.numParticles << " particles, " << options.numSteps << " steps of " << options.deltaTime << " s, seed " << options.seed
+		<< ", local size " << options.localSize << (options.buildOptions.empty() ? "" : ", build options " + options.buildOptions)
+		<< (curlNoise.empty() ? ", white noise" : ", curl noise of strength " + std::to_string(options.curlNoiseStrength)) << std::endl;
+
+	// same step inputs as Simulation::step(), the host time is accumulated in double
+	Pcg32 rng;
+	rng.seed(options.seed, 0);
+	double simulationTime = 0.0;
+	double pendingSpawns = 0.0;
+
+	std::vector<Divergence> finalDivergences(backends.size());
+	std::vector<int> firstDivergentSteps(backends.size(), -1);
+	std::vector<double> maxPositionErrors(backends.size(), 0.0);
+	std::vector<std::vector<ParticleState>> states(backends.size());
+	for (unsigned int stepIndex = 0; stepIndex < options.numSteps; ++stepIndex)
+	{
+		simulationTime += options.deltaTime;
+		StepInput input;
+		input.currentTime = static_cast<cl_float>(simulationTime);
+		input.deltaTime = options.deltaTime;
+		input.curlNoiseTransform = getCurlNoiseTransform(CURL_NOISE_SCALE, CURL_NOISE_SCROLL_SPEED, simulationTime);
+		pendingSpawns += static_cast<double>(options.spawnRate) * options.deltaTime;
+		input.numParticlesToSpawn = static_cast<cl_uint>(std::floor(pendingSpawns));
+		pendingSpawns -= input.numParticlesToSpawn;
+		if (input.numParticlesToSpawn > 0)
+		{
+			input.spawnSeed = rng.nextSeed();
+		}
+		input.updateSeed = rng.nextSeed();
+
+		for (const std::unique_ptr<Backend>& backend : backends)
+		{
+			if (!backend->step(input))
+				return EXIT_FAILURE;
+		}
+
+		for (size_t i = 0; i < backends.size(); ++i)
+		{
+			if (!backends[i]->readState(states[i]))
+				return EXIT_FAILURE;
+		}
+
+		for (size_t i = 1; i < backends.size(); ++i)
+		{
+			finalDivergences[i] = compareStates(states[i], states[referenceIndices[i]], options);
+			maxPositionErrors[i] = std::max(maxPositionErrors[i], finalDivergences[i].position.maxError);
+			if (firstDivergentSteps[i] < 0 && finalDivergences[i].getNumOutOfTolerance() > 0)
+			{
+				firstDivergentSteps[i] = static_cast<int>(stepIndex);
+			}
+		}
+	}
+
+	// faster profiles are expected to drift, only the backends compared against the native one can fail
+	bool passed = true;
+	for (size_t i = 1; i < backends.size(); ++i)
+	{
+		const Divergence& divergence = finalDivergences[i];
+		const size_t referenceIndex = referenceIndices[i];
+		std::cout << backends[i]->getName() << " against " << backends[referenceIndex]->getName() << std::endl;
+		if (firstDivergentSteps[i] >= 0)
+		{
+			std::cout << "  " << (referenceIndex == 0 ? "FAILED" : "drifted") << ", out of tolerance from step " << firstDivergentSteps[i] << std::endl;
+			passed &= referenceIndex != 0;
+		}
+		else
+		{
+			std::cout << "  within tolerance" << std::endl;
+		}
+		std::cout << "  last step:" << std::endl;
+		divergence.position.print();
+		divergence.velocity.print();
+		divergence.spawnTime.print();
+		divergence.lifetime.print();
+		divergence.isAlive.print();
+		std::printf("  max position error over all steps %.6g\n", maxPositionErrors[i]);
+		if (referenceIndex != 0)
+		{
+			const double referenceMilliseconds = backends[referenceIndex]->getMillisecondsPerStep();
+			const double milliseconds = backends[i]->getMillisecondsPerStep();
+			std::printf("  %.4f ms per step against %.4f ms, %.2fx\n", milliseconds, referenceMilliseconds,
+				milliseconds > 0.0 ? referenceMilliseconds / milliseconds : 0.0);
+		}
+	}
+
+	if (!options.profiles.empty())
+	{
+		std::printf("\n%-64s %12s %14s %14s\n", "profile", "ms per step", "max pos error", "first drift");
+		for (size_t i = 1; i < backends.size(); ++i)
+		{
+			std::printf("%-64s %12.4f %14.6g %14d\n", backends[i]->getName().c_str(), backends[i]->getMillisecondsPerStep(),
+				maxPositionErrors[i], firstDivergentSteps[i]);
+		}
+	}
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,40 @@
+// wrappers timing the helpers of cl/particle.cl in isolation, compiled appended to it
+// every work item calls the helper numIterations times and writes one result so the calls cannot be optimized out
+
+__kernel void benchRandom01(__global float* results, int globalSeed, uint numIterations)
+{
+	RngValue rng;
+	randomInit(&rng, globalSeed);
+
+	float sum = 0.f;
+	for (uint i = 0; i < numIterations; ++i)
+	{
+		sum += random01(&rng);
+	}
+	results[get_global_id(0)] = sum;
+}
+
+__kernel void benchRotateVector(__global float4* vectors, float theta, uint numIterations)
+{
+	size_t id = get_global_id(0);
+	float3 v = vectors[id].xyz;
+	const float3 k = (float3)(0.f, 1.f, 0.f);
+	for (uint i = 0; i < numIterations; ++i)
+	{
+		v = rotateVector(v, k, theta);
+	}
+	vectors[id] = (float4)(v, 0.f);
+}
+
+__kernel void benchInitRandomOnCylinder(__global ParticleState* particles, int globalSeed, uint numIterations)
+{
+	__global ParticleState* particle = &particles[get_global_id(0)];
+
+	RngValue rng;
+	randomInit(&rng, globalSeed);
+
+	for (uint i = 0; i < numIterations; ++i)
+	{
+		initRandomOnCylinder(particle, 45.f, 0.f, &rng);
+	}
+}
@@ -0,0 +1,340 @@
+// triangle mesh collision through a linear BVH (Karras 2012, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees")
+// appended to cl/particle.cl and built with PARTICLE_MESH_COLLISION, see src/MeshBvh.h
+// the triangles are sorted along a Morton curve of their centroids, the hierarchy is derived from the sorted codes in
+// one pass over the internal nodes and the bounds are merged bottom-up, the second child to arrive at a node merges it
+
+// n - 1 internal nodes first, the root at 0, then n leaves
+typedef struct
+{
+	float4 boundsMin;
+	float4 boundsMax;
+	int left;
+	int right;
+	int parent;
+	// -1 for internal nodes
+	int triangle;
+} BvhNode;
+
+// deepest traversal stack, enough for the hierarchies of 30 bit codes plus their tie breaks
+// a full stack skips the children of the node, BVH_COUNT_STACK_OVERFLOWS counts the particles it happened to
+#define BVH_STACK_SIZE 64
+// distance the particles are kept from the surface they hit, so that the next segment starts in front of it
+#define MESH_COLLISION_OFFSET 1e-3f
+
+// interleaves the lower 10 bits with two zeros each
+uint expandBits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// 30 bit Morton code of a point in the unit cube
+uint morton3D(float3 p)
+{
+	uint3 cell = convert_uint3(clamp(p * 1024.f, 0.f, 1023.f));
+	return (expandBits(cell.x) << 2) | (expandBits(cell.y) << 1) | expandBits(cell.z);
+}
+
+// one code per triangle, the padding up to the sorted power of two sorts last
+__kernel void computeMortonCodes(
+	__global const float4* triangles,
+	uint numTriangles,
+	float4 sceneMin,
+	float4 sceneInverseExtent,
+	__global uint* keys,
+	__global uint* values)
+{
+	uint id = get_global_id(0);
+	if (id >= numTriangles)
+	{
+		keys[id] = UINT_MAX;
+		values[id] = id;
+		return;
+	}
+
+	float3 centroid = (triangles[id * 3].xyz + triangles[id * 3 + 1].xyz + triangles[id * 3 + 2].xyz) * (1.f / 3.f);
+	keys[id] = morton3D((centroid - sceneMin.xyz) * sceneInverseExtent.xyz);
+	values[id] = id;
+}
+
+// one compare and exchange pass of a bitonic sort over a power of two number of pairs, one work item per element
+__kernel void bitonicSortStep(__global uint* keys, __global uint* values, uint distance, uint blockSize)
+{
+	uint id = get_global_id(0);
+	uint partner = id ^ distance;
+	if (partner <= id)
+	{
+		return;
+	}
+
+	uint key = keys[id];
+	uint partnerKey = keys[partner];
+	bool ascending = (id & blockSize) == 0;
+	if ((key > partnerKey) == ascending && key != partnerKey)
+	{
+		keys[id] = partnerKey;
+		keys[partner] = key;
+		uint value = values[id];
+		values[id] = values[partner];
+		values[partner] = value;
+	}
+}
+
+// leaf bounds, and the bottom-up merge counters of the internal nodes
+__kernel void initLeafNodes(
+	__global const float4* triangles,
+	__global const uint* sortedTriangles,
+	__global BvhNode* nodes,
+	__global int* mergeCounters,
+	uint numTriangles)
+{
+	uint id = get_global_id(0);
+	uint triangle = sortedTriangles[id];
+	float3 v0 = triangles[triangle * 3].xyz;
+	float3 v1 = triangles[triangle * 3 + 1].xyz;
+	float3 v2 = triangles[triangle * 3 + 2].xyz;
+
+	__global BvhNode* leaf = &nodes[numTriangles - 1 + id];
+	leaf->boundsMin = (float4)(fmin(fmin(v0, v1), v2), 0.f);
+	leaf->boundsMax = (float4)(fmax(fmax(v0, v1), v2), 0.f);
+	leaf->left = -1;
+	leaf->right = -1;
+	leaf->parent = -1;
+	leaf->triangle = (int)triangle;
+
+	if (id < numTriangles - 1)
+	{
+		mergeCounters[id] = 0;
+	}
+}
+
+// length of the common prefix of two sorted codes, equal codes are told apart by their indices
+int commonPrefix(__global const uint* keys, int numKeys, int i, int j)
+{
+	if (j < 0 || j >= numKeys)
+	{
+		return -1;
+	}
+
+	uint a = keys[i];
+	uint b = keys[j];
+	if (a == b)
+	{
+		return 32 + clz((uint)(i ^ j));
+	}
+	return clz(a ^ b);
+}
+
+// one work item per internal node: finds the range of keys it covers and where that range splits
+__kernel void buildInternalNodes(__global const uint* keys, __global BvhNode* nodes, uint numTriangles)
+{
+	int i = (int)get_global_id(0);
+	int n = (int)numTriangles;
+
+	// direction of the range, towards the neighbour sharing the longer prefix
+	int d = commonPrefix(keys, n, i, i + 1) - commonPrefix(keys, n, i, i - 1) >= 0 ? 1 : -1;
+	int minPrefix = commonPrefix(keys, n, i, i - d);
+
+	// other end of the range, exponential then binary search
+	int maxLength = 2;
+	while (commonPrefix(keys, n, i, i + maxLength * d) > minPrefix)
+	{
+		maxLength *= 2;
+	}
+	int length = 0;
+	for (int t = maxLength / 2; t >= 1; t /= 2)
+	{
+		if (commonPrefix(keys, n, i, i + (length + t) * d) > minPrefix)
+		{
+			length += t;
+		}
+	}
+	int j = i + length * d;
+
+	// split, the last key sharing more than the whole range's prefix with the first one
+	int nodePrefix = commonPrefix(keys, n, i, j);
+	int split = 0;
+	for (int t = (length + 1) / 2; ; t = (t + 1) / 2)
+	{
+		if (commonPrefix(keys, n, i, i + (split + t) * d) > nodePrefix)
+		{
+			split += t;
+		}
+		if (t == 1)
+		{
+			break;
+		}
+	}
+	int gamma = i + split * d + min(d, 0);
+
+	// single key halves are leaves
+	int left = min(i, j) == gamma ? n - 1 + gamma : gamma;
+	int right = max(i, j) == gamma + 1 ? n + gamma : gamma + 1;
+	nodes[i].left = left;
+	nodes[i].right = right;
+	nodes[i].triangle = -1;
+	nodes[left].parent = i;
+	nodes[right].parent = i;
+	if (i == 0)
+	{
+		nodes[0].parent = -1;
+	}
+}
+
+// one work item per leaf walking up to the root, the first child reaching a node stops there
+// and the second one merges both bounds, which the first one wrote before counting itself
+__kernel void computeNodeBounds(volatile __global BvhNode* nodes, __global int* mergeCounters, uint numTriangles)
+{
+	int node = (int)(numTriangles - 1 + get_global_id(0));
+	int parent = nodes[node].parent;
+	while (parent >= 0)
+	{
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		if (atomic_inc(&mergeCounters[parent]) == 0)
+		{
+			return;
+		}
+
+		volatile __global BvhNode* left = &nodes[nodes[parent].left];
+		volatile __global BvhNode* right = &nodes[nodes[parent].right];
+		nodes[parent].boundsMin = fmin(left->boundsMin, right->boundsMin);
+		nodes[parent].boundsMax = fmax(left->boundsMax, right->boundsMax);
+
+		node = parent;
+		parent = nodes[node].parent;
+	}
+}
+
+// entry and exit of the segment start + t * segment, t in [0, maxT]
+bool segmentHitsBounds(float3 start, float3 inverseSegment, float4 boundsMin, float4 boundsMax, float maxT)
+{
+	float3 t0 = (boundsMin.xyz - start) * inverseSegment;
+	float3 t1 = (boundsMax.xyz - start) * inverseSegment;
+	float3 entries = fmin(t0, t1);
+	float3 exits = fmax(t0, t1);
+	float entry = fmax(fmax(entries.x, entries.y), fmax(entries.z, 0.f));
+	float exit = fmin(fmin(exits.x, exits.y), fmin(exits.z, maxT));
+	return entry <= exit;
+}
+
+// Moller-Trumbore, the segment parameter of the hit or -1
+float intersectTriangle(float3 start, float3 segment, float3 v0, float3 v1, float3 v2)
+{
+	float3 edge1 = v1 - v0;
+	float3 edge2 = v2 - v0;
+	float3 p = cross(segment, edge2);
+	float determinant = dot(edge1, p);
+	if (fabs(determinant) < 1e-12f)
+	{
+		return -1.f;
+	}
+
+	float inverseDeterminant = 1.f / determinant;
+	float3 offset = start - v0;
+	float u = dot(offset, p) * inverseDeterminant;
+	if (u < 0.f || u > 1.f)
+	{
+		return -1.f;
+	}
+	float3 q = cross(offset, edge1);
+	float v = dot(segment, q) * inverseDeterminant;
+	if (v < 0.f || u + v > 1.f)
+	{
+		return -1.f;
+	}
+	return dot(edge2, q) * inverseDeterminant;
+}
+
+// runs between updateParticleState and checkParticleDeath: the segment a particle moved along this step is traced
+// through the hierarchy, at the nearest hit the particle is put back in front of the triangle and bounces off it
+__kernel void collideParticlesWithMesh(
+	__global ParticleState* particles,
+	__global const BvhNode* nodes,
+	__global const float4* triangles,
+	float restitution,
+	float friction
+#ifdef BVH_COUNT_STACK_OVERFLOWS
+	, volatile __global uint* stackOverflows
+#endif
+	)
+{
+	size_t id = get_global_id(0);
+	__global ParticleState* particle = &particles[id];
+	if (!particle->isAlive)
+	{
+		return;
+	}
+
+	float3 start = particle->previousPosition;
+	float3 segment = particle->position - start;
+	if (all(segment == 0.f))
+	{
+		return;
+	}
+	// infinite for axis aligned segments, the slab test then only keeps the bounds the segment lies in
+	float3 inverseSegment = 1.f / segment;
+
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	float nearestT = 1.f;
+	int nearestTriangle = -1;
+#ifdef BVH_COUNT_STACK_OVERFLOWS
+	bool overflowed = false;
+#endif
+	while (stackSize > 0)
+	{
+		__global const BvhNode* node = &nodes[stack[--stackSize]];
+		if (!segmentHitsBounds(start, inverseSegment, node->boundsMin, node->boundsMax, nearestT))
+		{
+			continue;
+		}
+
+		if (node->triangle >= 0)
+		{
+			int triangle = node->triangle;
+			float t = intersectTriangle(start, segment, triangles[triangle * 3].xyz, triangles[triangle * 3 + 1].xyz, triangles[triangle * 3 + 2].xyz);
+			if (t >= 0.f && t < nearestT)
+			{
+				nearestT = t;
+				nearestTriangle = triangle;
+			}
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node->left;
+			stack[stackSize++] = node->right;
+		}
+#ifdef BVH_COUNT_STACK_OVERFLOWS
+		else
+		{
+			overflowed = true;
+		}
+#endif
+	}
+#ifdef BVH_COUNT_STACK_OVERFLOWS
+	if (overflowed)
+	{
+		atomic_inc(stackOverflows);
+	}
+#endif
+
+	if (nearestTriangle < 0)
+	{
+		return;
+	}
+
+	// facing the side the particle came from, meshes do not need to be closed or consistently wound
+	float3 v0 = triangles[nearestTriangle * 3].xyz;
+	float3 normal = normalize(cross(triangles[nearestTriangle * 3 + 1].xyz - v0, triangles[nearestTriangle * 3 + 2].xyz - v0));
+	if (dot(normal, segment) > 0.f)
+	{
+		normal = -normal;
+	}
+
+	particle->position = start + segment * nearestT;
+	collide(particle, -MESH_COLLISION_OFFSET, normal, restitution, friction);
+}
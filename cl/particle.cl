@@ -25,6 +25,21 @@ void pcg32_srandom_r(pcg32_random_t* rng, ulong initstate, ulong initseq)
 
 //////
 
+// trig and sqrt of the per particle helpers, switched by the build profiles (src/BuildProfiles.h)
+#if defined(PARTICLE_NATIVE_MATH)
+#define PARTICLE_SIN native_sin
+#define PARTICLE_COS native_cos
+#define PARTICLE_SQRT native_sqrt
+#elif defined(PARTICLE_HALF_MATH)
+#define PARTICLE_SIN half_sin
+#define PARTICLE_COS half_cos
+#define PARTICLE_SQRT half_sqrt
+#else
+#define PARTICLE_SIN sin
+#define PARTICLE_COS cos
+#define PARTICLE_SQRT sqrt
+#endif
+
 const float3 initialPosition = (float3)(0.f, 20.f, 0.f);
 const float3 initialVelocity = (float3)(0.f, 0.f, 0.f);
 
@@ -34,12 +49,16 @@ typedef struct
 	float3 velocity __attribute__((aligned(16)));
 	float spawnTime __attribute__((aligned(4)));
 	uchar isAlive __attribute__((aligned(1)));
+	// seconds from spawnTime to the death, drawn at spawn
+	float lifetime __attribute__((aligned(4)));
+	// position before the last updateParticleState, only written with PARTICLE_MESH_COLLISION (cl/bvh.cl)
+	float3 previousPosition __attribute__((aligned(16)));
 } __attribute__((aligned(64))) ParticleState;
 
 float3 rotateVector(float3 v, float3 k, float theta)
 {
-	float cos_theta = cos(theta);
-	float sin_theta = sin(theta);
+	float cos_theta = PARTICLE_COS(theta);
+	float sin_theta = PARTICLE_SIN(theta);
 
 	return (v * cos_theta) + (cross(k, v) * sin_theta) + (k * dot(k, v)) * (1 - cos_theta);
 }
@@ -79,15 +98,52 @@ __kernel void initParticleState(__global ParticleState* particles)
 	particle->isAlive = 0;
 }
 
+// seed the particles from a point cloud, spread over the whole cloud when it has more points than particles
+__kernel void initParticleStateFromPoints(
+	__global ParticleState* particles,
+	__global const float4* points,
+	uint numPoints,
+	float currentTime,
+	float2 lifetimeRange)
+{
+	size_t id = get_global_id(0);
+	size_t numParticles = get_global_size(0);
+	__global ParticleState* particle = &particles[id];
+	particle->velocity = initialVelocity;
+
+	if (numPoints > numParticles)
+	{
+		size_t pointIndex = (size_t)((ulong)id * numPoints / numParticles);
+		particle->position = points[pointIndex].xyz;
+	}
+	else if (id < numPoints)
+	{
+		particle->position = points[id].xyz;
+	}
+	else
+	{
+		particle->position = initialPosition;
+		particle->isAlive = 0;
+		return;
+	}
+
+	// the lifetimes only depend on the work item, like a spawn with a fixed seed
+	RngValue rng;
+	randomInit(&rng, 0);
+	particle->spawnTime = currentTime;
+	particle->lifetime = random(&rng, lifetimeRange.x, lifetimeRange.y);
+	particle->isAlive = 1;
+}
+
 // uniform cylinder distribution
 void initRandomOnCylinder(__global ParticleState* particle, float radius, float height, Rng rng)
 {
 	float randomAngle = random(rng, 0.f, M_PI_F * 2.f);
-	float randomRadius = sqrt(random(rng, 0.f, 1.f)) * radius;
+	float randomRadius = PARTICLE_SQRT(random(rng, 0.f, 1.f)) * radius;
 	float randomY = random(rng, height * -0.5f, height * 0.5f);
-	particle->position.x = cos(randomAngle) * randomRadius;
+	particle->position.x = PARTICLE_COS(randomAngle) * randomRadius;
 	particle->position.y = randomY;
-	particle->position.z = sin(randomAngle) * randomRadius;
+	particle->position.z = PARTICLE_SIN(randomAngle) * randomRadius;
 }
 
 // non uniform sphere surface distribution
@@ -107,7 +163,10 @@ __kernel void spawnParticle(
 	__local uchar* canSpawnParticles,
 	uint numParticlesToSpawn,
 	int globalSeed,
-	float currentTime)
+	float currentTime,
+	__global const float4* spawnPoints,
+	uint numSpawnPoints,
+	float2 lifetimeRange)
 {
 	size_t id = get_global_id(0);
 	size_t localId = get_local_id(0);
@@ -158,9 +217,19 @@ __kernel void spawnParticle(
 		particle->spawnTime = currentTime;
 		particle->isAlive = 1;
 
-		initRandomOnCylinder(particle, 45.f, 0.f, &rng);
+		if (numSpawnPoints > 0)
+		{
+			particle->position = spawnPoints[randomUint(&rng) % numSpawnPoints].xyz;
+		}
+		else
+		{
+			initRandomOnCylinder(particle, 45.f, 0.f, &rng);
+		}
 		//initRandomOnSphere(particle, 100.f, &rng);
 		//particle->position = (float3)(0.f, 0.f, 0.f);
+
+		// drawn after the position so that the spawn distribution keeps its random stream
+		particle->lifetime = random(&rng, lifetimeRange.x, lifetimeRange.y);
 	}
 }
 
@@ -171,7 +240,7 @@ float remap(float value, float min1, float max1, float min2, float max2)
 
 void updateVortex(__global ParticleState* particle, float minRadius, float minRadiusAngularSpeed, float maxRadius, float maxRadiusAngularSpeed, float deltaTime)
 {
-	const float radius = sqrt(particle->position.x * particle->position.x + particle->position.z * particle->position.z);
+	const float radius = PARTICLE_SQRT(particle->position.x * particle->position.x + particle->position.z * particle->position.z);
 	float angularSpeed = remap(radius, minRadius, maxRadius, minRadiusAngularSpeed, maxRadiusAngularSpeed);
 	float angle = angularSpeed * deltaTime;
 	particle->position = rotateVector(particle->position, (float3)(0.f, 1.f, 0.f), angle);
@@ -195,10 +264,394 @@ void applyVelocity(__global ParticleState* particle, float deltaTime)
 	particle->position += particle->velocity * deltaTime;
 }
 
+#ifdef PARTICLE_CURL_NOISE
+// tileable curl-noise volume baked at startup (src/CurlNoise.h), repeated over the world
+__constant sampler_t curlNoiseSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_REPEAT | CLK_FILTER_LINEAR;
+
+// transform: xyz animated offset, w world to volume scale
+float3 sampleCurlNoise(__read_only image3d_t curlNoise, float3 position, float4 transform)
+{
+	float4 coordinates = (float4)(position * transform.w + transform.xyz, 0.f);
+	return read_imagef(curlNoise, curlNoiseSampler, coordinates).xyz;
+}
+#endif
+
+// number of vector field volumes (src/VectorField.h), each one is a separate image argument
+#ifndef PARTICLE_VECTOR_FIELDS
+#define PARTICLE_VECTOR_FIELDS 0
+#endif
+
+#if PARTICLE_VECTOR_FIELDS > 0
+typedef struct
+{
+	// world position to normalized volume coordinates
+	float4 rows[3];
+	// x weight, 0 while the volume is being uploaded
+	float4 weight;
+} VectorField;
+
+// no force outside of the field bounds
+__constant sampler_t vectorFieldSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_CLAMP | CLK_FILTER_LINEAR;
+
+float3 sampleVectorField(__read_only image3d_t field, __constant VectorField* params, float3 position)
+{
+	// uploading volumes are not read at all, their contents are undefined
+	if (params->weight.x == 0.f)
+	{
+		return (float3)(0.f, 0.f, 0.f);
+	}
+
+	float4 p = (float4)(position, 1.f);
+	float4 coordinates = (float4)(dot(params->rows[0], p), dot(params->rows[1], p), dot(params->rows[2], p), 0.f);
+	return read_imagef(field, vectorFieldSampler, coordinates).xyz * params->weight.x;
+}
+#endif
+
+#ifdef PARTICLE_FORCE_VOLUMES
+// ForceVolumeType in src/Options.h
+#define FORCE_VOLUME_ATTRACTOR 0
+#define FORCE_VOLUME_WIND 1
+#define FORCE_VOLUME_VORTEX 2
+
+// ForceVolumeParams in src/ForceVolumes.h
+typedef struct
+{
+	// center xyz, w attractor and vortex radius
+	float4 a;
+	// wind half extents, vortex half height in y
+	float4 b;
+	// wind acceleration xyz, attractor and vortex strength in x
+	float4 force;
+	int type;
+} ForceVolume;
+
+// uniform grid of volume index runs, binned on the host
+typedef struct
+{
+	float4 origin;
+	float4 inverseCellSize;
+	int4 size;
+} ForceVolumeGrid;
+
+float3 forceVolumeAcceleration(__global const ForceVolume* volume, float3 position)
+{
+	float3 offset = position - volume->a.xyz;
+	switch (volume->type)
+	{
+	case FORCE_VOLUME_ATTRACTOR:
+	{
+		float distance = length(offset);
+		if (distance >= volume->a.w || distance == 0.f)
+		{
+			return (float3)(0.f, 0.f, 0.f);
+		}
+		return offset * (-volume->force.x * (1.f - distance / volume->a.w) / distance);
+	}
+	case FORCE_VOLUME_WIND:
+		return all(fabs(offset) <= volume->b.xyz) ? volume->force.xyz : (float3)(0.f, 0.f, 0.f);
+	default:
+	{
+		// bounded updateVortex, turning the same way and strongest near the axis
+		float radius = length(offset.xz);
+		if (radius >= volume->a.w || radius == 0.f || fabs(offset.y) > volume->b.y)
+		{
+			return (float3)(0.f, 0.f, 0.f);
+		}
+		return (float3)(offset.z, 0.f, -offset.x) * (volume->force.x * (1.f - radius / volume->a.w) / radius);
+	}
+	}
+}
+
+float3 sampleForceVolumes(__constant ForceVolumeGrid* grid, __global const ForceVolume* volumes, __global const uint2* cells,
+	__global const uint* indices, float3 position)
+{
+	int3 cell = convert_int3_rtn((position - grid->origin.xyz) * grid->inverseCellSize.xyz);
+	if (any(cell < 0) || any(cell >= grid->size.xyz))
+	{
+		return (float3)(0.f, 0.f, 0.f);
+	}
+
+	uint2 run = cells[(cell.z * grid->size.y + cell.y) * grid->size.x + cell.x];
+	float3 acceleration = (float3)(0.f, 0.f, 0.f);
+	for (uint i = run.x; i < run.x + run.y; ++i)
+	{
+		acceleration += forceVolumeAcceleration(&volumes[indices[i]], position);
+	}
+	return acceleration;
+}
+#endif
+
+// static collision geometry (src/Colliders.h), analytic primitives and signed distance volumes
+#ifndef PARTICLE_SDF_VOLUMES
+#define PARTICLE_SDF_VOLUMES 0
+#endif
+
+#if defined(PARTICLE_COLLIDERS) || PARTICLE_SDF_VOLUMES > 0 || defined(PARTICLE_MESH_COLLISION) || defined(PARTICLE_HEIGHTFIELD)
+// pushes a penetrating particle out along the normal and reflects the approaching velocity,
+// restitution scales the reflected normal velocity and friction damps the tangential velocity
+void collide(__global ParticleState* particle, float signedDistance, float3 normal, float restitution, float friction)
+{
+	particle->position -= normal * signedDistance;
+
+	float3 velocity = particle->velocity;
+	float normalSpeed = dot(velocity, normal);
+	if (normalSpeed < 0.f)
+	{
+		float3 normalVelocity = normal * normalSpeed;
+		float3 tangentVelocity = velocity - normalVelocity;
+		particle->velocity = tangentVelocity * (1.f - friction) - normalVelocity * restitution;
+	}
+}
+#endif
+
+#ifdef PARTICLE_COLLIDERS
+// ColliderType in src/Options.h
+#define COLLIDER_PLANE 0
+#define COLLIDER_SPHERE 1
+#define COLLIDER_BOX 2
+#define COLLIDER_CAPSULE 3
+
+typedef struct
+{
+	float4 a;
+	float4 b;
+	float radius;
+	float restitution;
+	float friction;
+	int type;
+} Collider;
+
+// distance to a point, the normal points away from it
+float pointDistance(float3 offset, float radius, float3* normal)
+{
+	float offsetLength = length(offset);
+	*normal = offsetLength > 0.f ? offset / offsetLength : (float3)(0.f, 1.f, 0.f);
+	return offsetLength - radius;
+}
+
+// signed distance to an analytic collider and its outward normal
+float colliderDistance(__constant Collider* collider, float3 position, float3* normal)
+{
+	switch (collider->type)
+	{
+	case COLLIDER_PLANE:
+		*normal = collider->a.xyz;
+		return dot(collider->a.xyz, position) - collider->a.w;
+	case COLLIDER_SPHERE:
+		return pointDistance(position - collider->a.xyz, collider->radius, normal);
+	case COLLIDER_BOX:
+	{
+		float3 offset = position - collider->a.xyz;
+		float3 side = copysign((float3)(1.f, 1.f, 1.f), offset);
+		float3 q = fabs(offset) - collider->b.xyz;
+		if (any(q > 0.f))
+		{
+			// closest point on the surface
+			return pointDistance(max(q, 0.f) * side, 0.f, normal);
+		}
+		// inside, out through the nearest face
+		if (q.x >= q.y && q.x >= q.z)
+		{
+			*normal = (float3)(side.x, 0.f, 0.f);
+			return q.x;
+		}
+		if (q.y >= q.z)
+		{
+			*normal = (float3)(0.f, side.y, 0.f);
+			return q.y;
+		}
+		*normal = (float3)(0.f, 0.f, side.z);
+		return q.z;
+	}
+	default:
+	{
+		float3 segment = collider->b.xyz - collider->a.xyz;
+		float3 offset = position - collider->a.xyz;
+		float t = clamp(dot(offset, segment) / fmax(dot(segment, segment), 1e-12f), 0.f, 1.f);
+		return pointDistance(offset - segment * t, collider->radius, normal);
+	}
+	}
+}
+
+void collideWithColliders(__global ParticleState* particle, __constant Collider* colliders, int numColliders)
+{
+	for (int i = 0; i < numColliders; ++i)
+	{
+		float3 normal;
+		float signedDistance = colliderDistance(&colliders[i], particle->position, &normal);
+		if (signedDistance < 0.f)
+		{
+			collide(particle, signedDistance, normal, colliders[i].restitution, colliders[i].friction);
+		}
+	}
+}
+#endif
+
+#if PARTICLE_SDF_VOLUMES > 0
+typedef struct
+{
+	// world position to normalized volume coordinates
+	float4 rows[3];
+	// one texel in normalized coordinates
+	float4 texelSize;
+	// x field to world distance scale, y restitution, z friction
+	float4 material;
+} SdfVolume;
+
+__constant sampler_t sdfSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+void collideWithSdf(__global ParticleState* particle, __read_only image3d_t sdf, __constant SdfVolume* volume)
+{
+	float4 p = (float4)(particle->position, 1.f);
+	float4 coordinates = (float4)(dot(volume->rows[0], p), dot(volume->rows[1], p), dot(volume->rows[2], p), 0.f);
+	// the clamped distances outside of the volume are not distances to the geometry
+	if (any(coordinates.xyz < 0.f) || any(coordinates.xyz > 1.f))
+	{
+		return;
+	}
+
+	float signedDistance = read_imagef(sdf, sdfSampler, coordinates).x * volume->material.x;
+	if (signedDistance >= 0.f)
+	{
+		return;
+	}
+
+	// central differences in volume space, then back to world space through the transform
+	float4 dx = (float4)(volume->texelSize.x, 0.f, 0.f, 0.f);
+	float4 dy = (float4)(0.f, volume->texelSize.y, 0.f, 0.f);
+	float4 dz = (float4)(0.f, 0.f, volume->texelSize.z, 0.f);
+	float3 gradient = (float3)(
+		read_imagef(sdf, sdfSampler, coordinates + dx).x - read_imagef(sdf, sdfSampler, coordinates - dx).x,
+		read_imagef(sdf, sdfSampler, coordinates + dy).x - read_imagef(sdf, sdfSampler, coordinates - dy).x,
+		read_imagef(sdf, sdfSampler, coordinates + dz).x - read_imagef(sdf, sdfSampler, coordinates - dz).x) / volume->texelSize.xyz;
+	float3 normal = volume->rows[0].xyz * gradient.x + volume->rows[1].xyz * gradient.y + volume->rows[2].xyz * gradient.z;
+	float normalLength = length(normal);
+	if (normalLength == 0.f)
+	{
+		return;
+	}
+
+	collide(particle, signedDistance, normal / normalLength, volume->material.y, volume->material.z);
+}
+#endif
+
+#ifdef PARTICLE_HEIGHTFIELD
+// HeightfieldContact in src/Options.h
+#define HEIGHTFIELD_BOUNCE 0
+#define HEIGHTFIELD_STICK 1
+#define HEIGHTFIELD_KILL 2
+
+// HeightfieldParams in src/Heightfield.h
+typedef struct
+{
+	// x/z world position to normalized image coordinates: xy scale, zw offset
+	float4 mapping;
+	// x minimum height, y height range, zw one texel in normalized coordinates
+	float4 heights;
+	// x restitution, y friction, z contact
+	float4 material;
+} Heightfield;
+
+__constant sampler_t heightfieldSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+float sampleHeight(__read_only image2d_t heightfieldImage, __constant Heightfield* heightfield, float2 coordinates)
+{
+	return heightfield->heights.x + read_imagef(heightfieldImage, heightfieldSampler, coordinates).x * heightfield->heights.y;
+}
+
+void collideWithHeightfield(__global ParticleState* particle, __read_only image2d_t heightfieldImage, __constant Heightfield* heightfield)
+{
+	float2 coordinates = particle->position.xz * heightfield->mapping.xy + heightfield->mapping.zw;
+	// no ground outside of the terrain
+	if (any(coordinates < 0.f) || any(coordinates > 1.f))
+	{
+		return;
+	}
+
+	float height = sampleHeight(heightfieldImage, heightfield, coordinates);
+	if (particle->position.y >= height)
+	{
+		return;
+	}
+
+	int contact = (int)heightfield->material.z;
+	if (contact == HEIGHTFIELD_KILL)
+	{
+		particle->isAlive = 0;
+		particle->position = initialPosition;
+		return;
+	}
+	if (contact == HEIGHTFIELD_STICK)
+	{
+		particle->position.y = height;
+		particle->velocity = (float3)(0.f, 0.f, 0.f);
+		return;
+	}
+
+	// slope from central differences, scaled from texels to world units
+	float2 dx = (float2)(heightfield->heights.z, 0.f);
+	float2 dz = (float2)(0.f, heightfield->heights.w);
+	float slopeX = (sampleHeight(heightfieldImage, heightfield, coordinates + dx) - sampleHeight(heightfieldImage, heightfield, coordinates - dx))
+		* heightfield->mapping.x / (2.f * heightfield->heights.z);
+	float slopeZ = (sampleHeight(heightfieldImage, heightfield, coordinates + dz) - sampleHeight(heightfieldImage, heightfield, coordinates - dz))
+		* heightfield->mapping.y / (2.f * heightfield->heights.w);
+	float3 normal = normalize((float3)(-slopeX, 1.f, -slopeZ));
+
+	// vertical depth projected on the normal
+	collide(particle, (particle->position.y - height) * normal.y, normal, heightfield->material.x, heightfield->material.y);
+}
+#endif
+
 __kernel void updateParticleState(
 	__global ParticleState* particles,
 	int globalSeed,
-	float deltaTime)
+	float deltaTime
+#ifdef PARTICLE_CURL_NOISE
+	, __read_only image3d_t curlNoise,
+	float4 curlNoiseTransform,
+	float curlNoiseStrength
+#endif
+#if PARTICLE_VECTOR_FIELDS > 0
+	, __constant VectorField* vectorFields,
+	__read_only image3d_t vectorField0
+#endif
+#if PARTICLE_VECTOR_FIELDS > 1
+	, __read_only image3d_t vectorField1
+#endif
+#if PARTICLE_VECTOR_FIELDS > 2
+	, __read_only image3d_t vectorField2
+#endif
+#if PARTICLE_VECTOR_FIELDS > 3
+	, __read_only image3d_t vectorField3
+#endif
+#ifdef PARTICLE_FORCE_VOLUMES
+	, __constant ForceVolumeGrid* forceVolumeGrid,
+	__global const ForceVolume* forceVolumes,
+	__global const uint2* forceVolumeCells,
+	__global const uint* forceVolumeIndices
+#endif
+#ifdef PARTICLE_COLLIDERS
+	, __constant Collider* colliders,
+	int numColliders
+#endif
+#if PARTICLE_SDF_VOLUMES > 0
+	, __constant SdfVolume* sdfVolumes,
+	__read_only image3d_t sdf0
+#endif
+#if PARTICLE_SDF_VOLUMES > 1
+	, __read_only image3d_t sdf1
+#endif
+#if PARTICLE_SDF_VOLUMES > 2
+	, __read_only image3d_t sdf2
+#endif
+#if PARTICLE_SDF_VOLUMES > 3
+	, __read_only image3d_t sdf3
+#endif
+#ifdef PARTICLE_HEIGHTFIELD
+	, __constant Heightfield* heightfield,
+	__read_only image2d_t heightfieldImage
+#endif
+	)
 {
 	size_t id = get_global_id(0);
 	__global ParticleState* particle = &particles[id];
@@ -207,21 +660,65 @@ __kernel void updateParticleState(
 		return;
 	}
 
-	RngValue rng;
-	randomInit(&rng, globalSeed);
-
 	//updateVortex(particle, 0.f, -2.f, 50.f, 0.f, deltaTime);
 	//updateRadial(particle, 0.f, -0.6f, 50.f, 0.f, deltaTime);
 
+#ifdef PARTICLE_CURL_NOISE
+	// coherent turbulence, plus the mean of the white noise fall
+	float3 acceleration = sampleCurlNoise(curlNoise, particle->position, curlNoiseTransform) * curlNoiseStrength;
+	acceleration.y -= 7.5f;
+#else
+	RngValue rng;
+	randomInit(&rng, globalSeed);
+
 	float accelerationX = random(&rng, -50.f, 50.f);
 	float accelerationY = random(&rng, -5.f, -10.f);
 	float accelerationZ = random(&rng, -50.f, 50.f);
 	float3 acceleration = (float3)(accelerationX, accelerationY, accelerationZ);
+#endif
+#if PARTICLE_VECTOR_FIELDS > 0
+	acceleration += sampleVectorField(vectorField0, &vectorFields[0], particle->position);
+#endif
+#if PARTICLE_VECTOR_FIELDS > 1
+	acceleration += sampleVectorField(vectorField1, &vectorFields[1], particle->position);
+#endif
+#if PARTICLE_VECTOR_FIELDS > 2
+	acceleration += sampleVectorField(vectorField2, &vectorFields[2], particle->position);
+#endif
+#if PARTICLE_VECTOR_FIELDS > 3
+	acceleration += sampleVectorField(vectorField3, &vectorFields[3], particle->position);
+#endif
+#ifdef PARTICLE_FORCE_VOLUMES
+	acceleration += sampleForceVolumes(forceVolumeGrid, forceVolumes, forceVolumeCells, forceVolumeIndices, particle->position);
+#endif
 	accelerate(particle, acceleration, deltaTime);
 
 	//accelerate(particle, (float3)(0.f, -10.f, 0.f), deltaTime);
 
+#ifdef PARTICLE_MESH_COLLISION
+	// start of the segment traced by collideParticlesWithMesh
+	particle->previousPosition = particle->position;
+#endif
 	applyVelocity(particle, deltaTime);
+
+#ifdef PARTICLE_COLLIDERS
+	collideWithColliders(particle, colliders, numColliders);
+#endif
+#if PARTICLE_SDF_VOLUMES > 0
+	collideWithSdf(particle, sdf0, &sdfVolumes[0]);
+#endif
+#if PARTICLE_SDF_VOLUMES > 1
+	collideWithSdf(particle, sdf1, &sdfVolumes[1]);
+#endif
+#if PARTICLE_SDF_VOLUMES > 2
+	collideWithSdf(particle, sdf2, &sdfVolumes[2]);
+#endif
+#if PARTICLE_SDF_VOLUMES > 3
+	collideWithSdf(particle, sdf3, &sdfVolumes[3]);
+#endif
+#ifdef PARTICLE_HEIGHTFIELD
+	collideWithHeightfield(particle, heightfieldImage, heightfield);
+#endif
 }
 
 bool checkAge(__global ParticleState* particle, float currentTime, float maxAge)
@@ -238,9 +735,19 @@ __kernel void checkParticleDeath(__global ParticleState* particles, float curren
 		return;
 	}
 
-	if (checkAge(particle, currentTime, 5.f))
+	if (checkAge(particle, currentTime, particle->lifetime))
 	{
 		particle->isAlive = 0;
 		particle->position = initialPosition;
 	}
-}
\ No newline at end of file
+}
+
+// compact render record for the render thread: xyz position, w age over the lifetime from 0 to 1, -1 when dead
+// the size and colour over life are looked up from the age in the vertex shader
+__kernel void packRenderState(__global const ParticleState* particles, __global float4* renderState, float currentTime)
+{
+	size_t id = get_global_id(0);
+	__global const ParticleState* particle = &particles[id];
+	float age = particle->isAlive ? clamp((currentTime - particle->spawnTime) / particle->lifetime, 0.f, 1.f) : -1.f;
+	renderState[id] = (float4)(particle->position, age);
+}
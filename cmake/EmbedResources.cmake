@@ -0,0 +1,43 @@
+# Generates a header holding files as constexpr byte arrays
+# usage: cmake -DSOURCE_DIR=<dir> -DOUTPUT=<header> -DRESOURCES=<path1,path2,...> -P EmbedResources.cmake
+# paths are relative to SOURCE_DIR and are also the names used to look the resources up at runtime
+# an entry can also be <name>=<absolute path> for generated files
+
+string(REPLACE "," ";" RESOURCES "${RESOURCES}")
+
+set(arrays "")
+set(entries "")
+set(index 0)
+foreach(resource IN LISTS RESOURCES)
+    if(resource MATCHES "^([^=]+)=(.+)$")
+        set(resource "${CMAKE_MATCH_1}")
+        set(resourcePath "${CMAKE_MATCH_2}")
+    else()
+        set(resourcePath "${SOURCE_DIR}/${resource}")
+    endif()
+    file(READ "${resourcePath}" content HEX)
+    string(LENGTH "${content}" hexLength)
+    math(EXPR size "${hexLength} / 2")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," content "${content}")
+    # 16 bytes per line
+    string(REGEX REPLACE "(0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,)" "\\1\n\t" content "${content}")
+    # keep a null terminator after text resources
+    set(arrays "${arrays}constexpr unsigned char resource${index}[] = {\n\t${content}0x00\n};\n\n")
+    set(entries "${entries}\t{ \"${resource}\", resource${index}, ${size} },\n")
+    math(EXPR index "${index} + 1")
+endforeach()
+
+set(header "// generated by cmake/EmbedResources.cmake, do not edit\n\n")
+set(header "${header}#pragma once\n\n#include <cstddef>\n\nnamespace embedded\n{\n\n")
+set(header "${header}${arrays}")
+set(header "${header}struct Resource\n{\n\tconst char* path;\n\tconst unsigned char* data;\n\tsize_t size;\n};\n\n")
+set(header "${header}constexpr Resource resources[] = {\n${entries}};\n\n} // embedded\n")
+
+# only touch the header when it changes to avoid needless rebuilds
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" previousHeader)
+    if(previousHeader STREQUAL header)
+        return()
+    endif()
+endif()
+file(WRITE "${OUTPUT}" "${header}")
@@ -3,10 +3,11 @@
 uniform sampler2D particleTexture;
 
 in vec2 uv;
+in vec4 color;
 out vec4 outColor;
 
 void main()
 {
 	vec4 pxColor = texture(particleTexture, uv);
-	outColor = pxColor;
+	outColor = pxColor * color;
 }
\ No newline at end of file
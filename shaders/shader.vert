@@ -1,8 +1,28 @@
 #version 150
 
-in vec4 position;
+// positions are dequantized with positionScale and positionOffset, identity for simulated particles
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+// ages are mapped to [0, 1] with ageScale and ageOffset, negative for dead particles
+uniform float ageScale;
+uniform float ageOffset;
+uniform sampler1D sizeOverLife;
+uniform sampler1D colorOverLife;
+
+in vec3 position;
+in float age;
+
+out float particleSize;
+out vec4 particleColor;
 
 void main()
 {
-	gl_Position = position;
+	gl_Position = vec4(position * positionScale + positionOffset, 1.0);
+
+	float normalizedAge = age * ageScale + ageOffset;
+	// sample between the first and the last texel centers so that both ends of the curve are reached
+	float curveSize = float(textureSize(sizeOverLife, 0));
+	float u = (clamp(normalizedAge, 0.0, 1.0) * (curveSize - 1.0) + 0.5) / curveSize;
+	particleSize = normalizedAge < 0.0 ? 0.0 : texture(sizeOverLife, u).r;
+	particleColor = texture(colorOverLife, u);
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "BuildProfiles.h"
+
+#include <iostream>
+
+const std::vector<BuildProfile>& getBuildProfiles()
+{
+	static const std::vector<BuildProfile> profiles =
+	{
+		{ "precise", "", "IEEE conforming math, no options", false },
+		{ "mad", "-cl-mad-enable", "a * b + c may be fused with reduced accuracy", false },
+		{ "relaxed", "-cl-mad-enable -cl-denorms-are-zero", "mad and denormals flushed to zero", false },
+		{ "fast", "-cl-fast-relaxed-math -cl-denorms-are-zero", "finite math, no signed zeros, relaxed precision", false },
+		{ "native", "-cl-fast-relaxed-math -cl-denorms-are-zero -DPARTICLE_NATIVE_MATH", "fast, and native_sin/cos/sqrt in the helpers", true },
+		{ "half", "-cl-fast-relaxed-math -cl-denorms-are-zero -DPARTICLE_HALF_MATH", "fast, and half_sin/cos/sqrt in the helpers", true },
+	};
+	return profiles;
+}
+
+const BuildProfile* findBuildProfile(const std::string& name)
+{
+	for (const BuildProfile& profile : getBuildProfiles())
+	{
+		if (name == profile.name)
+		{
+			return &profile;
+		}
+	}
+
+	std::cerr << "Unknown OpenCL build profile '" << name << "', available profiles:" << std::endl;
+	for (const BuildProfile& profile : getBuildProfiles())
+	{
+		std::cerr << "  " << profile.name << " - " << profile.description << std::endl;
+	}
+	return nullptr;
+}
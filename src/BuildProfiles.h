@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// OpenCL compiler option sets trading accuracy for speed
+// the native and half profiles also switch the trig and sqrt calls of the per particle helpers in cl/particle.cl
+// (rotateVector, initRandomOnCylinder, updateVortex) through the PARTICLE_NATIVE_MATH and PARTICLE_HALF_MATH macros
+struct BuildProfile
+{
+	const char* name;
+	const char* options;
+	const char* description;
+	// the macros only exist when building from source, the offline compiled SPIR-V is the precise profile
+	bool requiresSource;
+};
+
+// the first profile is the precise one, the default
+const std::vector<BuildProfile>& getBuildProfiles();
+
+// nullptr and an error message listing the profiles if there is no such profile
+const BuildProfile* findBuildProfile(const std::string& name);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#define CL_HPP_MINIMUM_OPENCL_VERSION 110
+#define CL_HPP_TARGET_OPENCL_VERSION 110
+#include <CL/opencl.hpp>
+
+// OpenCL
+const char* getErrorString(cl_int error);
+
+// print an OpenCL error and return false, for functions outside of main()
+bool checkErrorCode(cl_int code, const char* function);
+
+// read only image formats beyond the RGBA ones every device supports
+bool isImageFormatSupported(const cl::Context& context, cl_mem_object_type imageType, const cl::ImageFormat& format);
+
+// SPIR-V programs through cl_khr_il_program, the bundled OpenCL 1.1 headers do not declare it
+bool isILProgramSupported(const cl::Device& device);
+// returns a null program and sets code on failure
+cl::Program createProgramWithIL(const cl::Context& context, const std::string& il, cl_int* code);
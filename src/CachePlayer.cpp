@@ -0,0 +1,214 @@
+#include "CachePlayer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+CachePlayer::~CachePlayer()
+{
+	close();
+}
+
+bool CachePlayer::open(const std::string& filePath, unsigned int numPrefetchFrames)
+{
+	close();
+
+	if (!GLEW_ARB_buffer_storage)
+	{
+		std::cerr << "Cache playback requires GL_ARB_buffer_storage" << std::endl;
+		return false;
+	}
+
+	if (!file.open(filePath))
+	{
+		return false;
+	}
+
+	if (file.getSize() < sizeof(header))
+	{
+		std::cerr << "Particle cache '" << filePath << "' is truncated" << std::endl;
+		close();
+		return false;
+	}
+	std::memcpy(&header, file.getData(), sizeof(header));
+
+	if (std::memcmp(header.magic, PARTICLE_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != PARTICLE_CACHE_VERSION
+		|| header.cachedParticleSize != sizeof(CachedParticle))
+	{
+		std::cerr << "'" << filePath << "' is not a supported particle cache" << std::endl;
+		close();
+		return false;
+	}
+
+	if (!readIndex(filePath))
+	{
+		close();
+		return false;
+	}
+
+	this->numPrefetchFrames = numPrefetchFrames;
+
+	// persistent ring of frame slots
+	slotSize = static_cast<size_t>(header.numParticles) * sizeof(CachedParticle);
+	const GLbitfield storageFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferStorage(GL_ARRAY_BUFFER, slotSize * NUM_SLOTS, nullptr, storageFlags);
+	mappedBuffer = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, slotSize * NUM_SLOTS, storageFlags));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (mappedBuffer == nullptr)
+	{
+		std::cerr << "Could not map the particle cache playback buffer" << std::endl;
+		close();
+		return false;
+	}
+
+	std::cout << "Playing " << index.size() << " frame(s) of " << header.numParticles << " particles from '" << filePath << "'" << std::endl;
+	return true;
+}
+
+void CachePlayer::close()
+{
+	for (GLsync& fence : slotFences)
+	{
+		if (fence != nullptr)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (buffer != 0)
+	{
+		if (mappedBuffer != nullptr)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	mappedBuffer = nullptr;
+
+	file.close();
+	index.clear();
+	header = {};
+	currentSlot = 0;
+	lastUploadedFrame = SIZE_MAX;
+}
+
+bool CachePlayer::readIndex(const std::string& filePath)
+{
+	const unsigned char* data = file.getData();
+	const size_t size = file.getSize();
+	const uint64_t payloadSize = static_cast<uint64_t>(header.numParticles) * sizeof(CachedParticle);
+
+	auto isValidChunk = [data, size, payloadSize](uint64_t offset)
+	{
+		if (offset + sizeof(ParticleCacheFrameHeader) + payloadSize > size)
+			return false;
+		ParticleCacheFrameHeader frameHeader;
+		std::memcpy(&frameHeader, data + offset, sizeof(frameHeader));
+		return frameHeader.magic == PARTICLE_CACHE_FRAME_MAGIC && frameHeader.payloadSize == payloadSize;
+	};
+
+	ParticleCacheFooter footer;
+	if (size >= sizeof(header) + sizeof(footer))
+	{
+		std::memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+		const bool hasFooter = std::memcmp(footer.magic, PARTICLE_CACHE_MAGIC, sizeof(footer.magic)) == 0
+			&& footer.indexOffset + footer.numFrames * sizeof(ParticleCacheIndexEntry) + sizeof(footer) == size;
+		if (hasFooter)
+		{
+			index.resize(static_cast<size_t>(footer.numFrames));
+			if (!index.empty())
+			{
+				std::memcpy(index.data(), data + footer.indexOffset, index.size() * sizeof(ParticleCacheIndexEntry));
+			}
+			for (const ParticleCacheIndexEntry& indexEntry : index)
+			{
+				if (!isValidChunk(indexEntry.offset))
+				{
+					std::cerr << "Particle cache '" << filePath << "' has a corrupted index" << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	// the recording was interrupted before the index was written, rebuild it from the aligned chunks
+	if (index.empty())
+	{
+		std::cerr << "Warning: particle cache '" << filePath << "' has no index, scanning frames" << std::endl;
+		for (uint64_t offset = PARTICLE_CACHE_CHUNK_ALIGNMENT; isValidChunk(offset);)
+		{
+			ParticleCacheFrameHeader frameHeader;
+			std::memcpy(&frameHeader, data + offset, sizeof(frameHeader));
+
+			ParticleCacheIndexEntry indexEntry = {};
+			indexEntry.offset = offset;
+			indexEntry.frameIndex = frameHeader.frameIndex;
+			indexEntry.simulationTime = frameHeader.simulationTime;
+			index.push_back(indexEntry);
+
+			offset += sizeof(frameHeader) + payloadSize;
+			offset += (PARTICLE_CACHE_CHUNK_ALIGNMENT - offset % PARTICLE_CACHE_CHUNK_ALIGNMENT) % PARTICLE_CACHE_CHUNK_ALIGNMENT;
+		}
+	}
+
+	if (index.empty())
+	{
+		std::cerr << "Particle cache '" << filePath << "' holds no frame" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool CachePlayer::uploadFrame(size_t frame)
+{
+	if (frame >= index.size())
+	{
+		return false;
+	}
+
+	currentSlot = (currentSlot + 1) % NUM_SLOTS;
+
+	// wait until the GPU is done drawing this slot
+	GLsync& fence = slotFences[currentSlot];
+	if (fence != nullptr)
+	{
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	const unsigned char* chunk = file.getData() + index[frame].offset;
+	std::memcpy(&currentFrameHeader, chunk, sizeof(currentFrameHeader));
+	std::memcpy(mappedBuffer + currentSlot * slotSize, chunk + sizeof(currentFrameHeader), slotSize);
+
+	// read the next frames ahead while this one is drawn, sequential playback only needs the newest one
+	const bool sequential = frame == lastUploadedFrame + 1;
+	for (size_t i = sequential ? numPrefetchFrames : 1; i <= numPrefetchFrames && frame + i < index.size(); ++i)
+	{
+		file.prefetch(static_cast<size_t>(index[frame + i].offset), sizeof(ParticleCacheFrameHeader) + slotSize);
+	}
+	lastUploadedFrame = frame;
+
+	return true;
+}
+
+void CachePlayer::fenceCurrentSlot()
+{
+	GLsync& fence = slotFences[currentSlot];
+	if (fence != nullptr)
+	{
+		glDeleteSync(fence);
+	}
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "MappedFile.h"
+#include "ParticleCache.h"
+
+// plays a particle cache back into a persistently mapped GL buffer (GL_ARB_buffer_storage)
+// the cache is memory mapped, frames are copied once into a ring of buffer slots fenced against the GPU
+class CachePlayer
+{
+public:
+	CachePlayer() = default;
+	CachePlayer(const CachePlayer&) = delete;
+	CachePlayer& operator=(const CachePlayer&) = delete;
+	~CachePlayer();
+
+	// requires a current GL context
+	bool open(const std::string& filePath, unsigned int numPrefetchFrames);
+	void close();
+
+	bool isOpen() const { return buffer != 0; }
+
+	size_t getNumFrames() const { return index.size(); }
+	uint32_t getNumParticles() const { return header.numParticles; }
+
+	// copy a frame into the next ring slot, any frame can be requested
+	bool uploadFrame(size_t frame);
+
+	// the GPU is done with the current slot once this fence is signaled, call after drawing it
+	void fenceCurrentSlot();
+
+	GLuint getBuffer() const { return buffer; }
+	GLintptr getCurrentSlotOffset() const { return static_cast<GLintptr>(currentSlot * slotSize); }
+	const ParticleCacheFrameHeader& getCurrentFrameHeader() const { return currentFrameHeader; }
+
+private:
+	bool readIndex(const std::string& filePath);
+
+	static const unsigned int NUM_SLOTS = 3;
+
+	MappedFile file;
+	ParticleCacheHeader header = {};
+	std::vector<ParticleCacheIndexEntry> index;
+	unsigned int numPrefetchFrames = 0;
+
+	GLuint buffer = 0;
+	unsigned char* mappedBuffer = nullptr;
+	size_t slotSize = 0;
+	GLsync slotFences[NUM_SLOTS] = {};
+	unsigned int currentSlot = 0;
+	size_t lastUploadedFrame = SIZE_MAX;
+	ParticleCacheFrameHeader currentFrameHeader = {};
+};
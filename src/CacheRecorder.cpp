@@ -0,0 +1,353 @@
+#include "CacheRecorder.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "JobSystem.h"
+
+static const size_t QUANTIZE_GRAIN_SIZE = 65536;
+
+CacheRecorder::~CacheRecorder()
+{
+	close();
+}
+
+bool CacheRecorder::open(
+	const std::string& filePath,
+	const cl::Context& context,
+	const cl::CommandQueue& commandQueue,
+	size_t numParticles,
+	unsigned int frameInterval,
+	unsigned int numSlots,
+	JobSystem* jobSystem)
+{
+	close();
+
+	this->commandQueue = commandQueue;
+	this->jobSystem = jobSystem;
+	this->numParticles = numParticles;
+	this->frameInterval = std::max(frameInterval, 1u);
+	frameCounter = 0;
+	fileOffset = 0;
+	writeFailed = false;
+	numRecordedFrames = 0;
+	numDroppedFrames = 0;
+
+	// pinned readback buffers, mapped once for the whole recording
+	const size_t renderStateSize = numParticles * sizeof(cl_float4);
+	slots.resize(std::max(numSlots, 1u));
+	for (Slot& slot : slots)
+	{
+		cl_int code;
+		slot.pinnedBuffer = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, renderStateSize, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+		{
+			close();
+			return false;
+		}
+
+		slot.renderStates = static_cast<cl_float4*>(this->commandQueue.enqueueMapBuffer(
+			slot.pinnedBuffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, renderStateSize, nullptr, nullptr, &code));
+		if (!checkErrorCode(code, "enqueueMapBuffer"))
+		{
+			close();
+			return false;
+		}
+
+		freeSlots.push_back(&slot);
+	}
+
+	file = std::fopen(filePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cerr << "Could not open particle cache '" << filePath << "' for writing" << std::endl;
+		close();
+		return false;
+	}
+
+	ParticleCacheHeader header = {};
+	std::memcpy(header.magic, PARTICLE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PARTICLE_CACHE_VERSION;
+	header.numParticles = static_cast<uint32_t>(numParticles);
+	header.frameInterval = this->frameInterval;
+	header.cachedParticleSize = sizeof(CachedParticle);
+	if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+	{
+		std::cerr << "Could not write particle cache '" << filePath << "'" << std::endl;
+		close();
+		return false;
+	}
+	fileOffset = sizeof(header);
+
+	compressedFrame.resize(numParticles);
+	index.clear();
+
+	stopWorker = false;
+	worker = std::thread(&CacheRecorder::workerMain, this);
+
+	std::cout << "Recording every " << this->frameInterval << " frame(s) to '" << filePath << "'" << std::endl;
+	return true;
+}
+
+void CacheRecorder::close()
+{
+	if (worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(slotsMutex);
+			stopWorker = true;
+		}
+		pendingSlotsCondition.notify_one();
+		worker.join();
+	}
+
+	if (file != nullptr)
+	{
+		ParticleCacheFooter footer = {};
+		footer.indexOffset = fileOffset;
+		footer.numFrames = index.size();
+		std::memcpy(footer.magic, PARTICLE_CACHE_MAGIC, sizeof(footer.magic));
+
+		bool success = !writeFailed
+			&& (index.empty() || std::fwrite(index.data(), sizeof(ParticleCacheIndexEntry), index.size(), file) == index.size())
+			&& std::fwrite(&footer, sizeof(footer), 1, file) == 1;
+		success = std::fclose(file) == 0 && success;
+		file = nullptr;
+
+		if (!success)
+		{
+			std::cerr << "Could not finalize particle cache, it may be truncated" << std::endl;
+		}
+
+		std::cout << "Recorded " << numRecordedFrames << " frame(s), dropped " << numDroppedFrames << std::endl;
+	}
+
+	for (Slot& slot : slots)
+	{
+		if (slot.renderStates != nullptr)
+		{
+			commandQueue.enqueueUnmapMemObject(slot.pinnedBuffer, slot.renderStates);
+		}
+	}
+	if (!slots.empty())
+	{
+		commandQueue.finish();
+	}
+
+	freeSlots.clear();
+	pendingSlots.clear();
+	slots.clear();
+	index.clear();
+	compressedFrame.clear();
+}
+
+bool CacheRecorder::recordFrame(
+	const cl::Buffer& renderStateBuffer,
+	double simulationTime,
+	const std::vector<cl::Event>* waitEvents,
+	cl::Event* readEvent)
+{
+	const uint32_t frameIndex = frameCounter++;
+	if (file == nullptr || frameIndex % frameInterval != 0)
+	{
+		return true;
+	}
+
+	Slot* slot = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(slotsMutex);
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+	}
+
+	// backpressure: never wait for the writer
+	if (slot == nullptr)
+	{
+		++numDroppedFrames;
+		return true;
+	}
+
+	slot->frameIndex = frameIndex;
+	slot->simulationTime = simulationTime;
+
+	cl_int code = commandQueue.enqueueReadBuffer(
+		renderStateBuffer, CL_FALSE, 0, numParticles * sizeof(cl_float4), slot->renderStates, waitEvents, &slot->readEvent);
+	if (!checkErrorCode(code, "enqueueReadBuffer"))
+	{
+		std::lock_guard<std::mutex> lock(slotsMutex);
+		freeSlots.push_back(slot);
+		return false;
+	}
+
+	// the worker waits on the event from another thread, make sure the readback gets submitted
+	commandQueue.flush();
+	if (readEvent != nullptr)
+	{
+		*readEvent = slot->readEvent;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(slotsMutex);
+		pendingSlots.push_back(slot);
+	}
+	pendingSlotsCondition.notify_one();
+	return true;
+}
+
+void CacheRecorder::workerMain()
+{
+	while (true)
+	{
+		Slot* slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(slotsMutex);
+			pendingSlotsCondition.wait(lock, [this]() { return stopWorker || !pendingSlots.empty(); });
+			if (pendingSlots.empty())
+			{
+				return;
+			}
+			slot = pendingSlots.front();
+			pendingSlots.pop_front();
+		}
+
+		slot->readEvent.wait();
+
+		if (!writeFailed)
+		{
+			if (writeFrame(*slot))
+			{
+				++numRecordedFrames;
+			}
+			else
+			{
+				std::cerr << "Could not write particle cache frame " << slot->frameIndex << ", recording stopped" << std::endl;
+				writeFailed = true;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(slotsMutex);
+			freeSlots.push_back(slot);
+		}
+	}
+}
+
+bool CacheRecorder::writeFrame(const Slot& slot)
+{
+	// bounds of the living particles, per chunk then merged
+	struct Bounds
+	{
+		float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	};
+	std::vector<Bounds> chunkBounds((numParticles + QUANTIZE_GRAIN_SIZE - 1) / QUANTIZE_GRAIN_SIZE);
+	forEachChunk("cache bounds", [&slot, &chunkBounds](size_t begin, size_t end)
+	{
+		Bounds& bounds = chunkBounds[begin / QUANTIZE_GRAIN_SIZE];
+		for (size_t i = begin; i < end; ++i)
+		{
+			const cl_float4& renderState = slot.renderStates[i];
+			if (renderState.s[3] < 0.f)
+				continue;
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				bounds.min[axis] = std::min(bounds.min[axis], renderState.s[axis]);
+				bounds.max[axis] = std::max(bounds.max[axis], renderState.s[axis]);
+			}
+		}
+	});
+
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const Bounds& bounds : chunkBounds)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			boundsMin[axis] = std::min(boundsMin[axis], bounds.min[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], bounds.max[axis]);
+		}
+	}
+
+	float scale[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (boundsMin[axis] > boundsMax[axis])
+		{
+			boundsMin[axis] = 0.f;
+			boundsMax[axis] = 0.f;
+		}
+		const float extent = boundsMax[axis] - boundsMin[axis];
+		scale[axis] = extent > 0.f ? 65535.f / extent : 0.f;
+	}
+
+	// quantize
+	forEachChunk("cache quantize", [this, &slot, &boundsMin, &scale](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const cl_float4& renderState = slot.renderStates[i];
+			CachedParticle& cachedParticle = compressedFrame[i];
+			const bool isAlive = renderState.s[3] >= 0.f;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float quantized = isAlive ? (renderState.s[axis] - boundsMin[axis]) * scale[axis] : 0.f;
+				cachedParticle.position[axis] = static_cast<uint16_t>(std::lround(std::min(std::max(quantized, 0.f), 65535.f)));
+			}
+			// the packed age is already normalized and clamped
+			cachedParticle.isAlive = isAlive ? 1 : 0;
+			cachedParticle.age = isAlive ? static_cast<uint8_t>(1 + std::lround(std::min(renderState.s[3], 1.f) * 254.f)) : 0;
+		}
+	});
+
+	// align the chunk
+	static const char padding[PARTICLE_CACHE_CHUNK_ALIGNMENT] = {};
+	const size_t paddingSize = static_cast<size_t>((PARTICLE_CACHE_CHUNK_ALIGNMENT - fileOffset % PARTICLE_CACHE_CHUNK_ALIGNMENT) % PARTICLE_CACHE_CHUNK_ALIGNMENT);
+	if (paddingSize > 0 && std::fwrite(padding, paddingSize, 1, file) != 1)
+	{
+		return false;
+	}
+	fileOffset += paddingSize;
+
+	ParticleCacheFrameHeader frameHeader = {};
+	frameHeader.magic = PARTICLE_CACHE_FRAME_MAGIC;
+	frameHeader.frameIndex = slot.frameIndex;
+	frameHeader.simulationTime = slot.simulationTime;
+	std::memcpy(frameHeader.boundsMin, boundsMin, sizeof(boundsMin));
+	std::memcpy(frameHeader.boundsMax, boundsMax, sizeof(boundsMax));
+	frameHeader.payloadSize = numParticles * sizeof(CachedParticle);
+
+	if (std::fwrite(&frameHeader, sizeof(frameHeader), 1, file) != 1
+		|| std::fwrite(compressedFrame.data(), sizeof(CachedParticle), numParticles, file) != numParticles)
+	{
+		return false;
+	}
+
+	ParticleCacheIndexEntry indexEntry = {};
+	indexEntry.offset = fileOffset;
+	indexEntry.frameIndex = slot.frameIndex;
+	indexEntry.simulationTime = slot.simulationTime;
+	index.push_back(indexEntry);
+
+	fileOffset += sizeof(frameHeader) + frameHeader.payloadSize;
+	return true;
+}
+
+void CacheRecorder::forEachChunk(const char* name, const std::function<void(size_t, size_t)>& function)
+{
+	if (jobSystem != nullptr)
+	{
+		jobSystem->parallelFor(name, numParticles, QUANTIZE_GRAIN_SIZE, function);
+		return;
+	}
+
+	for (size_t begin = 0; begin < numParticles; begin += QUANTIZE_GRAIN_SIZE)
+	{
+		function(begin, std::min(begin + QUANTIZE_GRAIN_SIZE, numParticles));
+	}
+}
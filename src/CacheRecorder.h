@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CLUtils.h"
+#include "ParticleCache.h"
+
+class JobSystem;
+
+// records every Nth frame of packed render records to a particle cache file
+// readbacks go asynchronously into a ring of pinned buffers, a worker thread quantizes and writes them
+// when every slot is busy the frame is dropped instead of stalling the caller
+class CacheRecorder
+{
+public:
+	CacheRecorder() = default;
+	CacheRecorder(const CacheRecorder&) = delete;
+	CacheRecorder& operator=(const CacheRecorder&) = delete;
+	~CacheRecorder();
+
+	bool open(
+		const std::string& filePath,
+		const cl::Context& context,
+		const cl::CommandQueue& commandQueue,
+		size_t numParticles,
+		unsigned int frameInterval,
+		unsigned int numSlots,
+		JobSystem* jobSystem = nullptr);
+
+	// waits for the pending frames, writes the index and closes the file
+	void close();
+
+	bool isOpen() const { return file != nullptr; }
+
+	// enqueue the readback of the render records written by packRenderState if this frame must be recorded
+	// one float4 per particle, xyz position and w normalized age, negative for dead particles
+	// the buffer must be usable by the queue (acquired if it is a GL buffer)
+	// the readback starts after waitEvents, readEvent is left null when the frame is skipped or dropped
+	bool recordFrame(
+		const cl::Buffer& renderStateBuffer,
+		double simulationTime,
+		const std::vector<cl::Event>* waitEvents = nullptr,
+		cl::Event* readEvent = nullptr);
+
+	uint64_t getNumRecordedFrames() const { return numRecordedFrames; }
+	uint64_t getNumDroppedFrames() const { return numDroppedFrames; }
+
+private:
+	struct Slot
+	{
+		cl::Buffer pinnedBuffer;
+		cl_float4* renderStates = nullptr;
+		cl::Event readEvent;
+		uint32_t frameIndex = 0;
+		double simulationTime = 0.0;
+	};
+
+	void workerMain();
+	bool writeFrame(const Slot& slot);
+	// bounds and quantization run on the job system when there is one
+	void forEachChunk(const char* name, const std::function<void(size_t, size_t)>& function);
+
+	cl::CommandQueue commandQueue;
+	JobSystem* jobSystem = nullptr;
+	FILE* file = nullptr;
+	uint64_t fileOffset = 0;
+	size_t numParticles = 0;
+	unsigned int frameInterval = 1;
+	uint32_t frameCounter = 0;
+
+	std::vector<Slot> slots;
+	std::vector<Slot*> freeSlots;
+	std::deque<Slot*> pendingSlots;
+	std::mutex slotsMutex;
+	std::condition_variable pendingSlotsCondition;
+	bool stopWorker = false;
+	std::thread worker;
+
+	// only touched by the worker thread until it is joined
+	std::vector<CachedParticle> compressedFrame;
+	std::vector<ParticleCacheIndexEntry> index;
+	bool writeFailed = false;
+
+	std::atomic<uint64_t> numRecordedFrames{ 0 };
+	std::atomic<uint64_t> numDroppedFrames{ 0 };
+};
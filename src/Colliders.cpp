@@ -0,0 +1,179 @@
+#include "Colliders.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "MappedFile.h"
+
+bool ColliderSet::create(const Options& options, const cl::Context& context, const cl::Device& device)
+{
+	if (options.sdfVolumes.size() > MAX_SDF_VOLUMES)
+	{
+		std::cerr << "At most " << MAX_SDF_VOLUMES << " signed distance volumes are supported" << std::endl;
+		return false;
+	}
+
+	std::vector<ColliderParams> colliders;
+	for (const ColliderSource& source : options.colliders)
+	{
+		const float* values = source.values;
+		ColliderParams collider = {};
+		collider.restitution = options.restitution;
+		collider.friction = options.friction;
+		collider.type = static_cast<cl_int>(source.type);
+		switch (source.type)
+		{
+		case ColliderType::Plane:
+		{
+			const float length = std::sqrt(values[0] * values[0] + values[1] * values[1] + values[2] * values[2]);
+			if (length == 0.f)
+			{
+				std::cerr << "Collision plane without a normal" << std::endl;
+				return false;
+			}
+			collider.a = { { values[0] / length, values[1] / length, values[2] / length, values[3] } };
+			break;
+		}
+		case ColliderType::Sphere:
+			collider.a = { { values[0], values[1], values[2], 0.f } };
+			collider.radius = values[3];
+			break;
+		case ColliderType::Box:
+			collider.a = { { values[0], values[1], values[2], 0.f } };
+			collider.b = { { std::fabs(values[3]), std::fabs(values[4]), std::fabs(values[5]), 0.f } };
+			break;
+		case ColliderType::Capsule:
+			collider.a = { { values[0], values[1], values[2], 0.f } };
+			collider.b = { { values[3], values[4], values[5], 0.f } };
+			collider.radius = values[6];
+			break;
+		}
+		colliders.push_back(collider);
+	}
+
+	cl_int code = CL_SUCCESS;
+	numColliders = colliders.size();
+	if (numColliders > 0)
+	{
+		collidersBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, colliders.size() * sizeof(ColliderParams), colliders.data(), &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+	}
+
+	for (const SdfSource& source : options.sdfVolumes)
+	{
+		if (!createSdfVolume(source, options, context, device))
+			return false;
+	}
+	if (!sdfParams.empty())
+	{
+		sdfParamsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sdfParams.size() * sizeof(SdfVolumeParams), sdfParams.data(), &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+	}
+
+	std::cout << "Colliders: " << numColliders << " primitives, " << sdfVolumes.size() << " signed distance volumes" << std::endl;
+	return true;
+}
+
+bool ColliderSet::createSdfVolume(const SdfSource& source, const Options& options, const cl::Context& context, const cl::Device& device)
+{
+	MappedFile file;
+	if (!file.open(source.path))
+	{
+		std::cerr << "Unable to open signed distance volume '" << source.path << "'" << std::endl;
+		return false;
+	}
+
+	// VF_F, 3 uint16 sizes, then one float per voxel with x varying fastest
+	const unsigned char* data = file.getData();
+	const size_t headerSize = 10;
+	if (file.getSize() < headerSize || std::memcmp(data, "VF_F", 4) != 0)
+	{
+		std::cerr << "'" << source.path << "' is not a scalar VF file" << std::endl;
+		return false;
+	}
+
+	size_t size[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		uint16_t axisSize;
+		std::memcpy(&axisSize, data + 4 + axis * 2, sizeof(axisSize));
+		size[axis] = axisSize;
+	}
+	const size_t numVoxels = size[0] * size[1] * size[2];
+	if (numVoxels == 0 || file.getSize() < headerSize + numVoxels * sizeof(float))
+	{
+		std::cerr << "'" << source.path << "' is truncated" << std::endl;
+		return false;
+	}
+	if (size[0] > device.getInfo<CL_DEVICE_IMAGE3D_MAX_WIDTH>() || size[1] > device.getInfo<CL_DEVICE_IMAGE3D_MAX_HEIGHT>()
+		|| size[2] > device.getInfo<CL_DEVICE_IMAGE3D_MAX_DEPTH>())
+	{
+		std::cerr << "Signed distance volume '" << source.path << "' is too large for the device" << std::endl;
+		return false;
+	}
+
+	// single channel floats are optional before OpenCL 2.0, RGBA floats are always supported
+	const bool singleChannel = isImageFormatSupported(context, CL_MEM_OBJECT_IMAGE3D, cl::ImageFormat(CL_R, CL_FLOAT));
+
+	// the 10 byte header leaves the mapped floats unaligned, they are copied into the texel layout
+	const size_t numChannels = singleChannel ? 1 : 4;
+	std::vector<float> texels(numVoxels * numChannels, 0.f);
+	for (size_t voxel = 0; voxel < numVoxels; ++voxel)
+	{
+		std::memcpy(&texels[voxel * numChannels], data + headerSize + voxel * sizeof(float), sizeof(float));
+	}
+
+	cl_int code = CL_SUCCESS;
+	cl::Image3D image(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		cl::ImageFormat(singleChannel ? CL_R : CL_RGBA, CL_FLOAT), size[0], size[1], size[2], 0, 0, texels.data(), &code);
+	if (!checkErrorCode(code, "cl::Image3D"))
+		return false;
+	sdfVolumes.push_back(image);
+
+	// one field unit per voxel, centered on the origin like the VF vector fields
+	// normalized coordinate = (transform * position + size / 2) / size
+	const float* transform = source.transform;
+	SdfVolumeParams params = {};
+	for (int row = 0; row < 3; ++row)
+	{
+		const float inverseSize = 1.f / static_cast<float>(size[row]);
+		for (int column = 0; column < 4; ++column)
+		{
+			params.rows[row].s[column] = transform[row * 4 + column] * inverseSize;
+		}
+		params.rows[row].s[3] += 0.5f;
+		params.texelSize.s[row] = inverseSize;
+	}
+
+	// field distances are converted with the mean scale of the transform, exact for uniform scales
+	const float determinant = transform[0] * (transform[5] * transform[10] - transform[6] * transform[9])
+		- transform[1] * (transform[4] * transform[10] - transform[6] * transform[8])
+		+ transform[2] * (transform[4] * transform[9] - transform[5] * transform[8]);
+	if (determinant == 0.f)
+	{
+		std::cerr << "Signed distance volume '" << source.path << "' has a singular transform" << std::endl;
+		return false;
+	}
+	params.material = { { 1.f / std::cbrt(std::fabs(determinant)), options.restitution, options.friction, 0.f } };
+	sdfParams.push_back(params);
+
+	std::cout << "Signed distance volume " << source.path << ": " << size[0] << "x" << size[1] << "x" << size[2] << std::endl;
+	return true;
+}
+
+std::string ColliderSet::getBuildOptions() const
+{
+	std::string buildOptions;
+	if (numColliders > 0)
+	{
+		buildOptions += " -DPARTICLE_COLLIDERS";
+	}
+	if (!sdfVolumes.empty())
+	{
+		buildOptions += " -DPARTICLE_SDF_VOLUMES=" + std::to_string(sdfVolumes.size());
+	}
+	return buildOptions;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CLUtils.h"
+#include "Options.h"
+
+// layout of the Collider struct in cl/particle.cl
+struct ColliderParams
+{
+	// plane normal and height, sphere and box center, capsule start
+	cl_float4 a;
+	// box half extents, capsule end
+	cl_float4 b;
+	cl_float radius;
+	cl_float restitution;
+	cl_float friction;
+	// ColliderType
+	cl_int type;
+};
+static_assert(sizeof(ColliderParams) == 48, "ColliderParams must match the OpenCL struct size");
+
+// layout of the SdfVolume struct in cl/particle.cl
+struct SdfVolumeParams
+{
+	// world position to normalized volume coordinates, rows of a 3x4 matrix
+	cl_float4 rows[3];
+	// xyz one texel in normalized coordinates, the central differences step
+	cl_float4 texelSize;
+	// x field to world distance scale, y restitution, z friction
+	cl_float4 material;
+};
+static_assert(sizeof(SdfVolumeParams) == 80, "SdfVolumeParams must match the OpenCL struct size");
+
+// static collision geometry tested in updateParticleState (PARTICLE_COLLIDERS, PARTICLE_SDF_VOLUMES)
+// analytic primitives are evaluated directly, signed distance volumes are sampled once per particle
+// plus six samples for the normal when it penetrates, whatever the complexity of the baked mesh
+// the volumes are small enough to be uploaded at startup, directly from the mapped files
+class ColliderSet
+{
+public:
+	// one image argument each, like the vector fields
+	static const unsigned int MAX_SDF_VOLUMES = 4;
+
+	bool create(const Options& options, const cl::Context& context, const cl::Device& device);
+
+	size_t getNumColliders() const { return numColliders; }
+	size_t getNumSdfVolumes() const { return sdfVolumes.size(); }
+	const cl::Buffer& getCollidersBuffer() const { return collidersBuffer; }
+	const cl::Buffer& getSdfParamsBuffer() const { return sdfParamsBuffer; }
+	const cl::Image3D& getSdfVolume(size_t volume) const { return sdfVolumes[volume]; }
+
+	// kernel macros matching the arguments set by the simulation
+	std::string getBuildOptions() const;
+
+private:
+	bool createSdfVolume(const SdfSource& source, const Options& options, const cl::Context& context, const cl::Device& device);
+
+	size_t numColliders = 0;
+	cl::Buffer collidersBuffer;
+	std::vector<SdfVolumeParams> sdfParams;
+	std::vector<cl::Image3D> sdfVolumes;
+	cl::Buffer sdfParamsBuffer;
+};
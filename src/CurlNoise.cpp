@@ -0,0 +1,163 @@
+#include "CurlNoise.h"
+
+#include <cmath>
+#include "Random.h"
+
+// periodic gradient noise, one random unit gradient per lattice point of a period^3 lattice wrapping around
+class PeriodicGradientNoise
+{
+public:
+	PeriodicGradientNoise(unsigned int period, Pcg32& rng)
+		: period(period), gradients(static_cast<size_t>(period) * period * period)
+	{
+		for (cl_float4& gradient : gradients)
+		{
+			// rejection sampling of the unit ball, then normalized
+			float x, y, z, squaredLength;
+			do
+			{
+				x = static_cast<float>(rng.next()) / 4294967295.f * 2.f - 1.f;
+				y = static_cast<float>(rng.next()) / 4294967295.f * 2.f - 1.f;
+				z = static_cast<float>(rng.next()) / 4294967295.f * 2.f - 1.f;
+				squaredLength = x * x + y * y + z * z;
+			} while (squaredLength > 1.f || squaredLength < 1e-4f);
+
+			const float length = std::sqrt(squaredLength);
+			gradient = { { x / length, y / length, z / length, 0.f } };
+		}
+	}
+
+	// lattice coordinates, one lattice cell per unit
+	float sample(float x, float y, float z) const
+	{
+		const int x0 = static_cast<int>(std::floor(x));
+		const int y0 = static_cast<int>(std::floor(y));
+		const int z0 = static_cast<int>(std::floor(z));
+		const float fx = x - static_cast<float>(x0);
+		const float fy = y - static_cast<float>(y0);
+		const float fz = z - static_cast<float>(z0);
+
+		float corners[8];
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const int dx = corner & 1;
+			const int dy = (corner >> 1) & 1;
+			const int dz = (corner >> 2) & 1;
+			const cl_float4& gradient = getGradient(x0 + dx, y0 + dy, z0 + dz);
+			corners[corner] = gradient.s[0] * (fx - dx) + gradient.s[1] * (fy - dy) + gradient.s[2] * (fz - dz);
+		}
+
+		const float u = fade(fx);
+		const float v = fade(fy);
+		const float w = fade(fz);
+		const float x00 = lerp(corners[0], corners[1], u);
+		const float x10 = lerp(corners[2], corners[3], u);
+		const float x01 = lerp(corners[4], corners[5], u);
+		const float x11 = lerp(corners[6], corners[7], u);
+		return lerp(lerp(x00, x10, v), lerp(x01, x11, v), w);
+	}
+
+private:
+	static float fade(float t) { return t * t * t * (t * (t * 6.f - 15.f) + 10.f); }
+	static float lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+	const cl_float4& getGradient(int x, int y, int z) const
+	{
+		const int p = static_cast<int>(period);
+		const size_t index = (static_cast<size_t>(((z % p) + p) % p) * period + ((y % p) + p) % p) * period + ((x % p) + p) % p;
+		return gradients[index];
+	}
+
+	unsigned int period;
+	std::vector<cl_float4> gradients;
+};
+
+std::vector<cl_float4> bakeCurlNoise(unsigned int size, uint64_t seed)
+{
+	// two octaves per potential component, the lattice periods divide the grid so that the volume tiles
+	const unsigned int BASE_PERIOD = 4;
+	Pcg32 rng;
+	rng.seed(seed, 0);
+	std::vector<PeriodicGradientNoise> octaves;
+	for (int component = 0; component < 3; ++component)
+	{
+		octaves.emplace_back(BASE_PERIOD, rng);
+		octaves.emplace_back(BASE_PERIOD * 2, rng);
+	}
+
+	const size_t numTexels = static_cast<size_t>(size) * size * size;
+	std::vector<cl_float4> potential(numTexels);
+	for (unsigned int z = 0; z < size; ++z)
+	{
+		for (unsigned int y = 0; y < size; ++y)
+		{
+			for (unsigned int x = 0; x < size; ++x)
+			{
+				const float u = static_cast<float>(x) / static_cast<float>(size);
+				const float v = static_cast<float>(y) / static_cast<float>(size);
+				const float w = static_cast<float>(z) / static_cast<float>(size);
+				cl_float4& texel = potential[(static_cast<size_t>(z) * size + y) * size + x];
+				for (int component = 0; component < 3; ++component)
+				{
+					const PeriodicGradientNoise& low = octaves[component * 2];
+					const PeriodicGradientNoise& high = octaves[component * 2 + 1];
+					texel.s[component] = low.sample(u * BASE_PERIOD, v * BASE_PERIOD, w * BASE_PERIOD)
+						+ 0.5f * high.sample(u * BASE_PERIOD * 2, v * BASE_PERIOD * 2, w * BASE_PERIOD * 2);
+				}
+				texel.s[3] = 0.f;
+			}
+		}
+	}
+
+	// curl by central differences, wrapping around like the sampler
+	auto at = [&potential, size](unsigned int x, unsigned int y, unsigned int z) -> const cl_float4&
+	{
+		return potential[(static_cast<size_t>(z % size) * size + y % size) * size + x % size];
+	};
+
+	std::vector<cl_float4> curl(numTexels);
+	double sumOfSquares = 0.0;
+	for (unsigned int z = 0; z < size; ++z)
+	{
+		for (unsigned int y = 0; y < size; ++y)
+		{
+			for (unsigned int x = 0; x < size; ++x)
+			{
+				const cl_float4& px = at(x + 1, y, z);
+				const cl_float4& nx = at(x + size - 1, y, z);
+				const cl_float4& py = at(x, y + 1, z);
+				const cl_float4& ny = at(x, y + size - 1, z);
+				const cl_float4& pz = at(x, y, z + 1);
+				const cl_float4& nz = at(x, y, z + size - 1);
+				// d/dx of component c is (px.s[c] - nx.s[c]), the common 1 / (2 * cell size) factor is normalized away
+				const float curlX = (py.s[2] - ny.s[2]) - (pz.s[1] - nz.s[1]);
+				const float curlY = (pz.s[0] - nz.s[0]) - (px.s[2] - nx.s[2]);
+				const float curlZ = (px.s[1] - nx.s[1]) - (py.s[0] - ny.s[0]);
+				curl[(static_cast<size_t>(z) * size + y) * size + x] = { { curlX, curlY, curlZ, 0.f } };
+				sumOfSquares += static_cast<double>(curlX) * curlX + static_cast<double>(curlY) * curlY + static_cast<double>(curlZ) * curlZ;
+			}
+		}
+	}
+
+	const float scale = sumOfSquares > 0.0 ? static_cast<float>(1.0 / std::sqrt(sumOfSquares / (3.0 * static_cast<double>(numTexels)))) : 1.f;
+	for (cl_float4& texel : curl)
+	{
+		texel.s[0] *= scale;
+		texel.s[1] *= scale;
+		texel.s[2] *= scale;
+	}
+	return curl;
+}
+
+cl_float4 getCurlNoiseTransform(float scale, const cl_float3& scrollSpeed, double time)
+{
+	// the volume repeats, wrapping the offset keeps its precision over long runs
+	cl_float4 transform;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const double offset = static_cast<double>(scrollSpeed.s[axis]) * time;
+		transform.s[axis] = static_cast<float>(offset - std::floor(offset));
+	}
+	transform.s[3] = scale;
+	return transform;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "CLUtils.h"
+
+// tileable curl-noise volume for the turbulence force of updateParticleState (PARTICLE_CURL_NOISE)
+// the curl of a periodic vector potential made of gradient noise, divergence-free by construction so that
+// particles swirl instead of bunching up, one float4 texel per cell (xyz force, w 0) of a size^3 grid
+// the force components are normalized to a unit root mean square
+std::vector<cl_float4> bakeCurlNoise(unsigned int size, uint64_t seed);
+
+// the simulation's volume, also replayed by bench/ParticleValidate.cpp
+// fixed seed so that snapshots and caches replay the same flow, one volume repetition every 80 units
+const unsigned int CURL_NOISE_SIZE = 64;
+const uint64_t CURL_NOISE_SEED = 1;
+const float CURL_NOISE_SCALE = 1.f / 80.f;
+const cl_float3 CURL_NOISE_SCROLL_SPEED = { { 0.013f, 0.021f, 0.008f, 0.f } };
+
+// curlNoiseTransform argument of updateParticleState at a simulation time, xyz scrolled offset and w scale
+cl_float4 getCurlNoiseTransform(float scale, const cl_float3& scrollSpeed, double time);
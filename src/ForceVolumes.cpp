@@ -0,0 +1,205 @@
+#include "ForceVolumes.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+bool makeForceVolume(const ForceVolumeSource& source, ForceVolumeParams& volume)
+{
+	const float* values = source.values;
+	volume = ForceVolumeParams();
+	volume.type = static_cast<cl_int>(source.type);
+	volume.a = { { values[0], values[1], values[2], 0.f } };
+	switch (source.type)
+	{
+	case ForceVolumeType::Attractor:
+		volume.a.s[3] = std::fabs(values[3]);
+		volume.force.s[0] = values[4];
+		break;
+	case ForceVolumeType::Wind:
+		volume.b = { { std::fabs(values[3]), std::fabs(values[4]), std::fabs(values[5]), 0.f } };
+		volume.force = { { values[6], values[7], values[8], 0.f } };
+		break;
+	case ForceVolumeType::Vortex:
+		volume.a.s[3] = std::fabs(values[3]);
+		volume.b.s[1] = std::fabs(values[4]);
+		volume.force.s[0] = values[5];
+		break;
+	}
+
+	if (source.type != ForceVolumeType::Wind && volume.a.s[3] == 0.f)
+	{
+		std::cerr << "Force volume without a radius" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void getForceVolumeBounds(const ForceVolumeParams& volume, float boundsMin[3], float boundsMax[3])
+{
+	float halfExtents[3];
+	switch (static_cast<ForceVolumeType>(volume.type))
+	{
+	case ForceVolumeType::Attractor:
+		halfExtents[0] = halfExtents[1] = halfExtents[2] = volume.a.s[3];
+		break;
+	case ForceVolumeType::Wind:
+		halfExtents[0] = volume.b.s[0];
+		halfExtents[1] = volume.b.s[1];
+		halfExtents[2] = volume.b.s[2];
+		break;
+	default:
+		halfExtents[0] = halfExtents[2] = volume.a.s[3];
+		halfExtents[1] = volume.b.s[1];
+		break;
+	}
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		boundsMin[axis] = volume.a.s[axis] - halfExtents[axis];
+		boundsMax[axis] = volume.a.s[axis] + halfExtents[axis];
+	}
+}
+
+void binForceVolumes(const std::vector<ForceVolumeParams>& volumes, unsigned int maxCellsPerAxis, ForceVolumeGrid& grid,
+	std::vector<ForceVolumeCell>& cells, std::vector<uint32_t>& indices)
+{
+	float gridMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float gridMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const ForceVolumeParams& volume : volumes)
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		getForceVolumeBounds(volume, boundsMin, boundsMax);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			gridMin[axis] = std::min(gridMin[axis], boundsMin[axis]);
+			gridMax[axis] = std::max(gridMax[axis], boundsMax[axis]);
+		}
+	}
+
+	// cubic cells where the union allows it, a flat axis gets a single cell
+	maxCellsPerAxis = std::max(maxCellsPerAxis, 1u);
+	float extent[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		extent[axis] = volumes.empty() ? 1.f : std::max(gridMax[axis] - gridMin[axis], 1e-3f);
+	}
+	const double maxCells = static_cast<double>(maxCellsPerAxis) * maxCellsPerAxis * maxCellsPerAxis;
+	const double targetCells = std::min(static_cast<double>(volumes.size()) * ForceVolumeSet::CELLS_PER_VOLUME, maxCells);
+	const double cellSize = std::cbrt(static_cast<double>(extent[0]) * extent[1] * extent[2] / std::max(targetCells, 1.0));
+
+	grid = ForceVolumeGrid();
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const double numCells = std::ceil(extent[axis] / cellSize);
+		grid.size.s[axis] = static_cast<cl_int>(std::min(std::max(numCells, 1.0), static_cast<double>(maxCellsPerAxis)));
+		grid.origin.s[axis] = volumes.empty() ? 0.f : gridMin[axis];
+		grid.inverseCellSize.s[axis] = static_cast<float>(grid.size.s[axis]) / extent[axis];
+	}
+
+	// cell range of each volume, clamped for the bounds on the far faces
+	auto getCellRange = [&grid](const ForceVolumeParams& volume, int first[3], int last[3])
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		getForceVolumeBounds(volume, boundsMin, boundsMax);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const int maxCell = grid.size.s[axis] - 1;
+			first[axis] = std::min(std::max(static_cast<int>((boundsMin[axis] - grid.origin.s[axis]) * grid.inverseCellSize.s[axis]), 0), maxCell);
+			last[axis] = std::min(std::max(static_cast<int>((boundsMax[axis] - grid.origin.s[axis]) * grid.inverseCellSize.s[axis]), 0), maxCell);
+		}
+	};
+
+	// count, prefix sum, then scatter with the counts as cursors
+	const size_t numCells = static_cast<size_t>(grid.size.s[0]) * grid.size.s[1] * grid.size.s[2];
+	cells.assign(numCells, ForceVolumeCell{ 0, 0 });
+	auto forEachCell = [&grid, &getCellRange](const ForceVolumeParams& volume, auto&& function)
+	{
+		int first[3];
+		int last[3];
+		getCellRange(volume, first, last);
+		for (int z = first[2]; z <= last[2]; ++z)
+		{
+			for (int y = first[1]; y <= last[1]; ++y)
+			{
+				for (int x = first[0]; x <= last[0]; ++x)
+				{
+					function((static_cast<size_t>(z) * grid.size.s[1] + y) * grid.size.s[0] + x);
+				}
+			}
+		}
+	};
+
+	for (const ForceVolumeParams& volume : volumes)
+	{
+		forEachCell(volume, [&cells](size_t cell) { ++cells[cell].count; });
+	}
+
+	uint32_t start = 0;
+	for (ForceVolumeCell& cell : cells)
+	{
+		cell.start = start;
+		start += cell.count;
+		cell.count = 0;
+	}
+
+	indices.resize(start);
+	for (size_t i = 0; i < volumes.size(); ++i)
+	{
+		forEachCell(volumes[i], [&cells, &indices, i](size_t cell)
+		{
+			indices[cells[cell].start + cells[cell].count++] = static_cast<uint32_t>(i);
+		});
+	}
+}
+
+bool ForceVolumeSet::create(const Options& options, cl::CommandQueue& commandQueue)
+{
+	std::vector<ForceVolumeParams> volumes(options.forceVolumes.size());
+	for (size_t i = 0; i < volumes.size(); ++i)
+	{
+		if (!makeForceVolume(options.forceVolumes[i], volumes[i]))
+			return false;
+	}
+
+	if (!update(commandQueue, volumes))
+		return false;
+
+	std::cout << "Force volumes: " << numVolumes << " in " << grid.size.s[0] << "x" << grid.size.s[1] << "x" << grid.size.s[2]
+		<< " cells, " << indices.size() << " cell references" << std::endl;
+	return true;
+}
+
+bool ForceVolumeSet::update(cl::CommandQueue& commandQueue, const std::vector<ForceVolumeParams>& volumes, unsigned int maxCellsPerAxis)
+{
+	if (volumes.empty())
+	{
+		std::cerr << "Force volume set without volumes" << std::endl;
+		return false;
+	}
+
+	binForceVolumes(volumes, maxCellsPerAxis, grid, cells, indices);
+	numVolumes = volumes.size();
+	return write(commandQueue, gridBuffer, gridCapacity, &grid, sizeof(grid))
+		&& write(commandQueue, volumesBuffer, volumesCapacity, volumes.data(), volumes.size() * sizeof(ForceVolumeParams))
+		&& write(commandQueue, cellsBuffer, cellsCapacity, cells.data(), cells.size() * sizeof(ForceVolumeCell))
+		&& write(commandQueue, indicesBuffer, indicesCapacity, indices.data(), indices.size() * sizeof(uint32_t));
+}
+
+bool ForceVolumeSet::write(cl::CommandQueue& commandQueue, cl::Buffer& buffer, size_t& capacity, const void* data, size_t size)
+{
+	cl_int code = CL_SUCCESS;
+	if (size > capacity)
+	{
+		capacity = std::max(size, capacity * 2);
+		buffer = cl::Buffer(commandQueue.getInfo<CL_QUEUE_CONTEXT>(), CL_MEM_READ_ONLY, capacity, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+			return false;
+	}
+
+	code = commandQueue.enqueueWriteBuffer(buffer, CL_TRUE, 0, size, data);
+	return checkErrorCode(code, "enqueueWriteBuffer");
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "CLUtils.h"
+#include "Options.h"
+
+// layout of the ForceVolume struct in cl/particle.cl
+struct ForceVolumeParams
+{
+	// center xyz, w attractor and vortex radius
+	cl_float4 a;
+	// wind half extents, vortex half height in y
+	cl_float4 b;
+	// wind acceleration xyz, attractor and vortex strength in x
+	cl_float4 force;
+	// ForceVolumeType
+	cl_int type;
+	cl_int padding[3];
+};
+
+static_assert(sizeof(ForceVolumeParams) == 64, "ForceVolumeParams must match the OpenCL struct size");
+
+// layout of the ForceVolumeGrid struct in cl/particle.cl
+struct ForceVolumeGrid
+{
+	cl_float4 origin;
+	cl_float4 inverseCellSize;
+	cl_int4 size;
+};
+
+// run of volume indices of a grid cell, a uint2 in cl/particle.cl
+// plain integers, the alignment attributes of the CL vector types are dropped in template arguments
+struct ForceVolumeCell
+{
+	uint32_t start;
+	uint32_t count;
+};
+
+static_assert(sizeof(ForceVolumeCell) == 8, "ForceVolumeCell must match the OpenCL uint2 size");
+
+bool makeForceVolume(const ForceVolumeSource& source, ForceVolumeParams& volume);
+// axis aligned bounds of the region where the volume accelerates
+void getForceVolumeBounds(const ForceVolumeParams& volume, float boundsMin[3], float boundsMax[3]);
+
+// uniform grid over the union of the volume bounds with about CELLS_PER_VOLUME cells per volume, up to maxCellsPerAxis
+// cells holds the start and count of each cell's run of volume indices, x varying fastest
+// a single cell per axis evaluates every volume for every particle
+void binForceVolumes(const std::vector<ForceVolumeParams>& volumes, unsigned int maxCellsPerAxis, ForceVolumeGrid& grid,
+	std::vector<ForceVolumeCell>& cells, std::vector<uint32_t>& indices);
+
+// bounded attractors, wind boxes and vortices evaluated in updateParticleState (PARTICLE_FORCE_VOLUMES)
+// the volumes are binned on the host, each particle only evaluates the volumes overlapping its cell
+class ForceVolumeSet
+{
+public:
+	static const unsigned int CELLS_PER_VOLUME = 4;
+	static const unsigned int MAX_CELLS_PER_AXIS = 32;
+
+	bool create(const Options& options, cl::CommandQueue& commandQueue);
+
+	// rebins and uploads volumes moved by the caller, with blocking writes
+	// the buffers are reallocated when they grow, the kernel arguments must be set again afterwards
+	bool update(cl::CommandQueue& commandQueue, const std::vector<ForceVolumeParams>& volumes, unsigned int maxCellsPerAxis = MAX_CELLS_PER_AXIS);
+
+	size_t getNumVolumes() const { return numVolumes; }
+	size_t getNumCells() const { return cells.size(); }
+	// volume references summed over the cells
+	size_t getNumIndices() const { return indices.size(); }
+	const cl::Buffer& getGridBuffer() const { return gridBuffer; }
+	const cl::Buffer& getVolumesBuffer() const { return volumesBuffer; }
+	const cl::Buffer& getCellsBuffer() const { return cellsBuffer; }
+	const cl::Buffer& getIndicesBuffer() const { return indicesBuffer; }
+
+private:
+	// doubles the capacity when the data does not fit
+	static bool write(cl::CommandQueue& commandQueue, cl::Buffer& buffer, size_t& capacity, const void* data, size_t size);
+
+	size_t numVolumes = 0;
+	ForceVolumeGrid grid = {};
+	std::vector<ForceVolumeCell> cells;
+	std::vector<uint32_t> indices;
+
+	cl::Buffer gridBuffer;
+	cl::Buffer volumesBuffer;
+	cl::Buffer cellsBuffer;
+	cl::Buffer indicesBuffer;
+	size_t gridCapacity = 0;
+	size_t volumesCapacity = 0;
+	size_t cellsCapacity = 0;
+	size_t indicesCapacity = 0;
+};
@@ -0,0 +1,167 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+static std::string toJsonString(const std::string& value)
+{
+	std::string json = "\"";
+	for (char c : value)
+	{
+		switch (c)
+		{
+		case '"': json += "\\\""; break;
+		case '\\': json += "\\\\"; break;
+		case '\n': json += "\\n"; break;
+		case '\t': json += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				json += escaped;
+			}
+			else
+			{
+				json += c;
+			}
+		}
+	}
+	return json + "\"";
+}
+
+static std::string toJsonNumber(double value)
+{
+	// JSON has no nan or infinity
+	if (!std::isfinite(value))
+		return "null";
+
+	char number[32];
+	std::snprintf(number, sizeof(number), "%.6g", value);
+	return number;
+}
+
+FrameStats::Stage& FrameStats::getStage(const std::string& name)
+{
+	for (Stage& stage : stages)
+	{
+		if (stage.name == name)
+		{
+			return stage;
+		}
+	}
+	stages.push_back({ name, {}, {} });
+	return stages.back();
+}
+
+void FrameStats::add(const std::string& stage, double milliseconds)
+{
+	getStage(stage).samples.push_back(milliseconds);
+}
+
+void FrameStats::setStageValue(const std::string& stage, const std::string& key, double value)
+{
+	getStage(stage).values.emplace_back(key, value);
+}
+
+void FrameStats::setInfo(const std::string& key, const std::string& value)
+{
+	info.emplace_back(key, toJsonString(value));
+}
+
+void FrameStats::setInfo(const std::string& key, double value)
+{
+	info.emplace_back(key, toJsonNumber(value));
+}
+
+FrameStats::Summary FrameStats::summarize(std::vector<double> samples)
+{
+	Summary summary;
+	if (samples.empty())
+	{
+		return summary;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	// nearest rank
+	auto percentile = [&samples](double p)
+	{
+		const size_t rank = static_cast<size_t>(p * static_cast<double>(samples.size()) + 0.999999);
+		return samples[std::min(std::max<size_t>(rank, 1), samples.size()) - 1];
+	};
+
+	summary.count = samples.size();
+	summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+	if (samples.size() > 1)
+	{
+		double sumOfSquares = 0.0;
+		for (double sample : samples)
+		{
+			sumOfSquares += (sample - summary.mean) * (sample - summary.mean);
+		}
+		summary.stddev = std::sqrt(sumOfSquares / static_cast<double>(samples.size() - 1));
+	}
+	summary.min = samples.front();
+	summary.p50 = percentile(0.50);
+	summary.p95 = percentile(0.95);
+	summary.p99 = percentile(0.99);
+	summary.max = samples.back();
+	return summary;
+}
+
+bool FrameStats::writeJson(const std::string& filePath) const
+{
+	std::ostringstream json;
+	json << "{\n";
+	for (const std::pair<std::string, std::string>& entry : info)
+	{
+		json << "\t" << toJsonString(entry.first) << ": " << entry.second << ",\n";
+	}
+
+	json << "\t\"stages\": {";
+	for (size_t i = 0; i < stages.size(); ++i)
+	{
+		const Summary summary = summarize(stages[i].samples);
+		json << (i > 0 ? "," : "") << "\n\t\t" << toJsonString(stages[i].name) << ": { "
+			<< "\"count\": " << summary.count
+			<< ", \"mean\": " << toJsonNumber(summary.mean)
+			<< ", \"stddev\": " << toJsonNumber(summary.stddev)
+			<< ", \"min\": " << toJsonNumber(summary.min)
+			<< ", \"p50\": " << toJsonNumber(summary.p50)
+			<< ", \"p95\": " << toJsonNumber(summary.p95)
+			<< ", \"p99\": " << toJsonNumber(summary.p99)
+			<< ", \"max\": " << toJsonNumber(summary.max);
+		for (const std::pair<std::string, double>& value : stages[i].values)
+		{
+			json << ", " << toJsonString(value.first) << ": " << toJsonNumber(value.second);
+		}
+		json << " }";
+	}
+	json << "\n\t}\n}\n";
+
+	std::ofstream file(filePath.c_str(), std::ofstream::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Could not write '" << filePath << "'" << std::endl;
+		return false;
+	}
+	file << json.str();
+	return file.good();
+}
+
+void FrameStats::print() const
+{
+	std::printf("%-16s %8s %10s %10s %10s %10s\n", "stage (ms)", "count", "mean", "p50", "p95", "p99");
+	for (const Stage& stage : stages)
+	{
+		const Summary summary = summarize(stage.samples);
+		std::printf("%-16s %8u %10.3f %10.3f %10.3f %10.3f\n", stage.name.c_str(), static_cast<unsigned int>(summary.count),
+			summary.mean, summary.p50, summary.p95, summary.p99);
+	}
+}
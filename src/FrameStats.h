@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// per stage timing samples of a benchmark run, written as JSON with their percentiles
+class FrameStats
+{
+public:
+	struct Summary
+	{
+		size_t count = 0;
+		double mean = 0.0;
+		// sample standard deviation
+		double stddev = 0.0;
+		double min = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	// stages are written in the order they were first added
+	void add(const std::string& stage, double milliseconds);
+	// string or number metadata written next to the stages, numbers are written as is
+	void setInfo(const std::string& key, const std::string& value);
+	void setInfo(const std::string& key, double value);
+	// derived number written inside a stage, e.g. its bandwidth
+	void setStageValue(const std::string& stage, const std::string& key, double value);
+
+	static Summary summarize(std::vector<double> samples);
+
+	bool writeJson(const std::string& filePath) const;
+	void print() const;
+
+private:
+	struct Stage
+	{
+		std::string name;
+		std::vector<double> samples;
+		std::vector<std::pair<std::string, double>> values;
+	};
+
+	Stage& getStage(const std::string& name);
+
+	std::vector<Stage> stages;
+	// values are already JSON encoded
+	std::vector<std::pair<std::string, std::string>> info;
+};
@@ -5,9 +5,13 @@
 #include <cstring>
 #include <cassert>
 #include <cmath>
-#define CL_HPP_MINIMUM_OPENCL_VERSION 110
-#define CL_HPP_TARGET_OPENCL_VERSION 110
-#include <CL/opencl.hpp>
+#include <ctime>
+#include <algorithm>
+#include <future>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include "CLUtils.h"
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
@@ -16,31 +20,64 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/norm.hpp>
-
-#ifdef _WIN32
-#include <windows.h>
-#define getCurrentDeviceContext() wglGetCurrentDC()
-#define DEVICE_CONTEXT_PROPERTY_NAME CL_WGL_HDC_KHR
-#else
-#error Unsupported platform
-#endif
+#include "BuildProfiles.h"
+#include "CachePlayer.h"
+#include "CacheRecorder.h"
+#include "Colliders.h"
+#include "CurlNoise.h"
+#include "ForceVolumes.h"
+#include "FrameStats.h"
+#include "GLSharing.h"
+#include "Heightfield.h"
+#include "JobSystem.h"
+#include "LifeCurves.h"
+#include "MeshBvh.h"
+#include "OffscreenContext.h"
+#include "Options.h"
+#include "ParticleState.h"
+#include "PointCloud.h"
+#include "ProgramBinaryCache.h"
+#include "Random.h"
+#include "Resources.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "StartupTimer.h"
+#include "TriangleMesh.h"
+#include "VectorField.h"
 
 #define GL_SHARING_EXTENSION "cl_khr_gl_sharing"
 
-// read shader or opencl file
-std::string readFile(const std::string& filePath);
-
 // load image as sdl surface and upload to gpu
 GLuint loadImage(const std::string& filePath);
+SDL_Surface* decodeImage(const std::string& filePath);
+GLuint uploadImage(SDL_Surface* surface);
+// 1D float texture of a curve baked by bakeLifeCurve, 1 or 4 channels
+GLuint uploadLifeCurve(const std::vector<float>& texels, size_t numChannels);
 
-// shaders
-GLuint compileProgram(GLuint vertexShaderId, GLuint geometryShaderId, GLuint fragmentShaderId);
+// load a point cloud into an OpenCL buffer of float4 positions
+bool loadPointCloud(const std::string& filePath, const cl::Context& context, cl::CommandQueue& commandQueue, const cl::Device& device, cl::Buffer& pointsBuffer, cl_uint& numPoints);
+
+// shaders, submit functions do not wait for the driver, check functions do
+bool enableParallelShaderCompile();
+GLuint submitProgram(GLuint vertexShaderId, GLuint geometryShaderId, GLuint fragmentShaderId, bool retrievableBinary);
 bool checkProgram(GLuint programId);
-GLuint loadShader(GLenum shaderType, const GLchar* source);
+GLuint submitShader(GLenum shaderType, const GLchar* source);
 bool checkShader(GLuint shaderId);
 
-// OpenCL
-const char* getErrorString(cl_int error);
+// OpenCL platform and GPU device discovery, the device is null on failure
+std::pair<cl::Platform, cl::Device> findOpenCLDevice();
+
+// asynchronous OpenCL program build
+struct ProgramBuild
+{
+	std::promise<void> built;
+	StartupTimer* startupTimer;
+	StartupTimer::Clock::time_point start;
+	cl_device_id device;
+	// read by the callback once the build completed, valid after built
+	cl_build_status status = CL_BUILD_NONE;
+};
+void CL_CALLBACK onProgramBuilt(cl_program program, void* userData);
 
 #define DEBUG_BREAK() *(int*)0 = 0
 
@@ -67,42 +104,186 @@ const char* getErrorString(cl_int error);
 
 int main(int argc, char* argv[])
 {
-	// init SDL window
-	SDL_Init(SDL_INIT_VIDEO);
+	StartupTimer startupTimer;
+	StartupTimer::Clock::time_point phaseStart = StartupTimer::Clock::now();
+	auto endPhase = [&startupTimer, &phaseStart](const char* phase)
+	{
+		const StartupTimer::Clock::time_point now = StartupTimer::Clock::now();
+		startupTimer.record(phase, phaseStart, now);
+		phaseStart = now;
+	};
 
-	SDL_DisplayMode displayMode;
-	SDL_GetCurrentDisplayMode(0, &displayMode);
-	unsigned int windowWidth = static_cast<unsigned int>(static_cast<float>(displayMode.w) * 0.75f);
-	unsigned int windowHeight = static_cast<unsigned int>(static_cast<float>(displayMode.h) * 0.75f);
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
 
-	srand(static_cast<unsigned int>(time(nullptr)));
+	if (!options.resourceDirectory.empty())
+	{
+		setResourceDirectory(options.resourceDirectory);
+	}
 
-	SDL_Window* window = SDL_CreateWindow(
-		"OpenGL/OpenCL Test",
-		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-		windowWidth, windowHeight,
-		SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
-	);
-	if (window == nullptr)
+	// benchmark runs are repeatable: fixed seed and time step, scripted camera, offscreen by default
+	const bool benchmark = !options.benchmarkPath.empty();
+	const unsigned int BENCHMARK_WARMUP_FRAMES = 30;
+	const float BENCHMARK_DELTA_TIME = 1.f / 60.f;
+	if (benchmark)
 	{
-		std::cerr << "Could not open SDL window" << std::endl;
-		return EXIT_FAILURE;
+		if (!options.playPath.empty())
+		{
+			std::cerr << "--benchmark measures the simulation, it cannot be combined with --play" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!options.fixedSeed)
+		{
+			options.seed = 1;
+			options.fixedSeed = true;
+		}
+		if (options.offscreenWidth == 0)
+		{
+			options.offscreenWidth = 1280;
+			options.offscreenHeight = 720;
+		}
+		if (options.maxFrames == 0)
+		{
+			options.maxFrames = 600;
+		}
+		options.maxFrames += BENCHMARK_WARMUP_FRAMES;
 	}
 
-	SDL_GLContext glContext = SDL_GL_CreateContext(window);
-	if (glContext == nullptr)
+	// resource loading, image decoding and OpenCL device discovery run on worker threads
+	// while the window and the GL context are created
+	auto loadResourceAsync = [&startupTimer](const char* path)
 	{
-		std::cerr << "Could not create GL context" << std::endl;
-		return EXIT_FAILURE;
+		return std::async(std::launch::async, [&startupTimer, path]()
+		{
+			StartupTimer::Scope scope(startupTimer, path);
+			std::optional<std::string> contents(std::in_place);
+			if (!loadResource(path, *contents))
+			{
+				contents.reset();
+			}
+			return contents;
+		});
+	};
+	std::future<std::optional<std::string>> vertexShaderSourceFuture = loadResourceAsync("shaders/shader.vert");
+	std::future<std::optional<std::string>> geometryShaderSourceFuture = loadResourceAsync("shaders/shader.geom");
+	std::future<std::optional<std::string>> fragmentShaderSourceFuture = loadResourceAsync("shaders/shader.frag");
+	std::future<std::optional<std::string>> programSourceFuture = loadResourceAsync("cl/particle.cl");
+
+	// collision meshes, the BVH kernels are appended to the particle kernels
+	const bool useMeshCollision = !options.collisionMeshes.empty() && options.playPath.empty();
+	std::future<std::optional<std::string>> meshProgramSourceFuture;
+	std::future<std::optional<std::vector<cl_float4>>> collisionMeshFuture;
+	if (useMeshCollision)
+	{
+		meshProgramSourceFuture = loadResourceAsync("cl/bvh.cl");
+		collisionMeshFuture = std::async(std::launch::async, [&startupTimer, &options]()
+		{
+			StartupTimer::Scope scope(startupTimer, "collision mesh load");
+			std::optional<std::vector<cl_float4>> triangles(std::in_place);
+			for (const CollisionMeshSource& mesh : options.collisionMeshes)
+			{
+				if (!loadTriangleMesh(mesh.path, mesh.transform, *triangles))
+				{
+					triangles.reset();
+					break;
+				}
+			}
+			return triangles;
+		});
+	}
+
+	std::future<SDL_Surface*> particleImageFuture = std::async(std::launch::async, [&startupTimer]()
+	{
+		StartupTimer::Scope scope(startupTimer, "decode data/particle.png");
+		return decodeImage("data/particle.png");
+	});
+
+	// turbulence volume
+	std::future<std::vector<cl_float4>> curlNoiseFuture;
+	if (options.curlNoise)
+	{
+		curlNoiseFuture = std::async(std::launch::async, [&startupTimer]()
+		{
+			StartupTimer::Scope scope(startupTimer, "curl noise bake");
+			return bakeCurlNoise(CURL_NOISE_SIZE, CURL_NOISE_SEED);
+		});
 	}
 
-	SDL_GL_MakeCurrent(window, glContext);
+	std::future<std::pair<cl::Platform, cl::Device>> openCLDeviceFuture = std::async(std::launch::async, [&startupTimer]()
+	{
+		StartupTimer::Scope scope(startupTimer, "OpenCL device discovery");
+		return findOpenCLDevice();
+	});
+
+	// host random stream producing the kernel seeds, saved in snapshots
+	Pcg32 rng;
+	rng.seed(options.fixedSeed ? options.seed : static_cast<uint64_t>(time(nullptr)), 0);
+
+	// init SDL window, or a headless EGL context rendering into a framebuffer
+	const bool offscreen = options.offscreenWidth > 0;
+	unsigned int windowWidth;
+	unsigned int windowHeight;
+	SDL_Window* window = nullptr;
+	SDL_GLContext glContext = nullptr;
+	OffscreenContext offscreenContext;
+	if (offscreen)
+	{
+		SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS);
+
+		windowWidth = options.offscreenWidth;
+		windowHeight = options.offscreenHeight;
+		if (!offscreenContext.create())
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		SDL_Init(SDL_INIT_VIDEO);
+
+		SDL_DisplayMode displayMode;
+		SDL_GetCurrentDisplayMode(0, &displayMode);
+		windowWidth = static_cast<unsigned int>(static_cast<float>(displayMode.w) * 0.75f);
+		windowHeight = static_cast<unsigned int>(static_cast<float>(displayMode.h) * 0.75f);
+
+		window = SDL_CreateWindow(
+			"OpenGL/OpenCL Test",
+			SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+			windowWidth, windowHeight,
+			SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
+		);
+		if (window == nullptr)
+		{
+			std::cerr << "Could not open SDL window" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		glContext = SDL_GL_CreateContext(window);
+		if (glContext == nullptr)
+		{
+			std::cerr << "Could not create GL context" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		SDL_GL_MakeCurrent(window, glContext);
+	}
 
 	// init OpenGL
 	glewExperimental = GL_TRUE;
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-	int err = glewInit();
+	GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLEW built for GLX still loads the GL entry points of an EGL context
+	if (offscreen && err == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		err = GLEW_OK;
+	}
+#endif
 	if (err != GLEW_OK)
 	{
 		std::cerr << "glewInit failed: " << glewGetErrorString(err) << std::endl;
@@ -119,41 +300,294 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
-	std::string vertexShaderSource = readFile("shaders/shader.vert");
-	GLuint vertexShaderId = loadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
-	if (vertexShaderId == 0)
+	if (offscreen && !offscreenContext.createFramebuffer(windowWidth, windowHeight))
+	{
+		return EXIT_FAILURE;
+	}
+	endPhase("window and GL context");
+
+	// OpenCL context, the program builds asynchronously while the GL shaders compile
+	cl_int code;
+
+	cl::Platform platform;
+	cl::Device device;
+	std::tie(platform, device) = openCLDeviceFuture.get();
+	if (device() == nullptr)
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Device name   : " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+	std::cout << "Device vendor : " << device.getInfo<CL_DEVICE_VENDOR>() << std::endl;
+	std::cout << "Device version: " << device.getInfo<CL_DRIVER_VERSION>() << std::endl;
+
+	// check if sharing is supported on the device, otherwise the particles are copied through host memory
+	const std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+	const bool sharingSupported = extensions.find(GL_SHARING_EXTENSION) != std::string::npos;
+	const bool glSharing = sharingSupported && !options.disableGLSharing;
+
+	if (!glSharing)
+	{
+		std::cout << (sharingSupported ? "Sharing disabled" : "Sharing not supported") << ", copying the particles through host memory" << std::endl;
+	}
+
+	const bool curlNoise = options.curlNoise && device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() == CL_TRUE;
+	if (options.curlNoise && !curlNoise)
+	{
+		std::cout << "Images not supported, white noise turbulence instead of curl noise" << std::endl;
+	}
+
+	// context
+	const std::vector<cl_context_properties> sharingContextProperties = getGLSharingContextProperties(platform);
+	cl_context_properties contextProperties[] = {
+		CL_CONTEXT_PLATFORM,			(cl_context_properties)(platform)(),
+		0
+	};
+	cl::Context gpuContext(device, glSharing ? sharingContextProperties.data() : contextProperties);
+
+	// command queue
+	cl::CommandQueue commandQueue(gpuContext, device);
+
+	// vector field volumes, uploaded in the background while the program builds
+	VectorFieldSet vectorFields;
+	const bool useVectorFields = !options.vectorFields.empty() && options.playPath.empty();
+	if (useVectorFields)
+	{
+		if (device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() != CL_TRUE)
+		{
+			std::cerr << "Vector fields need image support" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!vectorFields.open(options.vectorFields, gpuContext, device))
+		{
+			return EXIT_FAILURE;
+		}
+		endPhase("vector field headers");
+	}
+
+	// bounded forces
+	ForceVolumeSet forceVolumes;
+	const bool useForceVolumes = !options.forceVolumes.empty() && options.playPath.empty();
+	if (useForceVolumes)
+	{
+		if (!forceVolumes.create(options, commandQueue))
+		{
+			return EXIT_FAILURE;
+		}
+		endPhase("force volumes");
+	}
+
+	// collision geometry
+	ColliderSet colliders;
+	const bool useColliders = (!options.colliders.empty() || !options.sdfVolumes.empty()) && options.playPath.empty();
+	if (useColliders)
+	{
+		if (!options.sdfVolumes.empty() && device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() != CL_TRUE)
+		{
+			std::cerr << "Signed distance volumes need image support" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!colliders.create(options, gpuContext, device))
+		{
+			return EXIT_FAILURE;
+		}
+		endPhase("colliders");
+	}
+
+	// terrain
+	Heightfield heightfield;
+	const bool useHeightfield = !options.heightfieldPath.empty() && options.playPath.empty();
+	if (useHeightfield)
+	{
+		if (device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() != CL_TRUE)
+		{
+			std::cerr << "Heightfields need image support" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!heightfield.create(options, gpuContext, device))
+		{
+			return EXIT_FAILURE;
+		}
+		endPhase("heightfield");
+	}
+
+	// program, from the offline compiled SPIR-V when available, the resource directory override always builds from source
+	// the SPIR-V kernel is compiled with curl noise, without vector fields, force volumes and collisions
+	const BuildProfile* buildProfile = findBuildProfile(options.clBuildProfile);
+	if (buildProfile == nullptr)
 	{
-		DEBUG_BREAK();
 		return EXIT_FAILURE;
 	}
+	std::string buildOptions = buildProfile->options;
+	if (curlNoise)
+	{
+		buildOptions += " -DPARTICLE_CURL_NOISE";
+	}
+	if (useVectorFields)
+	{
+		buildOptions += " -DPARTICLE_VECTOR_FIELDS=" + std::to_string(vectorFields.getNumFields());
+	}
+	if (useForceVolumes)
+	{
+		buildOptions += " -DPARTICLE_FORCE_VOLUMES";
+	}
+	if (useColliders)
+	{
+		buildOptions += colliders.getBuildOptions();
+	}
+	if (useMeshCollision)
+	{
+		buildOptions += " -DPARTICLE_MESH_COLLISION";
+	}
+	if (useHeightfield)
+	{
+		buildOptions += " -DPARTICLE_HEIGHTFIELD";
+	}
+	const bool needsSourceFeatures = useVectorFields || useForceVolumes || useColliders || useMeshCollision || useHeightfield;
+	cl::Program program;
+	std::string programIL;
+	if (options.useSpirv && curlNoise && !needsSourceFeatures && !buildProfile->requiresSource && getResourceDirectory().empty()
+		&& loadEmbeddedResource("cl/particle.spv", programIL) && isILProgramSupported(device))
+	{
+		program = createProgramWithIL(gpuContext, programIL, &code);
+		if (code == CL_SUCCESS)
+		{
+			std::cout << "OpenCL program loaded from SPIR-V" << std::endl;
+		}
+		else
+		{
+			std::cerr << "Unable to load the SPIR-V program (" << getErrorString(code) << "), building from source" << std::endl;
+		}
+	}
+	if (program() == nullptr)
+	{
+		std::optional<std::string> programSource = programSourceFuture.get();
+		if (!programSource)
+		{
+			return EXIT_FAILURE;
+		}
+		if (useMeshCollision)
+		{
+			std::optional<std::string> meshProgramSource = meshProgramSourceFuture.get();
+			if (!meshProgramSource)
+			{
+				return EXIT_FAILURE;
+			}
+			*programSource += "\n" + *meshProgramSource;
+		}
+		cl::Program::Sources sources = { *programSource };
+		program = cl::Program(gpuContext, sources);
+		std::cout << "OpenCL program built from source" << std::endl;
+	}
 
-	std::string geometryShaderSource = readFile("shaders/shader.geom");
-	GLuint geometryShaderId = loadShader(GL_GEOMETRY_SHADER, geometryShaderSource.c_str());
-	if (geometryShaderId == 0)
+	ProgramBuild programBuild;
+	programBuild.startupTimer = &startupTimer;
+	programBuild.start = StartupTimer::Clock::now();
+	std::future<void> programBuilt = programBuild.built.get_future();
+
+	cl_device_id deviceId = device();
+	programBuild.device = deviceId;
+	std::cout << "OpenCL build profile: " << buildProfile->name << " - " << buildProfile->description << std::endl;
+	code = clBuildProgram(program(), 1, &deviceId, buildOptions.c_str(), onProgramBuilt, &programBuild);
+	CHECK_ERROR_CODE_LOG(clBuildProgram);
+	endPhase("OpenCL context and build submit");
+
+	// GL program, from the binary cache or compiled by the driver threads when parallel shader compile is available
+	std::optional<std::string> vertexShaderSourceResource = vertexShaderSourceFuture.get();
+	std::optional<std::string> geometryShaderSourceResource = geometryShaderSourceFuture.get();
+	std::optional<std::string> fragmentShaderSourceResource = fragmentShaderSourceFuture.get();
+	if (!vertexShaderSourceResource || !geometryShaderSourceResource || !fragmentShaderSourceResource)
 	{
-		DEBUG_BREAK();
+		programBuilt.wait();
 		return EXIT_FAILURE;
 	}
+	const std::string& vertexShaderSource = *vertexShaderSourceResource;
+	const std::string& geometryShaderSource = *geometryShaderSourceResource;
+	const std::string& fragmentShaderSource = *fragmentShaderSourceResource;
+
+	const bool useProgramBinaryCache = !options.shaderCacheDirectory.empty() && isProgramBinaryCacheSupported();
+	std::string programBinaryPath;
+	GLuint programId = 0;
+	if (useProgramBinaryCache)
+	{
+		programBinaryPath = getProgramBinaryCachePath(options.shaderCacheDirectory, { vertexShaderSource, geometryShaderSource, fragmentShaderSource });
+		programId = loadProgramBinary(programBinaryPath);
+		endPhase("GL program binary load");
+	}
+	const bool programFromCache = programId != 0;
 
-	std::string fragmentShaderSource = readFile("shaders/shader.frag");
-	GLuint fragmentShaderId = loadShader(GL_FRAGMENT_SHADER, fragmentShaderSource.c_str());
-	if (fragmentShaderId == 0)
+	GLuint vertexShaderId = 0;
+	GLuint geometryShaderId = 0;
+	GLuint fragmentShaderId = 0;
+	bool parallelShaderCompile = false;
+	if (!programFromCache)
 	{
-		DEBUG_BREAK();
+		parallelShaderCompile = enableParallelShaderCompile();
+		vertexShaderId = submitShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+		geometryShaderId = submitShader(GL_GEOMETRY_SHADER, geometryShaderSource.c_str());
+		fragmentShaderId = submitShader(GL_FRAGMENT_SHADER, fragmentShaderSource.c_str());
+		programId = submitProgram(vertexShaderId, geometryShaderId, fragmentShaderId, useProgramBinaryCache);
+		endPhase("GL shader submit");
+	}
+
+	// load particle texture
+	GLuint textureId = uploadImage(particleImageFuture.get());
+	if (textureId == 0)
+	{
+		programBuilt.wait();
 		return EXIT_FAILURE;
 	}
 
-	GLuint programId = compileProgram(vertexShaderId, geometryShaderId, fragmentShaderId);
-	if (programId == 0)
+	// size and colour over life, looked up from the particles' age in the vertex shader
+	GLuint sizeOverLifeTextureId = uploadLifeCurve(bakeLifeCurve(options.sizeOverLife, 1), 1);
+	GLuint colorOverLifeTextureId = uploadLifeCurve(bakeLifeCurve(options.colorOverLife, 4), 4);
+	if (sizeOverLifeTextureId == 0 || colorOverLifeTextureId == 0)
 	{
-		DEBUG_BREAK();
+		programBuilt.wait();
 		return EXIT_FAILURE;
 	}
+	endPhase("texture upload");
+
+	// wait for the GL program
+	if (!programFromCache)
+	{
+		if (parallelShaderCompile)
+		{
+			GLint completed = GL_FALSE;
+			while (!completed)
+			{
+				glGetProgramiv(programId, GL_COMPLETION_STATUS_ARB, &completed);
+				std::this_thread::yield();
+			}
+		}
+		if (!checkShader(vertexShaderId) || !checkShader(geometryShaderId) || !checkShader(fragmentShaderId) || !checkProgram(programId))
+		{
+			// the build callback must not outlive programBuild
+			programBuilt.wait();
+			DEBUG_BREAK();
+			return EXIT_FAILURE;
+		}
+		endPhase("GL program wait");
+
+		if (useProgramBinaryCache)
+		{
+			saveProgramBinary(programBinaryPath, programId);
+			endPhase("GL program binary save");
+		}
+	}
 
 	GLint particleTextureUniform = glGetUniformLocation(programId, "particleTexture");
 	if (particleTextureUniform == -1)
 		std::cerr << "warning: particleTextureUniform invalid" << std::endl;
 
+	GLint sizeOverLifeUniform = glGetUniformLocation(programId, "sizeOverLife");
+	if (sizeOverLifeUniform == -1)
+		std::cerr << "warning: sizeOverLifeUniform invalid" << std::endl;
+
+	GLint colorOverLifeUniform = glGetUniformLocation(programId, "colorOverLife");
+	if (colorOverLifeUniform == -1)
+		std::cerr << "warning: colorOverLifeUniform invalid" << std::endl;
+
 	GLint projectionMatrixUniform = glGetUniformLocation(programId, "projectionMatrix");
 	if (projectionMatrixUniform == -1)
 		std::cerr << "warning: projectionMatrixUniform invalid" << std::endl;
@@ -162,13 +596,29 @@ int main(int argc, char* argv[])
 	if (modelViewMatrixUniform == -1)
 		std::cerr << "warning: modelViewMatrixUniform invalid" << std::endl;
 
+	GLint positionScaleUniform = glGetUniformLocation(programId, "positionScale");
+	if (positionScaleUniform == -1)
+		std::cerr << "warning: positionScaleUniform invalid" << std::endl;
+
+	GLint positionOffsetUniform = glGetUniformLocation(programId, "positionOffset");
+	if (positionOffsetUniform == -1)
+		std::cerr << "warning: positionOffsetUniform invalid" << std::endl;
+
+	GLint ageScaleUniform = glGetUniformLocation(programId, "ageScale");
+	if (ageScaleUniform == -1)
+		std::cerr << "warning: ageScaleUniform invalid" << std::endl;
+
+	GLint ageOffsetUniform = glGetUniformLocation(programId, "ageOffset");
+	if (ageOffsetUniform == -1)
+		std::cerr << "warning: ageOffsetUniform invalid" << std::endl;
+
 	GLint positionAttribute = glGetAttribLocation(programId, "position");
 	if (positionAttribute == -1)
 		std::cerr << "warning: positionAttribute invalid" << std::endl;
 
-	GLint isAliveAttribute = glGetAttribLocation(programId, "isAlive");
-	if (isAliveAttribute == -1)
-		std::cerr << "warning: isAliveAttribute invalid" << std::endl;
+	GLint ageAttribute = glGetAttribLocation(programId, "age");
+	if (ageAttribute == -1)
+		std::cerr << "warning: ageAttribute invalid" << std::endl;
 
 	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
@@ -221,131 +671,160 @@ int main(int argc, char* argv[])
 	};
 	updateCamera();
 
-	// load particle texture
-	GLuint textureId = loadImage("data/particle.png");
-
-	// init OpenCL
-	cl_int code;
+	// wait for the OpenCL program
+	programBuilt.wait();
+	code = programBuild.status == CL_BUILD_SUCCESS ? CL_SUCCESS : CL_BUILD_PROGRAM_FAILURE;
+	CHECK_ERROR_CODE_LOG(clBuildProgram);
+	endPhase("OpenCL program wait");
 
-	// platform
-	std::vector<cl::Platform> platforms;
-	cl::Platform::get(&platforms);
-	if (platforms.empty())
-	{
-		std::cerr << "Could not get OpenCL platforms" << std::endl;
-		return EXIT_FAILURE;
-	}
-
-	cl::Platform platform = platforms.front();
-
-	// device
-	std::vector<cl::Device> devices;
-	platform.getDevices(CL_DEVICE_TYPE_GPU, &devices);
-	if (devices.empty())
-	{
-		std::cerr << "Could not find GPU device" << std::endl;
-		return EXIT_FAILURE;
-	}
-
-	cl::Device device = devices.front();
-	std::cout << "Device name   : " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
-	std::cout << "Device vendor : " << device.getInfo<CL_DEVICE_VENDOR>() << std::endl;
-	std::cout << "Device version: " << device.getInfo<CL_DRIVER_VERSION>() << std::endl;
-
-	// check if sharing is supported on the device
-	const std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
-	const bool sharingSupported = extensions.find(GL_SHARING_EXTENSION) != std::string::npos;
-
-	if (!sharingSupported)
-	{
-		std::cerr << "Sharing not supported" << std::endl;
-		return EXIT_FAILURE;
-	}
-
-	// context
-	cl_context_properties contextProperties[] = {
-		CL_GL_CONTEXT_KHR,				reinterpret_cast<cl_context_properties>(glContext),
-		DEVICE_CONTEXT_PROPERTY_NAME,	reinterpret_cast<cl_context_properties>(getCurrentDeviceContext()),
-		CL_CONTEXT_PLATFORM,			(cl_context_properties)(platform)(),
-		0
-	};
-	cl::Context gpuContext(device, contextProperties);
-
-	// command queue
-	cl::CommandQueue commandQueue(gpuContext, device);
-
-	// program
-	cl::string programSource = readFile("cl/particle.cl");
-	cl::Program::Sources sources = { programSource };
-	cl::Program program(gpuContext, sources);
-
-	code = program.build();
-	CHECK_ERROR_CODE_LOG(build);
-
-	// VBO
-	const size_t NUM_PARTICLES = 1000000;
+	const size_t NUM_PARTICLES = options.numParticles;
 	cl::NDRange globalWorkSize(NUM_PARTICLES);
 
-	// create particle state buffer object
-	GLuint particleStateVbo;
-	glGenBuffers(1, &particleStateVbo);
-	glBindBuffer(GL_ARRAY_BUFFER, particleStateVbo);
-
-	unsigned int particleStateStructSize = 64;
-	unsigned int particleStateSize = NUM_PARTICLES * particleStateStructSize;
-	glBufferData(GL_ARRAY_BUFFER, particleStateSize, 0, GL_DYNAMIC_DRAW);
-
-	cl::BufferGL particleStateVboCl(gpuContext, CL_MEM_WRITE_ONLY, particleStateVbo);
+	// particle state, owned by OpenCL, the simulation packs what the renderer needs into shared GL buffers
+	cl::Buffer particleStateBuffer(gpuContext, CL_MEM_READ_WRITE, NUM_PARTICLES * sizeof(ParticleState), nullptr, &code);
+	CHECK_ERROR_CODE(cl::Buffer);
 
 	const float particleSpawnRate = 200000.f;
 
-	glFinish();
+	// spawn positions from a point cloud
+	cl::Buffer spawnPointsBuffer;
+	cl_uint numSpawnPoints = 0;
+	if (!options.pointsPath.empty())
+	{
+		if (!loadPointCloud(options.pointsPath, gpuContext, commandQueue, device, spawnPointsBuffer, numSpawnPoints))
+		{
+			return EXIT_FAILURE;
+		}
+	}
 
 	// init particle state
 	cl::Kernel initParticleStateKernel(program, "initParticleState", &code);
 	CHECK_ERROR_CODE_LOG(cl::Kernel);
 
-	code = initParticleStateKernel.setArg(0, particleStateVboCl);
+	code = initParticleStateKernel.setArg(0, particleStateBuffer);
 	CHECK_ERROR_CODE_LOG(setArg);
 
-	const std::vector<cl::Memory> glObjects = { particleStateVboCl };
-	code = commandQueue.enqueueAcquireGLObjects(&glObjects);
-	CHECK_ERROR_CODE_LOG(enqueueAcquireGLObjects);
-
-	code = commandQueue.enqueueNDRangeKernel(initParticleStateKernel, cl::NullRange, globalWorkSize);
-	CHECK_ERROR_CODE_LOG(enqueueNDRangeKernel);
+	// simulation clock, restored from snapshots
+	double simulationTime = 0.0;
 
-	code = commandQueue.enqueueReleaseGLObjects(&glObjects);
-	CHECK_ERROR_CODE_LOG(enqueueReleaseGLObjects);
+	if (!options.loadSnapshotPath.empty())
+	{
+		if (!loadSnapshot(options.loadSnapshotPath, commandQueue, particleStateBuffer, NUM_PARTICLES, simulationTime, rng))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else if (options.seedFromPoints && numSpawnPoints > 0)
+	{
+		cl::Kernel initParticleStateFromPointsKernel(program, "initParticleStateFromPoints", &code);
+		CHECK_ERROR_CODE_LOG(cl::Kernel);
+
+		code = initParticleStateFromPointsKernel.setArg(0, particleStateBuffer);
+		CHECK_ERROR_CODE_LOG(setArg);
+		code = initParticleStateFromPointsKernel.setArg(1, spawnPointsBuffer);
+		CHECK_ERROR_CODE_LOG(setArg);
+		code = initParticleStateFromPointsKernel.setArg(2, numSpawnPoints);
+		CHECK_ERROR_CODE_LOG(setArg);
+		code = initParticleStateFromPointsKernel.setArg(3, static_cast<cl_float>(simulationTime));
+		CHECK_ERROR_CODE_LOG(setArg);
+		const cl_float2 lifetimeRange = { { options.lifetime[0], options.lifetime[1] } };
+		code = initParticleStateFromPointsKernel.setArg(4, lifetimeRange);
+		CHECK_ERROR_CODE_LOG(setArg);
+
+		code = commandQueue.enqueueNDRangeKernel(initParticleStateFromPointsKernel, cl::NullRange, globalWorkSize);
+		CHECK_ERROR_CODE_LOG(enqueueNDRangeKernel);
+	}
+	else
+	{
+		code = commandQueue.enqueueNDRangeKernel(initParticleStateKernel, cl::NullRange, globalWorkSize);
+		CHECK_ERROR_CODE_LOG(enqueueNDRangeKernel);
+	}
 
 	code = commandQueue.finish();
 	CHECK_ERROR_CODE_LOG(finish);
 
-	// spawn kernel
-	cl::Kernel spawnParticleKernel(program, "spawnParticle", &code);
-	CHECK_ERROR_CODE_LOG(cl::Kernel);
+	// host side tasks, they overlap with the CL work the simulation thread keeps enqueuing
+	JobSystem jobSystem;
 
-	size_t spawnParticleKernelWorkGroupSize = spawnParticleKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device, &code);
-	CHECK_ERROR_CODE_LOG(getWorkGroupInfo);
+	// particle cache recording
+	CacheRecorder cacheRecorder;
+	if (!options.recordPath.empty())
+	{
+		if (!cacheRecorder.open(options.recordPath, gpuContext, commandQueue, NUM_PARTICLES, options.recordInterval, options.recordSlots, &jobSystem))
+		{
+			return EXIT_FAILURE;
+		}
+	}
 
-	code = spawnParticleKernel.setArg(0, particleStateVboCl);
-	CHECK_ERROR_CODE(setArg);
-	code = spawnParticleKernel.setArg(1, spawnParticleKernelWorkGroupSize * sizeof(cl_uchar), nullptr);
-	CHECK_ERROR_CODE(setArg);
+	// particle cache playback replaces the simulation
+	CachePlayer cachePlayer;
+	size_t playbackFrame = 0;
+	bool playbackPaused = false;
+	if (!options.playPath.empty())
+	{
+		if (!cachePlayer.open(options.playPath, options.prefetchFrames))
+		{
+			return EXIT_FAILURE;
+		}
+		playbackFrame = std::min<size_t>(options.playStartFrame, cachePlayer.getNumFrames() - 1);
+	}
 
-	// set update particle state kernel constant arguments
-	cl::Kernel updateParticleStateKernel(program, "updateParticleState", &code);
-	CHECK_ERROR_CODE_LOG(cl::Kernel);
+	// simulation thread with its own queue, the recorder belongs to it from now on
+	// benchmarks step it from the render loop instead, one profiled step per frame
+	MeshBvh meshBvh;
+	Simulation simulation;
+	if (!cachePlayer.isOpen())
+	{
+		if (useMeshCollision)
+		{
+			// static meshes, the hierarchy is built once
+			std::optional<std::vector<cl_float4>> collisionTriangles = collisionMeshFuture.get();
+			if (!collisionTriangles || !meshBvh.create(gpuContext, device, program, *collisionTriangles) || !meshBvh.build(commandQueue))
+			{
+				return EXIT_FAILURE;
+			}
+			code = commandQueue.finish();
+			CHECK_ERROR_CODE(finish);
+			std::cout << "Collision mesh: " << meshBvh.getNumTriangles() << " triangles" << std::endl;
+			endPhase("collision mesh BVH");
+			simulation.setMeshCollision(&meshBvh, options.restitution, options.friction);
+		}
 
-	code = updateParticleStateKernel.setArg(0, particleStateVboCl);
-	CHECK_ERROR_CODE(setArg);
+		simulation.setLifetimeRange(options.lifetime[0], options.lifetime[1]);
+		if (curlNoise)
+		{
+			// the spawn cylinder spans a bit more than one volume repetition
+			const std::vector<cl_float4> curlNoiseTexels = curlNoiseFuture.get();
+			cl::Image3D curlNoiseVolume(gpuContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cl::ImageFormat(CL_RGBA, CL_FLOAT),
+				CURL_NOISE_SIZE, CURL_NOISE_SIZE, CURL_NOISE_SIZE, 0, 0, const_cast<cl_float4*>(curlNoiseTexels.data()), &code);
+			CHECK_ERROR_CODE(cl::Image3D);
+			simulation.setCurlNoise(curlNoiseVolume, CURL_NOISE_SCALE, CURL_NOISE_SCROLL_SPEED, options.curlNoiseStrength);
+		}
+		if (useVectorFields)
+		{
+			simulation.setVectorFields(&vectorFields);
+		}
+		if (useForceVolumes)
+		{
+			simulation.setForceVolumes(&forceVolumes);
+		}
+		if (useColliders)
+		{
+			simulation.setColliders(&colliders);
+		}
+		if (useHeightfield)
+		{
+			simulation.setHeightfield(&heightfield);
+		}
 
-	// check particle death conditions
-	cl::Kernel checkParticleDeathKernel(program, "checkParticleDeath", &code);
-	CHECK_ERROR_CODE_LOG(cl::Kernel);
+		if (!simulation.start(gpuContext, device, program, glSharing, particleStateBuffer, NUM_PARTICLES, particleSpawnRate,
+			spawnPointsBuffer, numSpawnPoints, simulationTime, rng, &cacheRecorder, options.snapshotPath, !benchmark, benchmark))
+		{
+			return EXIT_FAILURE;
+		}
+	}
 
-	code = checkParticleDeathKernel.setArg(0, particleStateVboCl);
-	CHECK_ERROR_CODE(setArg);
+	endPhase("buffers and kernels");
 
 	Uint32 t1 = SDL_GetTicks();
 
@@ -355,11 +834,19 @@ int main(int argc, char* argv[])
 	SDL_Event event;
 	Uint32 deltaTime = 0;
 	bool loop = true;
+	bool firstFrameDone = false;
+	uint64_t lastNumSimulationSteps = 0;
+	unsigned int numFrames = 0;
+	Uint32 lastReportTicks = t1;
+	// without a swap chain to throttle the offscreen frames, at most one frame is kept in flight
+	GLsync previousFrameFence = nullptr;
+	FrameStats frameStats;
 	while (loop)
 	{
 		//std::cout << "Frame start ===================================================" << std::endl;
-		const cl_float currentTimeSeconds = static_cast<cl_float>(t1) * 0.001f;
-		const cl_float deltaTimeSeconds = static_cast<cl_float>(deltaTime) * 0.001f;
+		const StartupTimer::Clock::time_point frameStart = StartupTimer::Clock::now();
+		const cl_float deltaTimeSeconds = benchmark ? BENCHMARK_DELTA_TIME : static_cast<cl_float>(deltaTime) * 0.001f;
+		const bool measureFrame = benchmark && numFrames >= BENCHMARK_WARMUP_FRAMES;
 
 		while (SDL_PollEvent(&event))
 		{
@@ -375,6 +862,35 @@ int main(int argc, char* argv[])
 				case SDLK_ESCAPE:
 					loop = false;
 					break;
+
+				case SDLK_F5:
+					simulation.requestSaveSnapshot();
+					break;
+
+				case SDLK_F9:
+					simulation.requestLoadSnapshot();
+					break;
+
+				case SDLK_SPACE:
+					playbackPaused = !playbackPaused;
+					break;
+
+				case SDLK_HOME:
+					playbackFrame = 0;
+					break;
+
+				case SDLK_PAGEUP:
+				case SDLK_PAGEDOWN:
+					if (cachePlayer.isOpen())
+					{
+						// random access seek, 10 recorded frames at a time
+						const size_t numFrames = cachePlayer.getNumFrames();
+						const size_t seekDistance = std::min<size_t>(10, numFrames);
+						playbackFrame = event.key.keysym.sym == SDLK_PAGEUP
+							? (playbackFrame + seekDistance) % numFrames
+							: (playbackFrame + numFrames - seekDistance) % numFrames;
+					}
+					break;
 				}
 				break;
 
@@ -422,64 +938,100 @@ int main(int argc, char* argv[])
 			cameraElevation -= cameraRotationSpeed * deltaTimeSeconds;
 		}
 
-		updateCamera();
-
-		// map OpenGL buffer object for writing from OpenCL
-		glFinish();
-
-		code = commandQueue.enqueueAcquireGLObjects(&glObjects);
-		CHECK_ERROR_CODE(enqueueAcquireGLObjects);
-
-		// prepare particles to spawn
-		const cl_int numParticlesToSpawn = static_cast<cl_int>(std::ceil(particleSpawnRate * deltaTimeSeconds));
-
-		if (numParticlesToSpawn > 0)
+		if (benchmark)
 		{
-			// spawn new particles
-			cl_int globalSeed = rand();
+			// scripted camera path, a slow sway around the spawn point
+			const float pathTime = static_cast<float>(numFrames) * BENCHMARK_DELTA_TIME;
+			cameraPosition.s[0] = 8.f * std::sin(pathTime * 0.5f);
+			cameraPosition.s[1] = 20.f + 4.f * std::sin(pathTime * 0.3f);
+			cameraPosition.s[2] = -23.f + 6.f * std::cos(pathTime * 0.5f);
+			cameraElevation = -glm::pi<float>() * 0.25f + 0.1f * std::sin(pathTime * 0.7f);
+		}
 
-			code = spawnParticleKernel.setArg(2, numParticlesToSpawn);
-			CHECK_ERROR_CODE(setArg);
+		updateCamera();
 
-			code = spawnParticleKernel.setArg(3, globalSeed);
-			CHECK_ERROR_CODE(setArg);
+		// vertex layout of the particles to draw
+		GLuint renderBuffer = 0;
+		GLintptr renderOffset = 0;
+		GLsizei renderStride = sizeof(cl_float4);
+		GLenum positionType = GL_FLOAT;
+		GLboolean positionNormalized = GL_FALSE;
+		GLenum ageType = GL_FLOAT;
+		GLboolean ageNormalized = GL_FALSE;
+		GLintptr ageAttributeOffset = 3 * sizeof(cl_float);
+		GLsizei numParticlesToDraw = NUM_PARTICLES;
+		glm::vec3 positionScale(1.f);
+		glm::vec3 positionOffset(0.f);
+		// the packed ages are already normalized, -1 when dead
+		float ageScale = 1.f;
+		float ageOffset = 0.f;
+
+		if (cachePlayer.isOpen())
+		{
+			if (!cachePlayer.uploadFrame(playbackFrame))
+			{
+				DEBUG_BREAK();
+				return EXIT_FAILURE;
+			}
 
-			code = spawnParticleKernel.setArg(4, currentTimeSeconds);
-			CHECK_ERROR_CODE(setArg);
+			if (!playbackPaused)
+			{
+				playbackFrame = (playbackFrame + 1) % cachePlayer.getNumFrames();
+			}
 
-			code = commandQueue.enqueueNDRangeKernel(spawnParticleKernel, cl::NullRange, globalWorkSize);
-			CHECK_ERROR_CODE(enqueueNDRangeKernel);
+			const ParticleCacheFrameHeader& frameHeader = cachePlayer.getCurrentFrameHeader();
+			renderBuffer = cachePlayer.getBuffer();
+			renderOffset = cachePlayer.getCurrentSlotOffset();
+			renderStride = sizeof(CachedParticle);
+			positionType = GL_UNSIGNED_SHORT;
+			positionNormalized = GL_TRUE;
+			ageType = GL_UNSIGNED_BYTE;
+			ageNormalized = GL_TRUE;
+			ageAttributeOffset = offsetof(CachedParticle, age);
+			// cached ages go from 1 to 255, 0 when dead
+			ageScale = 255.f / 254.f;
+			ageOffset = -1.f / 254.f;
+			numParticlesToDraw = cachePlayer.getNumParticles();
+			positionOffset = glm::make_vec3(frameHeader.boundsMin);
+			positionScale = glm::make_vec3(frameHeader.boundsMax) - positionOffset;
 		}
-
+		else
 		{
-			// update the particles
-			cl_int globalSeed = rand();
-
-			code = updateParticleStateKernel.setArg(1, globalSeed);
-			CHECK_ERROR_CODE(setArg);
-
-			code = updateParticleStateKernel.setArg(2, deltaTimeSeconds);
-			CHECK_ERROR_CODE(setArg);
-
-			code = commandQueue.enqueueNDRangeKernel(updateParticleStateKernel, cl::NullRange, globalWorkSize);
-			CHECK_ERROR_CODE(enqueueNDRangeKernel);
+			if (simulation.hasFailed())
+			{
+				DEBUG_BREAK();
+				return EXIT_FAILURE;
+			}
 
-			// check the particles' death conditions
-			code = checkParticleDeathKernel.setArg(1, currentTimeSeconds);
-			CHECK_ERROR_CODE(setArg);
+			if (benchmark)
+			{
+				const StartupTimer::Clock::time_point simulateStart = StartupTimer::Clock::now();
+				if (!simulation.stepNow(deltaTimeSeconds))
+				{
+					DEBUG_BREAK();
+					return EXIT_FAILURE;
+				}
+				if (measureFrame)
+				{
+					const Simulation::StepTimings& stepTimings = simulation.getLastStepTimings();
+					frameStats.add("simulate", std::chrono::duration<double, std::milli>(StartupTimer::Clock::now() - simulateStart).count());
+					frameStats.add("clSpawn", stepTimings.spawn);
+					frameStats.add("clUpdate", stepTimings.update);
+					if (useMeshCollision)
+					{
+						frameStats.add("clCollide", stepTimings.collide);
+					}
+					frameStats.add("clDeath", stepTimings.death);
+					frameStats.add("clPack", stepTimings.pack);
+				}
+			}
 
-			code = commandQueue.enqueueNDRangeKernel(checkParticleDeathKernel, cl::NullRange, globalWorkSize);
-			CHECK_ERROR_CODE(enqueueNDRangeKernel);
+			// latest step published by the simulation thread, never waits for it
+			renderBuffer = simulation.acquireRenderBuffer();
 		}
 
-		// unmap buffer objectS
-		code = commandQueue.enqueueReleaseGLObjects(&glObjects);
-		CHECK_ERROR_CODE(enqueueReleaseGLObjects);
-
-		code = commandQueue.finish();
-		CHECK_ERROR_CODE(finish);
-
 		// opengl render
+		const StartupTimer::Clock::time_point renderStart = StartupTimer::Clock::now();
 		glClear(GL_COLOR_BUFFER_BIT);
 
 		glUseProgram(programId);
@@ -488,65 +1040,217 @@ int main(int argc, char* argv[])
 		glBindTexture(GL_TEXTURE_2D, textureId);
 		glUniform1i(particleTextureUniform, 0);
 
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_1D, sizeOverLifeTextureId);
+		glUniform1i(sizeOverLifeUniform, 1);
+
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_1D, colorOverLifeTextureId);
+		glUniform1i(colorOverLifeUniform, 2);
+		glActiveTexture(GL_TEXTURE0);
+
 		glUniformMatrix4fv(projectionMatrixUniform, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
 		glUniformMatrix4fv(modelViewMatrixUniform, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
+		glUniform3fv(positionScaleUniform, 1, glm::value_ptr(positionScale));
+		glUniform3fv(positionOffsetUniform, 1, glm::value_ptr(positionOffset));
+		glUniform1f(ageScaleUniform, ageScale);
+		glUniform1f(ageOffsetUniform, ageOffset);
 
 		glEnableClientState(GL_VERTEX_ARRAY);
 
 		glEnableVertexAttribArray(positionAttribute);
-		glEnableVertexAttribArray(isAliveAttribute);
+		glEnableVertexAttribArray(ageAttribute);
 
-		glBindBuffer(GL_ARRAY_BUFFER, particleStateVbo);
-		glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, particleStateStructSize, 0);
-		glVertexAttribPointer(isAliveAttribute, 1, GL_UNSIGNED_BYTE, GL_FALSE, particleStateStructSize, (void*)16);
+		glBindBuffer(GL_ARRAY_BUFFER, renderBuffer);
+		glVertexAttribPointer(positionAttribute, 3, positionType, positionNormalized, renderStride, (void*)renderOffset);
+		glVertexAttribPointer(ageAttribute, 1, ageType, ageNormalized, renderStride, (void*)(renderOffset + ageAttributeOffset));
 
-		glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+		glDrawArrays(GL_POINTS, 0, numParticlesToDraw);
 
 		glDisableVertexAttribArray(positionAttribute);
-		glDisableVertexAttribArray(isAliveAttribute);
+		glDisableVertexAttribArray(ageAttribute);
 
 		glDisableClientState(GL_VERTEX_ARRAY);
 
 		glUseProgram(0);
 
-		SDL_GL_SwapWindow(window);
+		if (cachePlayer.isOpen())
+		{
+			cachePlayer.fenceCurrentSlot();
+		}
+		else
+		{
+			simulation.fenceRenderBuffer();
+		}
+
+		if (benchmark)
+		{
+			// geometry shader expansion and blending, the whole frame is attributed to the render stage
+			glFinish();
+			if (measureFrame)
+			{
+				const StartupTimer::Clock::time_point renderEnd = StartupTimer::Clock::now();
+				frameStats.add("render", std::chrono::duration<double, std::milli>(renderEnd - renderStart).count());
+				frameStats.add("frame", std::chrono::duration<double, std::milli>(renderEnd - frameStart).count());
+			}
+		}
+		else if (offscreen)
+		{
+			if (previousFrameFence != nullptr)
+			{
+				while (glClientWaitSync(previousFrameFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+				{
+				}
+				glDeleteSync(previousFrameFence);
+			}
+			previousFrameFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		else
+		{
+			SDL_GL_SwapWindow(window);
+		}
+
+		if (!firstFrameDone)
+		{
+			endPhase("first frame");
+			startupTimer.print();
+			firstFrameDone = true;
+		}
 
 		Uint32 t2 = SDL_GetTicks();
 		deltaTime = t2 - t1;
 		t1 = t2;
-		sprintf_s(windowTitle, "%.1f fps", 1000.f / static_cast<float>(deltaTime));
-		SDL_SetWindowTitle(window, windowTitle);
+		if (cachePlayer.isOpen())
+		{
+			std::snprintf(windowTitle, sizeof(windowTitle), "%.1f fps - frame %u/%u%s", 1000.f / static_cast<float>(deltaTime),
+				static_cast<unsigned int>(playbackFrame), static_cast<unsigned int>(cachePlayer.getNumFrames()),
+				playbackPaused ? " (paused)" : "");
+		}
+		else
+		{
+			const uint64_t numSimulationSteps = simulation.getNumSteps();
+			const float simulationStepsPerSecond = static_cast<float>(numSimulationSteps - lastNumSimulationSteps) * 1000.f / static_cast<float>(deltaTime);
+			lastNumSimulationSteps = numSimulationSteps;
+			if (cacheRecorder.isOpen())
+			{
+				std::snprintf(windowTitle, sizeof(windowTitle), "%.1f fps, %.1f steps/s - recorded %llu, dropped %llu", 1000.f / static_cast<float>(deltaTime),
+					simulationStepsPerSecond,
+					static_cast<unsigned long long>(cacheRecorder.getNumRecordedFrames()),
+					static_cast<unsigned long long>(cacheRecorder.getNumDroppedFrames()));
+			}
+			else
+			{
+				std::snprintf(windowTitle, sizeof(windowTitle), "%.1f fps, %.1f steps/s", 1000.f / static_cast<float>(deltaTime), simulationStepsPerSecond);
+			}
+		}
+		if (offscreen)
+		{
+			// no title bar, report about once per second
+			if (t2 - lastReportTicks >= 1000)
+			{
+				std::cout << windowTitle << std::endl;
+				lastReportTicks = t2;
+			}
+		}
+		else
+		{
+			SDL_SetWindowTitle(window, windowTitle);
+		}
+
+		++numFrames;
+		if (options.maxFrames > 0 && numFrames >= options.maxFrames)
+		{
+			loop = false;
+		}
+	}
+
+	if (previousFrameFence != nullptr)
+	{
+		glDeleteSync(previousFrameFence);
+	}
+
+	if (benchmark)
+	{
+		frameStats.setInfo("particles", static_cast<double>(NUM_PARTICLES));
+		frameStats.setInfo("frames", static_cast<double>(numFrames > BENCHMARK_WARMUP_FRAMES ? numFrames - BENCHMARK_WARMUP_FRAMES : 0));
+		frameStats.setInfo("warmupFrames", static_cast<double>(BENCHMARK_WARMUP_FRAMES));
+		frameStats.setInfo("width", static_cast<double>(windowWidth));
+		frameStats.setInfo("height", static_cast<double>(windowHeight));
+		frameStats.setInfo("seed", static_cast<double>(options.seed));
+		frameStats.setInfo("glSharing", glSharing ? 1.0 : 0.0);
+		frameStats.setInfo("glRenderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+		frameStats.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+		frameStats.print();
+		if (!frameStats.writeJson(options.benchmarkPath))
+		{
+			return EXIT_FAILURE;
+		}
 	}
 
+	simulation.stop();
+	cacheRecorder.close();
+	cachePlayer.close();
+
 	// release opengl stuff
 	glDeleteTextures(1, &textureId);
-	glDeleteBuffers(1, &particleStateVbo);
+	glDeleteTextures(1, &sizeOverLifeTextureId);
+	glDeleteTextures(1, &colorOverLifeTextureId);
 	glDeleteShader(vertexShaderId);
 	glDeleteShader(geometryShaderId);
 	glDeleteShader(fragmentShaderId);
 	glDeleteProgram(programId);
 
 	// release sdl stuff
-	SDL_GL_DeleteContext(glContext);
-	SDL_DestroyWindow(window);
+	if (offscreen)
+	{
+		offscreenContext.destroy();
+	}
+	else
+	{
+		SDL_GL_DeleteContext(glContext);
+		SDL_DestroyWindow(window);
+	}
 	SDL_Quit();
 
 	return EXIT_SUCCESS;
 }
 
 // shaders
-GLuint compileProgram(GLuint vertexShaderId, GLuint geometryShaderId, GLuint fragmentShaderId)
+bool enableParallelShaderCompile()
+{
+	// GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile share their enums
+	if (SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile"))
+	{
+		typedef void (GLAPIENTRY * PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+		PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+			reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR"));
+		if (maxShaderCompilerThreads != nullptr)
+		{
+			maxShaderCompilerThreads(0xFFFFFFFF);
+			return true;
+		}
+	}
+
+	if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		return true;
+	}
+
+	return false;
+}
+
+GLuint submitProgram(GLuint vertexShaderId, GLuint geometryShaderId, GLuint fragmentShaderId, bool retrievableBinary)
 {
 	GLuint programId = glCreateProgram();
+	if (retrievableBinary)
+	{
+		glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glAttachShader(programId, vertexShaderId);
 	glAttachShader(programId, geometryShaderId);
 	glAttachShader(programId, fragmentShaderId);
 	glLinkProgram(programId);
-	if (!checkProgram(programId))
-	{
-		glDeleteProgram(programId);
-		return 0;
-	}
 	return programId;
 }
 
@@ -568,16 +1272,11 @@ bool checkProgram(GLuint programId)
 	return true;
 }
 
-GLuint loadShader(GLenum shaderType, const GLchar* source)
+GLuint submitShader(GLenum shaderType, const GLchar* source)
 {
 	GLuint shaderId = glCreateShader(shaderType);
 	glShaderSource(shaderId, 1, &source, NULL);
 	glCompileShader(shaderId);
-	if (!checkShader(shaderId))
-	{
-		glDeleteShader(shaderId);
-		return 0;
-	}
 	return shaderId;
 }
 
@@ -599,105 +1298,123 @@ bool checkShader(GLuint shaderId)
 	return true;
 }
 
-// from https://stackoverflow.com/questions/24326432/convenient-way-to-show-opencl-error-codes
-const char* getErrorString(cl_int error)
+std::pair<cl::Platform, cl::Device> findOpenCLDevice()
 {
-	switch (error) {
-		// run-time and JIT compiler errors
-	case 0: return "CL_SUCCESS";
-	case -1: return "CL_DEVICE_NOT_FOUND";
-	case -2: return "CL_DEVICE_NOT_AVAILABLE";
-	case -3: return "CL_COMPILER_NOT_AVAILABLE";
-	case -4: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
-	case -5: return "CL_OUT_OF_RESOURCES";
-	case -6: return "CL_OUT_OF_HOST_MEMORY";
-	case -7: return "CL_PROFILING_INFO_NOT_AVAILABLE";
-	case -8: return "CL_MEM_COPY_OVERLAP";
-	case -9: return "CL_IMAGE_FORMAT_MISMATCH";
-	case -10: return "CL_IMAGE_FORMAT_NOT_SUPPORTED";
-	case -11: return "CL_BUILD_PROGRAM_FAILURE";
-	case -12: return "CL_MAP_FAILURE";
-	case -13: return "CL_MISALIGNED_SUB_BUFFER_OFFSET";
-	case -14: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
-	case -15: return "CL_COMPILE_PROGRAM_FAILURE";
-	case -16: return "CL_LINKER_NOT_AVAILABLE";
-	case -17: return "CL_LINK_PROGRAM_FAILURE";
-	case -18: return "CL_DEVICE_PARTITION_FAILED";
-	case -19: return "CL_KERNEL_ARG_INFO_NOT_AVAILABLE";
-
-		// compile-time errors
-	case -30: return "CL_INVALID_VALUE";
-	case -31: return "CL_INVALID_DEVICE_TYPE";
-	case -32: return "CL_INVALID_PLATFORM";
-	case -33: return "CL_INVALID_DEVICE";
-	case -34: return "CL_INVALID_CONTEXT";
-	case -35: return "CL_INVALID_QUEUE_PROPERTIES";
-	case -36: return "CL_INVALID_COMMAND_QUEUE";
-	case -37: return "CL_INVALID_HOST_PTR";
-	case -38: return "CL_INVALID_MEM_OBJECT";
-	case -39: return "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR";
-	case -40: return "CL_INVALID_IMAGE_SIZE";
-	case -41: return "CL_INVALID_SAMPLER";
-	case -42: return "CL_INVALID_BINARY";
-	case -43: return "CL_INVALID_BUILD_OPTIONS";
-	case -44: return "CL_INVALID_PROGRAM";
-	case -45: return "CL_INVALID_PROGRAM_EXECUTABLE";
-	case -46: return "CL_INVALID_KERNEL_NAME";
-	case -47: return "CL_INVALID_KERNEL_DEFINITION";
-	case -48: return "CL_INVALID_KERNEL";
-	case -49: return "CL_INVALID_ARG_INDEX";
-	case -50: return "CL_INVALID_ARG_VALUE";
-	case -51: return "CL_INVALID_ARG_SIZE";
-	case -52: return "CL_INVALID_KERNEL_ARGS";
-	case -53: return "CL_INVALID_WORK_DIMENSION";
-	case -54: return "CL_INVALID_WORK_GROUP_SIZE";
-	case -55: return "CL_INVALID_WORK_ITEM_SIZE";
-	case -56: return "CL_INVALID_GLOBAL_OFFSET";
-	case -57: return "CL_INVALID_EVENT_WAIT_LIST";
-	case -58: return "CL_INVALID_EVENT";
-	case -59: return "CL_INVALID_OPERATION";
-	case -60: return "CL_INVALID_GL_OBJECT";
-	case -61: return "CL_INVALID_BUFFER_SIZE";
-	case -62: return "CL_INVALID_MIP_LEVEL";
-	case -63: return "CL_INVALID_GLOBAL_WORK_SIZE";
-	case -64: return "CL_INVALID_PROPERTY";
-	case -65: return "CL_INVALID_IMAGE_DESCRIPTOR";
-	case -66: return "CL_INVALID_COMPILER_OPTIONS";
-	case -67: return "CL_INVALID_LINKER_OPTIONS";
-	case -68: return "CL_INVALID_DEVICE_PARTITION_COUNT";
-
-		// extension errors
-	case -1000: return "CL_INVALID_GL_SHAREGROUP_REFERENCE_KHR";
-	case -1001: return "CL_PLATFORM_NOT_FOUND_KHR";
-	case -1002: return "CL_INVALID_D3D10_DEVICE_KHR";
-	case -1003: return "CL_INVALID_D3D10_RESOURCE_KHR";
-	case -1004: return "CL_D3D10_RESOURCE_ALREADY_ACQUIRED_KHR";
-	case -1005: return "CL_D3D10_RESOURCE_NOT_ACQUIRED_KHR";
-	default: return "Unknown OpenCL error";
+	// platform
+	std::vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+	if (platforms.empty())
+	{
+		std::cerr << "Could not get OpenCL platforms" << std::endl;
+		return {};
 	}
+
+	// first GPU device of any platform, any device otherwise since the particles can be copied to GL without sharing
+	const cl_device_type deviceTypes[] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ALL };
+	for (cl_device_type deviceType : deviceTypes)
+	{
+		for (const cl::Platform& platform : platforms)
+		{
+			std::vector<cl::Device> devices;
+			platform.getDevices(deviceType, &devices);
+			if (!devices.empty())
+			{
+				return { platform, devices.front() };
+			}
+		}
+	}
+
+	std::cerr << "Could not find an OpenCL device" << std::endl;
+	return {};
 }
 
-std::string readFile(const std::string& filePath)
+void CL_CALLBACK onProgramBuilt(cl_program program, void* userData)
 {
-	std::ifstream file(filePath.c_str(), std::ifstream::binary);
-	if (!file.is_open())
+	ProgramBuild* programBuild = static_cast<ProgramBuild*>(userData);
+	const cl_int code = clGetProgramBuildInfo(program, programBuild->device, CL_PROGRAM_BUILD_STATUS, sizeof(programBuild->status), &programBuild->status, nullptr);
+	if (code != CL_SUCCESS || programBuild->status != CL_BUILD_SUCCESS)
 	{
-		std::cerr << "Warning: unable to open file '" << filePath << "'" << std::endl;
-		return "";
+		programBuild->status = CL_BUILD_ERROR;
+		std::cerr << "OpenCL program build failed" << std::endl;
 	}
+	programBuild->startupTimer->record("OpenCL program build", programBuild->start, StartupTimer::Clock::now());
+	programBuild->built.set_value();
+}
 
-	std::stringstream buffer;
-	buffer << file.rdbuf();
-	return buffer.str();
+bool loadPointCloud(const std::string& filePath, const cl::Context& context, cl::CommandQueue& commandQueue, const cl::Device& device, cl::Buffer& pointsBuffer, cl_uint& numPoints)
+{
+	const Uint32 startTicks = SDL_GetTicks();
+
+	PointCloud pointCloud;
+	if (!pointCloud.open(filePath))
+	{
+		return false;
+	}
+
+	// keep every nth point if the whole cloud does not fit in a single allocation
+	const size_t pointSize = sizeof(cl_float4);
+	const size_t maxPoints = static_cast<size_t>(device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()) / pointSize;
+	const size_t step = (pointCloud.getNumPoints() + maxPoints - 1) / maxPoints;
+	const size_t numBufferPoints = (pointCloud.getNumPoints() + step - 1) / step;
+	if (step > 1)
+	{
+		std::cerr << "Warning: point cloud '" << filePath << "' is too large, keeping 1 point out of " << step << std::endl;
+	}
+
+	cl_int code;
+	pointsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, numBufferPoints * pointSize, nullptr, &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+	{
+		return false;
+	}
+
+	// parse straight into the mapped buffer
+	float* points = static_cast<float*>(commandQueue.enqueueMapBuffer(pointsBuffer, CL_TRUE, CL_MAP_WRITE, 0, numBufferPoints * pointSize, nullptr, nullptr, &code));
+	if (!checkErrorCode(code, "enqueueMapBuffer"))
+	{
+		return false;
+	}
+
+	const size_t numReadPoints = pointCloud.read(points, pointSize / sizeof(float), step, std::thread::hardware_concurrency());
+
+	code = commandQueue.enqueueUnmapMemObject(pointsBuffer, points);
+	if (!checkErrorCode(code, "enqueueUnmapMemObject"))
+	{
+		return false;
+	}
+
+	numPoints = static_cast<cl_uint>(numReadPoints);
+	std::cout << "Loaded " << numPoints << " points from '" << filePath << "' in " << SDL_GetTicks() - startTicks << " ms" << std::endl;
+	return true;
 }
 
 GLuint loadImage(const std::string& filePath)
 {
-	SDL_Surface* surface = IMG_Load(filePath.c_str());
+	return uploadImage(decodeImage(filePath));
+}
+
+SDL_Surface* decodeImage(const std::string& filePath)
+{
+	std::string encodedImage;
+	if (!loadResource(filePath, encodedImage))
+	{
+		return nullptr;
+	}
+
+	SDL_Surface* surface = IMG_Load_RW(SDL_RWFromConstMem(encodedImage.data(), static_cast<int>(encodedImage.size())), 1);
 
 	if (surface == nullptr)
 	{
-		std::cerr << "Could not load image '" << filePath << "'" << std::endl;
+		std::cerr << "Could not load image '" << filePath << "': " << IMG_GetError() << std::endl;
+	}
+
+	return surface;
+}
+
+GLuint uploadImage(SDL_Surface* surface)
+{
+	if (surface == nullptr)
+	{
 		return 0;
 	}
 
@@ -706,6 +1423,7 @@ GLuint loadImage(const std::string& filePath)
 	if (textureId == 0)
 	{
 		std::cerr << "glGenTextures failed" << std::endl;
+		SDL_FreeSurface(surface);
 		return 0;
 	}
 
@@ -721,3 +1439,32 @@ GLuint loadImage(const std::string& filePath)
 
 	return textureId;
 }
+
+GLuint uploadLifeCurve(const std::vector<float>& texels, size_t numChannels)
+{
+	GLuint textureId = 0;
+	glGenTextures(1, &textureId);
+	if (textureId == 0)
+	{
+		std::cerr << "glGenTextures failed" << std::endl;
+		return 0;
+	}
+
+	// clamped so that the ends of the curve are the spawn and death values
+	const GLsizei numTexels = static_cast<GLsizei>(texels.size() / numChannels);
+	glBindTexture(GL_TEXTURE_1D, textureId);
+	if (numChannels == 1)
+	{
+		glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, numTexels, 0, GL_RED, GL_FLOAT, texels.data());
+	}
+	else
+	{
+		glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA32F, numTexels, 0, GL_RGBA, GL_FLOAT, texels.data());
+	}
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D, 0);
+
+	return textureId;
+}
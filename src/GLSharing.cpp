@@ -0,0 +1,46 @@
+#include "GLSharing.h"
+
+#include <CL/cl_gl.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <EGL/egl.h>
+#include <GL/glx.h>
+#else
+#error Unsupported platform
+#endif
+
+std::vector<cl_context_properties> getGLSharingContextProperties(const cl::Platform& platform)
+{
+	std::vector<cl_context_properties> properties;
+
+#if defined(_WIN32)
+	properties.push_back(CL_GL_CONTEXT_KHR);
+	properties.push_back(reinterpret_cast<cl_context_properties>(wglGetCurrentContext()));
+	properties.push_back(CL_WGL_HDC_KHR);
+	properties.push_back(reinterpret_cast<cl_context_properties>(wglGetCurrentDC()));
+#elif defined(__linux__)
+	// offscreen contexts and SDL on Wayland go through EGL, SDL on X11 through GLX
+	EGLContext eglContext = eglGetCurrentContext();
+	if (eglContext != EGL_NO_CONTEXT)
+	{
+		properties.push_back(CL_GL_CONTEXT_KHR);
+		properties.push_back(reinterpret_cast<cl_context_properties>(eglContext));
+		properties.push_back(CL_EGL_DISPLAY_KHR);
+		properties.push_back(reinterpret_cast<cl_context_properties>(eglGetCurrentDisplay()));
+	}
+	else
+	{
+		properties.push_back(CL_GL_CONTEXT_KHR);
+		properties.push_back(reinterpret_cast<cl_context_properties>(glXGetCurrentContext()));
+		properties.push_back(CL_GLX_DISPLAY_KHR);
+		properties.push_back(reinterpret_cast<cl_context_properties>(glXGetCurrentDisplay()));
+	}
+#endif
+
+	properties.push_back(CL_CONTEXT_PLATFORM);
+	properties.push_back(reinterpret_cast<cl_context_properties>(platform()));
+	properties.push_back(0);
+	return properties;
+}
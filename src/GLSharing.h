@@ -0,0 +1,8 @@
+#pragma once
+
+#include <vector>
+#include "CLUtils.h"
+
+// OpenCL context properties sharing the GL context current on the calling thread, terminated by 0
+// WGL on Windows, EGL or GLX on Linux depending on the API that made the context current
+std::vector<cl_context_properties> getGLSharingContextProperties(const cl::Platform& platform);
@@ -0,0 +1,186 @@
+#include "Heightfield.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "Resources.h"
+
+// next header token of a PGM or PFM file, skipping white space and comments
+static bool readHeaderToken(const std::string& data, size_t& offset, std::string& token)
+{
+	while (offset < data.size())
+	{
+		if (data[offset] == '#')
+		{
+			while (offset < data.size() && data[offset] != '\n')
+				++offset;
+		}
+		else if (data[offset] == ' ' || data[offset] == '\t' || data[offset] == '\r' || data[offset] == '\n')
+		{
+			++offset;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	token.clear();
+	while (offset < data.size() && data[offset] != ' ' && data[offset] != '\t' && data[offset] != '\r' && data[offset] != '\n')
+	{
+		token += data[offset++];
+	}
+	return !token.empty();
+}
+
+static bool readHeaderNumber(const std::string& data, size_t& offset, double& value)
+{
+	std::string token;
+	if (!readHeaderToken(data, offset, token))
+		return false;
+
+	char* end = nullptr;
+	value = std::strtod(token.c_str(), &end);
+	return *end == '\0';
+}
+
+bool decodeHeightfield(const std::string& filePath, const std::string& data, std::vector<float>& heights, size_t& width, size_t& height)
+{
+	const bool isPgm = data.compare(0, 2, "P5") == 0;
+	const bool isPfm = data.compare(0, 2, "Pf") == 0;
+	if (isPgm || isPfm)
+	{
+		size_t offset = 2;
+		double values[3];
+		for (double& value : values)
+		{
+			if (!readHeaderNumber(data, offset, value))
+			{
+				std::cerr << "'" << filePath << "' has an invalid header" << std::endl;
+				return false;
+			}
+		}
+		// a single white space character ends the header
+		++offset;
+
+		width = static_cast<size_t>(values[0]);
+		height = static_cast<size_t>(values[1]);
+		const size_t numTexels = width * height;
+		const size_t texelSize = isPfm ? sizeof(float) : (values[2] > 255.0 ? 2 : 1);
+		if (numTexels == 0 || values[2] == 0.0 || data.size() < offset + numTexels * texelSize)
+		{
+			std::cerr << "'" << filePath << "' is truncated" << std::endl;
+			return false;
+		}
+
+		heights.resize(numTexels);
+		const unsigned char* texels = reinterpret_cast<const unsigned char*>(data.data() + offset);
+		for (size_t row = 0; row < height; ++row)
+		{
+			// PFM rows go from the bottom of the image to the top
+			const size_t sourceRow = isPfm ? height - 1 - row : row;
+			for (size_t column = 0; column < width; ++column)
+			{
+				const unsigned char* texel = texels + (sourceRow * width + column) * texelSize;
+				float& value = heights[row * width + column];
+				if (isPfm)
+				{
+					// a negative scale means little endian
+					unsigned char bytes[4];
+					for (int i = 0; i < 4; ++i)
+					{
+						bytes[i] = values[2] < 0.0 ? texel[i] : texel[3 - i];
+					}
+					uint32_t bits = static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8
+						| static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+					std::memcpy(&value, &bits, sizeof(value));
+				}
+				else
+				{
+					// PGM samples are big endian
+					const unsigned int sample = texelSize == 2 ? (texel[0] << 8 | texel[1]) : texel[0];
+					value = static_cast<float>(sample / values[2]);
+				}
+			}
+		}
+		return true;
+	}
+
+	// raw R16 has no header, only square images are recognized
+	const size_t numTexels = data.size() / 2;
+	const size_t size = static_cast<size_t>(std::sqrt(static_cast<double>(numTexels)) + 0.5);
+	if (data.size() % 2 != 0 || size == 0 || size * size != numTexels)
+	{
+		std::cerr << "'" << filePath << "' is neither a PGM, a PFM nor a square R16 height image" << std::endl;
+		return false;
+	}
+
+	width = size;
+	height = size;
+	heights.resize(numTexels);
+	const unsigned char* texels = reinterpret_cast<const unsigned char*>(data.data());
+	for (size_t i = 0; i < numTexels; ++i)
+	{
+		heights[i] = static_cast<float>(texels[i * 2] | texels[i * 2 + 1] << 8) / 65535.f;
+	}
+	return true;
+}
+
+bool Heightfield::create(const Options& options, const cl::Context& context, const cl::Device& device)
+{
+	std::string data;
+	if (!loadResource(options.heightfieldPath, data))
+		return false;
+
+	std::vector<float> heights;
+	size_t width = 0;
+	size_t height = 0;
+	if (!decodeHeightfield(options.heightfieldPath, data, heights, width, height))
+		return false;
+
+	if (width > device.getInfo<CL_DEVICE_IMAGE2D_MAX_WIDTH>() || height > device.getInfo<CL_DEVICE_IMAGE2D_MAX_HEIGHT>())
+	{
+		std::cerr << "Heightfield '" << options.heightfieldPath << "' is too large for the device" << std::endl;
+		return false;
+	}
+
+	// single channel floats are optional before OpenCL 2.0, RGBA floats are always supported
+	const bool singleChannel = isImageFormatSupported(context, CL_MEM_OBJECT_IMAGE2D, cl::ImageFormat(CL_R, CL_FLOAT));
+	if (!singleChannel)
+	{
+		std::vector<float> texels(heights.size() * 4, 0.f);
+		for (size_t i = 0; i < heights.size(); ++i)
+		{
+			texels[i * 4] = heights[i];
+		}
+		heights.swap(texels);
+	}
+
+	cl_int code = CL_SUCCESS;
+	image = cl::Image2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cl::ImageFormat(singleChannel ? CL_R : CL_RGBA, CL_FLOAT),
+		width, height, 0, heights.data(), &code);
+	if (!checkErrorCode(code, "cl::Image2D"))
+		return false;
+
+	const float* bounds = options.heightfieldBounds;
+	const float sizeX = bounds[3] - bounds[0];
+	const float sizeZ = bounds[5] - bounds[2];
+	if (sizeX <= 0.f || sizeZ <= 0.f)
+	{
+		std::cerr << "Heightfield bounds without an area" << std::endl;
+		return false;
+	}
+
+	HeightfieldParams params;
+	params.mapping = { { 1.f / sizeX, 1.f / sizeZ, -bounds[0] / sizeX, -bounds[2] / sizeZ } };
+	params.heights = { { bounds[1], bounds[4] - bounds[1], 1.f / static_cast<float>(width), 1.f / static_cast<float>(height) } };
+	params.material = { { options.restitution, options.friction, static_cast<float>(options.heightfieldContact), 0.f } };
+	paramsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(params), &params, &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	std::cout << "Heightfield " << options.heightfieldPath << ": " << width << "x" << height << std::endl;
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CLUtils.h"
+#include "Options.h"
+
+// layout of the Heightfield struct in cl/particle.cl
+struct HeightfieldParams
+{
+	// x/z world position to normalized image coordinates: xy scale, zw offset
+	cl_float4 mapping;
+	// x minimum height, y height range, zw one texel in normalized coordinates
+	cl_float4 heights;
+	// x restitution, y friction, z HeightfieldContact
+	cl_float4 material;
+};
+
+// decodes a height image into values between 0 and 1, rows from the minimum z to the maximum z
+// 8 and 16 bit binary PGM (P5), grayscale PFM (Pf, floats kept as they are) and raw square 16 bit little endian R16
+bool decodeHeightfield(const std::string& filePath, const std::string& data, std::vector<float>& heights, size_t& width, size_t& height);
+
+// terrain collision tested in updateParticleState (PARTICLE_HEIGHTFIELD): one bilinear height fetch per particle,
+// the slope is only sampled for the particles below the surface
+class Heightfield
+{
+public:
+	bool create(const Options& options, const cl::Context& context, const cl::Device& device);
+
+	const cl::Image2D& getImage() const { return image; }
+	const cl::Buffer& getParamsBuffer() const { return paramsBuffer; }
+
+private:
+	cl::Image2D image;
+	cl::Buffer paramsBuffer;
+};
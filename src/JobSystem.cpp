@@ -0,0 +1,246 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+
+static thread_local const JobSystem* currentJobSystem = nullptr;
+static thread_local int currentWorkerIndex = -1;
+
+JobSystem::JobSystem(unsigned int numWorkers)
+{
+	if (numWorkers == 0)
+	{
+		numWorkers = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+
+	for (unsigned int i = 0; i <= numWorkers; ++i)
+	{
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	for (unsigned int i = 0; i < numWorkers; ++i)
+	{
+		workers.emplace_back(&JobSystem::workerMain, this, static_cast<int>(i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopWorkers = true;
+	}
+	sleepCondition.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	// without workers the jobs left in the shared queue still have to run
+	while (tryRunJob())
+	{
+	}
+}
+
+JobSystem::JobHandle JobSystem::createJob(const char* name, std::function<void()> function)
+{
+	JobHandle job = std::make_shared<Job>();
+	job->name = name;
+	job->function = std::move(function);
+	return job;
+}
+
+void JobSystem::addDependency(const JobHandle& job, const JobHandle& dependency)
+{
+	std::lock_guard<std::mutex> lock(dependency->dependentsMutex);
+	if (dependency->done)
+	{
+		return;
+	}
+	job->numPendingDependencies.fetch_add(1, std::memory_order_relaxed);
+	dependency->dependents.push_back(job);
+}
+
+void JobSystem::submit(const JobHandle& job)
+{
+	if (job->numPendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		push(job);
+	}
+}
+
+JobSystem::JobHandle JobSystem::run(const char* name, std::function<void()> function)
+{
+	JobHandle job = createJob(name, std::move(function));
+	submit(job);
+	return job;
+}
+
+bool JobSystem::isDone(const JobHandle& job) const
+{
+	return job->done.load(std::memory_order_acquire);
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+	while (!isDone(job))
+	{
+		if (!tryRunJob())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::parallelFor(const char* name, size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function)
+{
+	grainSize = std::max<size_t>(grainSize, 1);
+	const size_t numChunks = (count + grainSize - 1) / grainSize;
+	if (numChunks <= 1 || workers.empty())
+	{
+		if (count > 0)
+		{
+			function(0, count);
+		}
+		return;
+	}
+
+	std::atomic<size_t> numRemainingChunks{ numChunks };
+	for (size_t begin = 0; begin < count; begin += grainSize)
+	{
+		const size_t end = std::min(begin + grainSize, count);
+		run(name, [&function, &numRemainingChunks, begin, end]()
+		{
+			function(begin, end);
+			numRemainingChunks.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	while (numRemainingChunks.load(std::memory_order_acquire) > 0)
+	{
+		if (!tryRunJob())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::push(const JobHandle& job)
+{
+	const bool isWorker = currentJobSystem == this && currentWorkerIndex >= 0;
+	WorkerQueue& queue = *queues[isWorker ? currentWorkerIndex : workers.size()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	numQueuedJobs.fetch_add(1, std::memory_order_release);
+
+	// taking the lock orders the wake up after a worker checked the queued jobs and before it sleeps
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	sleepCondition.notify_one();
+}
+
+JobSystem::JobHandle JobSystem::pop()
+{
+	if (numQueuedJobs.load(std::memory_order_acquire) == 0)
+	{
+		return nullptr;
+	}
+
+	const bool isWorker = currentJobSystem == this && currentWorkerIndex >= 0;
+	const size_t numQueues = queues.size();
+	const size_t ownQueueIndex = isWorker ? static_cast<size_t>(currentWorkerIndex) : numQueues - 1;
+
+	// newest job of the own queue, it is the most likely to be in cache
+	if (isWorker)
+	{
+		WorkerQueue& queue = *queues[ownQueueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			JobHandle job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			numQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	// oldest job of the others, starting with the shared queue for threads outside of the pool
+	for (size_t i = isWorker ? 1 : 0; i < numQueues; ++i)
+	{
+		WorkerQueue& queue = *queues[(ownQueueIndex + i) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			JobHandle job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			numQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+bool JobSystem::tryRunJob()
+{
+	JobHandle job = pop();
+	if (job == nullptr)
+	{
+		return false;
+	}
+	execute(job);
+	return true;
+}
+
+void JobSystem::execute(const JobHandle& job)
+{
+	if (timingCallback)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		job->function();
+		const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+		timingCallback(job->name, duration.count(), currentJobSystem == this ? currentWorkerIndex : -1);
+	}
+	else
+	{
+		job->function();
+	}
+	job->function = nullptr;
+
+	std::vector<JobHandle> dependents;
+	{
+		std::lock_guard<std::mutex> lock(job->dependentsMutex);
+		job->done.store(true, std::memory_order_release);
+		dependents.swap(job->dependents);
+	}
+
+	for (const JobHandle& dependent : dependents)
+	{
+		submit(dependent);
+	}
+}
+
+void JobSystem::workerMain(int workerIndex)
+{
+	currentJobSystem = this;
+	currentWorkerIndex = workerIndex;
+
+	while (true)
+	{
+		if (tryRunJob())
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.wait(lock, [this]() { return stopWorkers || numQueuedJobs.load(std::memory_order_acquire) > 0; });
+		if (stopWorkers && numQueuedJobs.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work-stealing thread pool for host side tasks
+// each worker owns a deque, it runs its own jobs newest first and steals the oldest jobs of the others when it runs out
+// threads waiting for jobs run queued jobs in the meantime, so jobs may wait on other jobs
+class JobSystem
+{
+public:
+	struct Job;
+	typedef std::shared_ptr<Job> JobHandle;
+
+	// called after every job with its name, its duration and the index of the worker that ran it (-1 outside of the workers)
+	typedef std::function<void(const char* name, double milliseconds, int worker)> TimingCallback;
+
+	// 0 workers uses one per hardware thread but the calling one
+	explicit JobSystem(unsigned int numWorkers = 0);
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	// runs the remaining jobs, then joins the workers
+	~JobSystem();
+
+	unsigned int getNumWorkers() const { return static_cast<unsigned int>(workers.size()); }
+
+	// jobs start once submitted and once all their dependencies are done, names must outlive the jobs
+	JobHandle createJob(const char* name, std::function<void()> function);
+	// must be called before submitting the job
+	void addDependency(const JobHandle& job, const JobHandle& dependency);
+	void submit(const JobHandle& job);
+	JobHandle run(const char* name, std::function<void()> function);
+
+	bool isDone(const JobHandle& job) const;
+	void wait(const JobHandle& job);
+
+	// calls function(begin, end) on chunks of at most grainSize elements of [0, count), returns once every chunk is done
+	void parallelFor(const char* name, size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function);
+
+	// not synchronized with running jobs, set it before submitting any
+	void setTimingCallback(TimingCallback callback) { timingCallback = std::move(callback); }
+
+	struct Job
+	{
+		const char* name = nullptr;
+		std::function<void()> function;
+		// one more until the job is submitted
+		std::atomic<unsigned int> numPendingDependencies{ 1 };
+		std::atomic<bool> done{ false };
+		std::mutex dependentsMutex;
+		std::vector<JobHandle> dependents;
+	};
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+	};
+
+	void push(const JobHandle& job);
+	JobHandle pop();
+	bool tryRunJob();
+	void execute(const JobHandle& job);
+	void workerMain(int workerIndex);
+
+	// one queue per worker, the last one is shared by the threads outside of the pool
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> numQueuedJobs{ 0 };
+
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	bool stopWorkers = false;
+
+	TimingCallback timingCallback;
+};
@@ -0,0 +1,26 @@
+#include "LifeCurves.h"
+
+#include <algorithm>
+
+std::vector<float> bakeLifeCurve(const std::vector<float>& keys, size_t numChannels)
+{
+	std::vector<float> texels(LIFE_CURVE_RESOLUTION * numChannels, 1.f);
+	const size_t numKeys = keys.size() / numChannels;
+	if (numKeys == 0)
+		return texels;
+
+	for (size_t texel = 0; texel < LIFE_CURVE_RESOLUTION; ++texel)
+	{
+		const float position = static_cast<float>(texel) / static_cast<float>(LIFE_CURVE_RESOLUTION - 1) * static_cast<float>(numKeys - 1);
+		const size_t key = std::min(static_cast<size_t>(position), numKeys - 1);
+		const size_t nextKey = std::min(key + 1, numKeys - 1);
+		const float t = position - static_cast<float>(key);
+		for (size_t channel = 0; channel < numChannels; ++channel)
+		{
+			const float a = keys[key * numChannels + channel];
+			const float b = keys[nextKey * numChannels + channel];
+			texels[texel * numChannels + channel] = a + (b - a) * t;
+		}
+	}
+	return texels;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// texels of the 1D curve textures sampled by shaders/shader.vert
+static const size_t LIFE_CURVE_RESOLUTION = 64;
+
+// linear interpolation of keys evenly spaced over the normalized age into LIFE_CURVE_RESOLUTION texels
+// numChannels values per key and per texel, the first texel is the spawn and the last one the death
+// an empty key list gives a constant 1, a single key a constant curve
+std::vector<float> bakeLifeCurve(const std::vector<float>& keys, size_t numChannels);
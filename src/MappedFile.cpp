@@ -0,0 +1,126 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& filePath)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Warning: unable to open file '" << filePath << "'" << std::endl;
+		return false;
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		std::cerr << "Warning: file '" << filePath << "' is empty" << std::endl;
+		close();
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		std::cerr << "Warning: unable to map file '" << filePath << "'" << std::endl;
+		close();
+		return false;
+	}
+	mappingHandle = mapping;
+
+	data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+	if (fileDescriptor == -1)
+	{
+		std::cerr << "Warning: unable to open file '" << filePath << "'" << std::endl;
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		std::cerr << "Warning: file '" << filePath << "' is empty" << std::endl;
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping != MAP_FAILED)
+	{
+		data = static_cast<const unsigned char*>(mapping);
+		size = static_cast<size_t>(fileStat.st_size);
+	}
+#endif
+
+	if (data == nullptr)
+	{
+		std::cerr << "Warning: unable to map file '" << filePath << "'" << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+	if (fileHandle != nullptr)
+		CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (data != nullptr)
+		munmap(const_cast<unsigned char*>(data), size);
+	if (fileDescriptor != -1)
+		::close(fileDescriptor);
+	fileDescriptor = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+	if (data == nullptr || offset >= size)
+		return;
+
+	length = std::min(length, size - offset);
+
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<unsigned char*>(data + offset);
+	range.NumberOfBytes = length;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise needs a page aligned address
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t alignedOffset = offset - offset % pageSize;
+	madvise(const_cast<unsigned char*>(data + alignedOffset), length + (offset - alignedOffset), MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// read only memory mapped file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open(const std::string& filePath);
+	void close();
+
+	bool isOpen() const { return data != nullptr; }
+	const unsigned char* getData() const { return data; }
+	size_t getSize() const { return size; }
+
+	// hint the system to read a range ahead of its use
+	void prefetch(size_t offset, size_t length) const;
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+};
@@ -0,0 +1,157 @@
+#include "MeshBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+
+bool MeshBvh::create(const cl::Context& context, const cl::Device& device, const cl::Program& program, const std::vector<cl_float4>& triangles)
+{
+	numTriangles = triangles.size() / 3;
+	if (numTriangles == 0)
+	{
+		std::cerr << "Collision mesh without triangles" << std::endl;
+		return false;
+	}
+
+	numSortedKeys = 1;
+	while (numSortedKeys < numTriangles)
+	{
+		numSortedKeys *= 2;
+	}
+
+	// the Morton codes quantize the centroids inside the scene bounds
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const cl_float4& vertex : triangles)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			boundsMin[axis] = std::min(boundsMin[axis], vertex.s[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], vertex.s[axis]);
+		}
+	}
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float extent = boundsMax[axis] - boundsMin[axis];
+		sceneMin.s[axis] = boundsMin[axis];
+		sceneInverseExtent.s[axis] = extent > 0.f ? 1.f / extent : 0.f;
+	}
+
+	const size_t numNodes = 2 * numTriangles - 1;
+	const cl_ulong maxAllocationSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+	if (triangles.size() * sizeof(cl_float4) > maxAllocationSize || numNodes * sizeof(BvhNode) > maxAllocationSize)
+	{
+		std::cerr << "Collision mesh of " << numTriangles << " triangles is too large for the device" << std::endl;
+		return false;
+	}
+
+	cl_int code = CL_SUCCESS;
+	trianglesBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, triangles.size() * sizeof(cl_float4),
+		const_cast<cl_float4*>(triangles.data()), &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	keysBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numSortedKeys * sizeof(cl_uint), nullptr, &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	valuesBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numSortedKeys * sizeof(cl_uint), nullptr, &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	nodesBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numNodes * sizeof(BvhNode), nullptr, &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	mergeCountersBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, std::max<size_t>(numTriangles - 1, 1) * sizeof(cl_int), nullptr, &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	struct
+	{
+		cl::Kernel* kernel;
+		const char* name;
+	} kernels[] =
+	{
+		{ &computeMortonCodesKernel, "computeMortonCodes" },
+		{ &bitonicSortStepKernel, "bitonicSortStep" },
+		{ &initLeafNodesKernel, "initLeafNodes" },
+		{ &buildInternalNodesKernel, "buildInternalNodes" },
+		{ &computeNodeBoundsKernel, "computeNodeBounds" },
+	};
+	for (const auto& kernel : kernels)
+	{
+		*kernel.kernel = cl::Kernel(program, kernel.name, &code);
+		if (!checkErrorCode(code, "cl::Kernel"))
+			return false;
+	}
+
+	const cl_uint numTrianglesArg = static_cast<cl_uint>(numTriangles);
+	code = computeMortonCodesKernel.setArg(0, trianglesBuffer);
+	code |= computeMortonCodesKernel.setArg(1, numTrianglesArg);
+	code |= computeMortonCodesKernel.setArg(2, sceneMin);
+	code |= computeMortonCodesKernel.setArg(3, sceneInverseExtent);
+	code |= computeMortonCodesKernel.setArg(4, keysBuffer);
+	code |= computeMortonCodesKernel.setArg(5, valuesBuffer);
+
+	code |= bitonicSortStepKernel.setArg(0, keysBuffer);
+	code |= bitonicSortStepKernel.setArg(1, valuesBuffer);
+
+	code |= initLeafNodesKernel.setArg(0, trianglesBuffer);
+	code |= initLeafNodesKernel.setArg(1, valuesBuffer);
+	code |= initLeafNodesKernel.setArg(2, nodesBuffer);
+	code |= initLeafNodesKernel.setArg(3, mergeCountersBuffer);
+	code |= initLeafNodesKernel.setArg(4, numTrianglesArg);
+
+	code |= buildInternalNodesKernel.setArg(0, keysBuffer);
+	code |= buildInternalNodesKernel.setArg(1, nodesBuffer);
+	code |= buildInternalNodesKernel.setArg(2, numTrianglesArg);
+
+	code |= computeNodeBoundsKernel.setArg(0, nodesBuffer);
+	code |= computeNodeBoundsKernel.setArg(1, mergeCountersBuffer);
+	code |= computeNodeBoundsKernel.setArg(2, numTrianglesArg);
+	return checkErrorCode(code, "setArg");
+}
+
+bool MeshBvh::build(cl::CommandQueue& commandQueue, cl::Event* event)
+{
+	cl_int code = commandQueue.enqueueNDRangeKernel(computeMortonCodesKernel, cl::NullRange, cl::NDRange(numSortedKeys), cl::NullRange);
+	if (!checkErrorCode(code, "computeMortonCodes"))
+		return false;
+
+	// log2(n) * (log2(n) + 1) / 2 passes
+	for (size_t blockSize = 2; blockSize <= numSortedKeys; blockSize *= 2)
+	{
+		for (size_t distance = blockSize / 2; distance > 0; distance /= 2)
+		{
+			code = bitonicSortStepKernel.setArg(2, static_cast<cl_uint>(distance));
+			code |= bitonicSortStepKernel.setArg(3, static_cast<cl_uint>(blockSize));
+			code |= commandQueue.enqueueNDRangeKernel(bitonicSortStepKernel, cl::NullRange, cl::NDRange(numSortedKeys), cl::NullRange);
+			if (!checkErrorCode(code, "bitonicSortStep"))
+				return false;
+		}
+	}
+
+	// a single triangle is a leaf at the root
+	cl::Event lastEvent;
+	code = commandQueue.enqueueNDRangeKernel(initLeafNodesKernel, cl::NullRange, cl::NDRange(numTriangles), cl::NullRange, nullptr, &lastEvent);
+	if (!checkErrorCode(code, "initLeafNodes"))
+		return false;
+
+	if (numTriangles > 1)
+	{
+		code = commandQueue.enqueueNDRangeKernel(buildInternalNodesKernel, cl::NullRange, cl::NDRange(numTriangles - 1), cl::NullRange);
+		if (!checkErrorCode(code, "buildInternalNodes"))
+			return false;
+
+		code = commandQueue.enqueueNDRangeKernel(computeNodeBoundsKernel, cl::NullRange, cl::NDRange(numTriangles), cl::NullRange, nullptr, &lastEvent);
+		if (!checkErrorCode(code, "computeNodeBounds"))
+			return false;
+	}
+
+	if (event != nullptr)
+	{
+		*event = lastEvent;
+	}
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include "CLUtils.h"
+
+// layout of the BvhNode struct in cl/bvh.cl
+struct BvhNode
+{
+	cl_float4 boundsMin;
+	cl_float4 boundsMax;
+	cl_int left;
+	cl_int right;
+	cl_int parent;
+	cl_int triangle;
+};
+
+static_assert(sizeof(BvhNode) == 48, "BvhNode must match the OpenCL struct size");
+
+// linear BVH over a static triangle mesh, built on the device by the kernels of cl/bvh.cl:
+// Morton codes of the triangle centroids, a bitonic sort of the codes, the internal nodes from the sorted codes
+// and a bottom-up merge of the bounds; collideParticlesWithMesh traces the particles' steps through it
+// the scene bounds quantizing the codes are computed on the host while the triangles are uploaded
+class MeshBvh
+{
+public:
+	// the program is cl/particle.cl followed by cl/bvh.cl, built with PARTICLE_MESH_COLLISION
+	// triangles holds three vertices per triangle
+	bool create(const cl::Context& context, const cl::Device& device, const cl::Program& program, const std::vector<cl_float4>& triangles);
+
+	// enqueues the whole build on an in-order queue, the event of its last command is returned when requested
+	bool build(cl::CommandQueue& commandQueue, cl::Event* event = nullptr);
+
+	size_t getNumTriangles() const { return numTriangles; }
+	const cl::Buffer& getNodesBuffer() const { return nodesBuffer; }
+	const cl::Buffer& getTrianglesBuffer() const { return trianglesBuffer; }
+
+private:
+	size_t numTriangles = 0;
+	// power of two sorted by the bitonic sort
+	size_t numSortedKeys = 0;
+	cl_float4 sceneMin = {};
+	cl_float4 sceneInverseExtent = {};
+
+	cl::Buffer trianglesBuffer;
+	cl::Buffer keysBuffer;
+	cl::Buffer valuesBuffer;
+	cl::Buffer nodesBuffer;
+	cl::Buffer mergeCountersBuffer;
+
+	cl::Kernel computeMortonCodesKernel;
+	cl::Kernel bitonicSortStepKernel;
+	cl::Kernel initLeafNodesKernel;
+	cl::Kernel buildInternalNodesKernel;
+	cl::Kernel computeNodeBoundsKernel;
+};
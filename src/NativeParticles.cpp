@@ -0,0 +1,224 @@
+#include "NativeParticles.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+#include "Random.h"
+
+static const cl_float3 INITIAL_POSITION = { { 0.f, 20.f, 0.f, 0.f } };
+static const cl_float3 INITIAL_VELOCITY = { { 0.f, 0.f, 0.f, 0.f } };
+static const float PI = 3.14159265358979323846f;
+
+// randomInit(), one stream per work item
+static Pcg32 createWorkItemRng(cl_int globalSeed, size_t globalId)
+{
+	Pcg32 rng;
+	rng.seed(static_cast<uint64_t>(static_cast<int64_t>(globalSeed)), globalId);
+	return rng;
+}
+
+static float random01(Pcg32& rng)
+{
+	return static_cast<float>(static_cast<double>(rng.next()) / UINT_MAX);
+}
+
+static float random(Pcg32& rng, float min, float max)
+{
+	float randomFloat = random01(rng);
+	return min + randomFloat * (max - min);
+}
+
+// uniform cylinder distribution
+static void initRandomOnCylinder(ParticleState& particle, float radius, float height, Pcg32& rng)
+{
+	float randomAngle = random(rng, 0.f, PI * 2.f);
+	float randomRadius = std::sqrt(random(rng, 0.f, 1.f)) * radius;
+	float randomY = random(rng, height * -0.5f, height * 0.5f);
+	particle.position.s[0] = std::cos(randomAngle) * randomRadius;
+	particle.position.s[1] = randomY;
+	particle.position.s[2] = std::sin(randomAngle) * randomRadius;
+}
+
+void nativeInitParticleState(ParticleState* particles, size_t numParticles)
+{
+	for (size_t id = 0; id < numParticles; ++id)
+	{
+		ParticleState& particle = particles[id];
+		particle.position = INITIAL_POSITION;
+		particle.velocity = INITIAL_VELOCITY;
+		particle.isAlive = 0;
+	}
+}
+
+void nativeSpawnParticle(
+	ParticleState* particles,
+	size_t numParticles,
+	size_t localSize,
+	cl_uint numParticlesToSpawn,
+	cl_int globalSeed,
+	cl_float currentTime,
+	const cl_float4* spawnPoints,
+	cl_uint numSpawnPoints,
+	cl_float2 lifetimeRange)
+{
+	const size_t numGroups = numParticles / localSize;
+	std::vector<cl_uchar> canSpawnParticles(localSize);
+	for (size_t groupId = 0; groupId < numGroups; ++groupId)
+	{
+		ParticleState* groupParticles = particles + groupId * localSize;
+		for (size_t localId = 0; localId < localSize; ++localId)
+		{
+			canSpawnParticles[localId] = !groupParticles[localId].isAlive;
+		}
+
+		// first work item of the group
+		cl_uint numParticleToSpawnForWorkGroup = static_cast<cl_uint>(numParticlesToSpawn / numGroups);
+		if ((groupId + static_cast<size_t>(globalSeed)) % numGroups < numParticlesToSpawn % numGroups)
+		{
+			++numParticleToSpawnForWorkGroup;
+		}
+		numParticleToSpawnForWorkGroup = std::min(numParticleToSpawnForWorkGroup, static_cast<cl_uint>(localSize));
+
+		cl_uint numSpawnedParticles = 0;
+		for (size_t i = 0; i < localSize; ++i)
+		{
+			if (canSpawnParticles[i])
+			{
+				if (numSpawnedParticles < numParticleToSpawnForWorkGroup)
+				{
+					++numSpawnedParticles;
+				}
+				else
+				{
+					canSpawnParticles[i] = 0;
+				}
+			}
+		}
+
+		for (size_t localId = 0; localId < localSize; ++localId)
+		{
+			if (!canSpawnParticles[localId])
+			{
+				continue;
+			}
+
+			ParticleState& particle = groupParticles[localId];
+			Pcg32 rng = createWorkItemRng(globalSeed, groupId * localSize + localId);
+			particle.velocity = INITIAL_VELOCITY;
+			particle.spawnTime = currentTime;
+			particle.isAlive = 1;
+
+			if (numSpawnPoints > 0)
+			{
+				const cl_float4& spawnPoint = spawnPoints[rng.next() % numSpawnPoints];
+				particle.position = { { spawnPoint.s[0], spawnPoint.s[1], spawnPoint.s[2], 0.f } };
+			}
+			else
+			{
+				initRandomOnCylinder(particle, 45.f, 0.f, rng);
+			}
+
+			particle.lifetime = random(rng, lifetimeRange.s[0], lifetimeRange.s[1]);
+		}
+	}
+}
+
+// read_imagef with CLK_ADDRESS_REPEAT | CLK_FILTER_LINEAR on normalized coordinates, as the OpenCL specification defines it
+static void sampleCurlNoise(const NativeCurlNoise& curlNoise, const cl_float4& position, float result[3])
+{
+	const int size = static_cast<int>(curlNoise.size);
+	int indices[3][2];
+	float weights[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float s = position.s[axis] * curlNoise.transform.s[3] + curlNoise.transform.s[axis];
+		const float u = (s - std::floor(s)) * size;
+		const float base = std::floor(u - 0.5f);
+		int i0 = static_cast<int>(base);
+		int i1 = i0 + 1;
+		if (i0 < 0)
+			i0 += size;
+		if (i1 > size - 1)
+			i1 -= size;
+		indices[axis][0] = i0;
+		indices[axis][1] = i1;
+		weights[axis] = (u - 0.5f) - base;
+	}
+
+	result[0] = result[1] = result[2] = 0.f;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const int x = corner & 1;
+		const int y = (corner >> 1) & 1;
+		const int z = (corner >> 2) & 1;
+		const float weight = (x ? weights[0] : 1.f - weights[0]) * (y ? weights[1] : 1.f - weights[1]) * (z ? weights[2] : 1.f - weights[2]);
+		const size_t texel = (static_cast<size_t>(indices[2][z]) * size + indices[1][y]) * size + indices[0][x];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			result[axis] += weight * curlNoise.texels[texel].s[axis];
+		}
+	}
+}
+
+void nativeUpdateParticleState(ParticleState* particles, size_t numParticles, cl_int globalSeed, cl_float deltaTime,
+	const NativeCurlNoise* curlNoise)
+{
+	for (size_t id = 0; id < numParticles; ++id)
+	{
+		ParticleState& particle = particles[id];
+		if (!particle.isAlive)
+		{
+			continue;
+		}
+
+		float acceleration[3];
+		if (curlNoise != nullptr)
+		{
+			// coherent turbulence, plus the mean of the white noise fall
+			sampleCurlNoise(*curlNoise, particle.position, acceleration);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				acceleration[axis] *= curlNoise->strength;
+			}
+			acceleration[1] -= 7.5f;
+		}
+		else
+		{
+			Pcg32 rng = createWorkItemRng(globalSeed, id);
+
+			acceleration[0] = random(rng, -50.f, 50.f);
+			acceleration[1] = random(rng, -5.f, -10.f);
+			acceleration[2] = random(rng, -50.f, 50.f);
+		}
+
+		// accelerate() then applyVelocity()
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			particle.velocity.s[axis] += acceleration[axis] * deltaTime;
+		}
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			particle.position.s[axis] += particle.velocity.s[axis] * deltaTime;
+		}
+	}
+}
+
+void nativeCheckParticleDeath(ParticleState* particles, size_t numParticles, cl_float currentTime)
+{
+	for (size_t id = 0; id < numParticles; ++id)
+	{
+		ParticleState& particle = particles[id];
+		if (!particle.isAlive)
+		{
+			continue;
+		}
+
+		// checkAge()
+		if (currentTime - particle.spawnTime >= particle.lifetime)
+		{
+			particle.isAlive = 0;
+			particle.position = INITIAL_POSITION;
+		}
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include "ParticleState.h"
+
+// host side C++ implementation of the simulation kernels in cl/particle.cl
+// runs the work items one after the other but follows the kernels statement by statement,
+// including the per work item random streams and the per work-group spawn distribution,
+// so that its results can be compared with the OpenCL devices (see bench/ParticleValidate.cpp)
+// any change to a kernel must be reflected here
+
+void nativeInitParticleState(ParticleState* particles, size_t numParticles);
+
+// localSize is the work-group size the kernel would be enqueued with, it must divide numParticles
+void nativeSpawnParticle(
+	ParticleState* particles,
+	size_t numParticles,
+	size_t localSize,
+	cl_uint numParticlesToSpawn,
+	cl_int globalSeed,
+	cl_float currentTime,
+	const cl_float4* spawnPoints,
+	cl_uint numSpawnPoints,
+	cl_float2 lifetimeRange);
+
+// the curl-noise volume of a PARTICLE_CURL_NOISE build, sampled like the kernel's repeating linear sampler
+struct NativeCurlNoise
+{
+	// size^3 texels, x fastest (src/CurlNoise.h)
+	const cl_float4* texels;
+	unsigned int size;
+	cl_float4 transform;
+	float strength;
+};
+
+// replaces the white noise by the curl noise when curlNoise is set
+void nativeUpdateParticleState(ParticleState* particles, size_t numParticles, cl_int globalSeed, cl_float deltaTime,
+	const NativeCurlNoise* curlNoise = nullptr);
+
+void nativeCheckParticleDeath(ParticleState* particles, size_t numParticles, cl_float currentTime);
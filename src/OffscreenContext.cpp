@@ -0,0 +1,198 @@
+#include "OffscreenContext.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool hasExtension(const char* extensions, const char* extension)
+{
+	if (extensions == nullptr)
+	{
+		return false;
+	}
+
+	const size_t length = std::strlen(extension);
+	for (const char* found = std::strstr(extensions, extension); found != nullptr; found = std::strstr(found + length, extension))
+	{
+		const bool startsWord = found == extensions || found[-1] == ' ';
+		const bool endsWord = found[length] == ' ' || found[length] == '\0';
+		if (startsWord && endsWord)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+#endif
+
+OffscreenContext::~OffscreenContext()
+{
+	destroy();
+}
+
+bool OffscreenContext::create()
+{
+#ifdef __linux__
+	destroy();
+
+	// Mesa's surfaceless platform needs no display server at all
+	EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	if (hasExtension(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), "EGL_MESA_platform_surfaceless"))
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (getPlatformDisplay != nullptr)
+		{
+			eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		}
+	}
+	if (eglDisplay == EGL_NO_DISPLAY)
+	{
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major;
+	EGLint minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+	{
+		std::cerr << "Could not initialize EGL" << std::endl;
+		return false;
+	}
+	display = eglDisplay;
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+		destroy();
+		return false;
+	}
+
+	const bool surfaceless = hasExtension(eglQueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE,		surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE,	EGL_OPENGL_BIT,
+		EGL_RED_SIZE,			8,
+		EGL_GREEN_SIZE,			8,
+		EGL_BLUE_SIZE,			8,
+		EGL_ALPHA_SIZE,			8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+	{
+		std::cerr << "No EGL config for desktop OpenGL" << std::endl;
+		destroy();
+		return false;
+	}
+
+	// same requirements as the windowed context, the renderer still uses client state
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION,			3,
+		EGL_CONTEXT_MINOR_VERSION,			3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK,	EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, nullptr);
+	}
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		std::cerr << "Could not create EGL context" << std::endl;
+		destroy();
+		return false;
+	}
+	context = eglContext;
+
+	EGLSurface eglSurface = EGL_NO_SURFACE;
+	if (!surfaceless)
+	{
+		const EGLint pbufferAttributes[] = {
+			EGL_WIDTH,	1,
+			EGL_HEIGHT,	1,
+			EGL_NONE
+		};
+		eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttributes);
+		if (eglSurface == EGL_NO_SURFACE)
+		{
+			std::cerr << "Could not create EGL pbuffer" << std::endl;
+			destroy();
+			return false;
+		}
+		surface = eglSurface;
+	}
+
+	if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
+	{
+		std::cerr << "Could not make the EGL context current" << std::endl;
+		destroy();
+		return false;
+	}
+
+	std::cout << "Offscreen EGL " << major << "." << minor << " context (" << (surfaceless ? "surfaceless" : "pbuffer") << ")" << std::endl;
+	return true;
+#else
+	std::cerr << "Offscreen rendering requires EGL, it is only available on Linux" << std::endl;
+	return false;
+#endif
+}
+
+bool OffscreenContext::createFramebuffer(unsigned int width, unsigned int height)
+{
+	glGenRenderbuffers(1, &colorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cerr << "Offscreen framebuffer incomplete" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void OffscreenContext::destroy()
+{
+	if (framebuffer != 0)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+	}
+	if (colorRenderbuffer != 0)
+	{
+		glDeleteRenderbuffers(1, &colorRenderbuffer);
+		colorRenderbuffer = 0;
+	}
+
+#ifdef __linux__
+	if (display != nullptr)
+	{
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != nullptr)
+		{
+			eglDestroyContext(display, context);
+		}
+		if (surface != nullptr)
+		{
+			eglDestroySurface(display, surface);
+		}
+		eglTerminate(display);
+	}
+#endif
+	display = nullptr;
+	surface = nullptr;
+	context = nullptr;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// headless GL context through EGL, for servers without a display
+// surfaceless when EGL_KHR_surfaceless_context is available (on Mesa's surfaceless platform if possible),
+// on a 1x1 pbuffer otherwise, frames are rendered into a framebuffer object instead of a window
+class OffscreenContext
+{
+public:
+	OffscreenContext() = default;
+	OffscreenContext(const OffscreenContext&) = delete;
+	OffscreenContext& operator=(const OffscreenContext&) = delete;
+	~OffscreenContext();
+
+	// creates the context and makes it current
+	bool create();
+	// requires GL to be initialized, leaves the framebuffer bound
+	bool createFramebuffer(unsigned int width, unsigned int height);
+	void destroy();
+
+	bool isSurfaceless() const { return surface == nullptr; }
+
+private:
+	void* display = nullptr;
+	void* surface = nullptr;
+	void* context = nullptr;
+
+	GLuint framebuffer = 0;
+	GLuint colorRenderbuffer = 0;
+};
@@ -0,0 +1,573 @@
+#include "Options.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+
+static bool parseUnsigned(const char* value, unsigned int& result)
+{
+	if (value == nullptr)
+		return false;
+
+	char* end = nullptr;
+	const unsigned long parsed = std::strtoul(value, &end, 10);
+	if (end == value || *end != '\0')
+	{
+		std::cerr << "Invalid number '" << value << "'" << std::endl;
+		return false;
+	}
+	result = static_cast<unsigned int>(parsed);
+	return true;
+}
+
+static bool parseFloat(const char* value, float& result)
+{
+	if (value == nullptr)
+		return false;
+
+	char* end = nullptr;
+	const float parsed = std::strtof(value, &end);
+	if (end == value || *end != '\0')
+	{
+		std::cerr << "Invalid number '" << value << "'" << std::endl;
+		return false;
+	}
+	result = parsed;
+	return true;
+}
+
+// <count> comma separated values
+static bool parseFloatList(const char* value, float* values, int count)
+{
+	if (value == nullptr)
+		return false;
+
+	const char* begin = value;
+	for (int i = 0; i < count; ++i)
+	{
+		char* end = nullptr;
+		values[i] = std::strtof(begin, &end);
+		if (end == begin || *end != (i < count - 1 ? ',' : '\0'))
+		{
+			std::cerr << "Invalid list '" << value << "', expected " << count << " comma separated values" << std::endl;
+			return false;
+		}
+		begin = end + 1;
+	}
+	return true;
+}
+
+// comma separated values, a multiple of groupSize of them
+static bool parseFloatSequence(const char* value, std::vector<float>& values, size_t groupSize)
+{
+	if (value == nullptr)
+		return false;
+
+	values.clear();
+	const char* begin = value;
+	while (true)
+	{
+		char* end = nullptr;
+		values.push_back(std::strtof(begin, &end));
+		if (end == begin || (*end != ',' && *end != '\0'))
+		{
+			std::cerr << "Invalid list '" << value << "'" << std::endl;
+			return false;
+		}
+		if (*end == '\0')
+			break;
+		begin = end + 1;
+	}
+
+	if (values.size() % groupSize != 0)
+	{
+		std::cerr << "Invalid list '" << value << "', expected groups of " << groupSize << " values" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// <type>:<values>, see ColliderType
+static bool parseCollider(const char* value, ColliderSource& collider)
+{
+	if (value == nullptr)
+		return false;
+
+	static const struct
+	{
+		const char* name;
+		ColliderType type;
+		int numValues;
+	} colliderTypes[] =
+	{
+		{ "plane", ColliderType::Plane, 4 },
+		{ "sphere", ColliderType::Sphere, 4 },
+		{ "box", ColliderType::Box, 6 },
+		{ "capsule", ColliderType::Capsule, 7 },
+	};
+
+	const char* separator = std::strchr(value, ':');
+	if (separator != nullptr)
+	{
+		const size_t nameLength = static_cast<size_t>(separator - value);
+		for (const auto& colliderType : colliderTypes)
+		{
+			if (std::strlen(colliderType.name) == nameLength && std::strncmp(value, colliderType.name, nameLength) == 0)
+			{
+				collider.type = colliderType.type;
+				return parseFloatList(separator + 1, collider.values, colliderType.numValues);
+			}
+		}
+	}
+
+	std::cerr << "Invalid collider '" << value << "', expected plane:, sphere:, box: or capsule: followed by its values" << std::endl;
+	return false;
+}
+
+// <type>:<values>, see ForceVolumeType
+static bool parseForceVolume(const char* value, ForceVolumeSource& volume)
+{
+	if (value == nullptr)
+		return false;
+
+	static const struct
+	{
+		const char* name;
+		ForceVolumeType type;
+		int numValues;
+	} volumeTypes[] =
+	{
+		{ "attractor", ForceVolumeType::Attractor, 5 },
+		{ "wind", ForceVolumeType::Wind, 9 },
+		{ "vortex", ForceVolumeType::Vortex, 6 },
+	};
+
+	const char* separator = std::strchr(value, ':');
+	if (separator != nullptr)
+	{
+		const size_t nameLength = static_cast<size_t>(separator - value);
+		for (const auto& volumeType : volumeTypes)
+		{
+			if (std::strlen(volumeType.name) == nameLength && std::strncmp(value, volumeType.name, nameLength) == 0)
+			{
+				volume.type = volumeType.type;
+				return parseFloatList(separator + 1, volume.values, volumeType.numValues);
+			}
+		}
+	}
+
+	std::cerr << "Invalid force volume '" << value << "', expected attractor:, wind: or vortex: followed by its values" << std::endl;
+	return false;
+}
+
+// one --force-volume value per line, empty lines and # comments skipped
+static bool parseForceVolumeFile(const char* filePath, std::vector<ForceVolumeSource>& volumes)
+{
+	if (filePath == nullptr)
+		return false;
+
+	std::ifstream file(filePath);
+	if (!file)
+	{
+		std::cerr << "Unable to open force volume file '" << filePath << "'" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#')
+			continue;
+
+		const size_t end = line.find_last_not_of(" \t\r");
+		volumes.emplace_back();
+		if (!parseForceVolume(line.substr(begin, end - begin + 1).c_str(), volumes.back()))
+			return false;
+	}
+	return true;
+}
+
+// <width>x<height>
+static bool parseSize(const char* value, unsigned int& width, unsigned int& height)
+{
+	if (value == nullptr)
+		return false;
+
+	char* end = nullptr;
+	const unsigned long parsedWidth = std::strtoul(value, &end, 10);
+	if (end == value || *end != 'x')
+	{
+		std::cerr << "Invalid size '" << value << "'" << std::endl;
+		return false;
+	}
+
+	const char* heightString = end + 1;
+	const unsigned long parsedHeight = std::strtoul(heightString, &end, 10);
+	if (end == heightString || *end != '\0' || parsedWidth == 0 || parsedHeight == 0)
+	{
+		std::cerr << "Invalid size '" << value << "'" << std::endl;
+		return false;
+	}
+
+	width = static_cast<unsigned int>(parsedWidth);
+	height = static_cast<unsigned int>(parsedHeight);
+	return true;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+
+		auto getValue = [argc, argv, &i, option]() -> const char*
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << "Missing value for option " << option << std::endl;
+				return nullptr;
+			}
+			return argv[++i];
+		};
+
+		if (std::strcmp(option, "--help") == 0)
+		{
+			return false;
+		}
+		else if (std::strcmp(option, "--load-snapshot") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.loadSnapshotPath = value;
+		}
+		else if (std::strcmp(option, "--snapshot") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.snapshotPath = value;
+		}
+		else if (std::strcmp(option, "--record") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.recordPath = value;
+		}
+		else if (std::strcmp(option, "--record-interval") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.recordInterval) || options.recordInterval == 0)
+				return false;
+		}
+		else if (std::strcmp(option, "--record-slots") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.recordSlots) || options.recordSlots == 0)
+				return false;
+		}
+		else if (std::strcmp(option, "--play") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.playPath = value;
+		}
+		else if (std::strcmp(option, "--play-start") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.playStartFrame))
+				return false;
+		}
+		else if (std::strcmp(option, "--prefetch-frames") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.prefetchFrames))
+				return false;
+		}
+		else if (std::strcmp(option, "--points") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.pointsPath = value;
+		}
+		else if (std::strcmp(option, "--points-seed") == 0)
+		{
+			options.seedFromPoints = true;
+		}
+		else if (std::strcmp(option, "--shader-cache") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.shaderCacheDirectory = value;
+		}
+		else if (std::strcmp(option, "--no-shader-cache") == 0)
+		{
+			options.shaderCacheDirectory.clear();
+		}
+		else if (std::strcmp(option, "--particles") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.numParticles))
+				return false;
+			if (options.numParticles == 0)
+			{
+				std::cerr << "At least one particle is needed" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(option, "--lifetime") == 0)
+		{
+			if (!parseFloatList(getValue(), options.lifetime, 2))
+				return false;
+			if (options.lifetime[0] <= 0.f || options.lifetime[1] < options.lifetime[0])
+			{
+				std::cerr << "The lifetime range must be positive and ordered" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(option, "--size-over-life") == 0)
+		{
+			if (!parseFloatSequence(getValue(), options.sizeOverLife, 1))
+				return false;
+		}
+		else if (std::strcmp(option, "--color-over-life") == 0)
+		{
+			if (!parseFloatSequence(getValue(), options.colorOverLife, 4))
+				return false;
+		}
+		else if (std::strcmp(option, "--seed") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.seed))
+				return false;
+			options.fixedSeed = true;
+		}
+		else if (std::strcmp(option, "--benchmark") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.benchmarkPath = value;
+		}
+		else if (std::strcmp(option, "--offscreen") == 0)
+		{
+			if (!parseSize(getValue(), options.offscreenWidth, options.offscreenHeight))
+				return false;
+		}
+		else if (std::strcmp(option, "--frames") == 0)
+		{
+			if (!parseUnsigned(getValue(), options.maxFrames))
+				return false;
+		}
+		else if (std::strcmp(option, "--no-gl-sharing") == 0)
+		{
+			options.disableGLSharing = true;
+		}
+		else if (std::strcmp(option, "--no-spirv") == 0)
+		{
+			options.useSpirv = false;
+		}
+		else if (std::strcmp(option, "--no-curl-noise") == 0)
+		{
+			options.curlNoise = false;
+		}
+		else if (std::strcmp(option, "--curl-noise-strength") == 0)
+		{
+			if (!parseFloat(getValue(), options.curlNoiseStrength))
+				return false;
+		}
+		else if (std::strcmp(option, "--vector-field") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.vectorFields.emplace_back();
+			options.vectorFields.back().path = value;
+		}
+		else if (std::strcmp(option, "--vector-field-weight") == 0)
+		{
+			if (options.vectorFields.empty())
+			{
+				std::cerr << option << " applies to the preceding --vector-field" << std::endl;
+				return false;
+			}
+			if (!parseFloat(getValue(), options.vectorFields.back().weight))
+				return false;
+		}
+		else if (std::strcmp(option, "--vector-field-transform") == 0)
+		{
+			if (options.vectorFields.empty())
+			{
+				std::cerr << option << " applies to the preceding --vector-field" << std::endl;
+				return false;
+			}
+			if (!parseFloatList(getValue(), options.vectorFields.back().transform, 12))
+				return false;
+		}
+		else if (std::strcmp(option, "--force-volume") == 0)
+		{
+			options.forceVolumes.emplace_back();
+			if (!parseForceVolume(getValue(), options.forceVolumes.back()))
+				return false;
+		}
+		else if (std::strcmp(option, "--force-volumes") == 0)
+		{
+			if (!parseForceVolumeFile(getValue(), options.forceVolumes))
+				return false;
+		}
+		else if (std::strcmp(option, "--collider") == 0)
+		{
+			options.colliders.emplace_back();
+			if (!parseCollider(getValue(), options.colliders.back()))
+				return false;
+		}
+		else if (std::strcmp(option, "--sdf") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.sdfVolumes.emplace_back();
+			options.sdfVolumes.back().path = value;
+		}
+		else if (std::strcmp(option, "--sdf-transform") == 0)
+		{
+			if (options.sdfVolumes.empty())
+			{
+				std::cerr << option << " applies to the preceding --sdf" << std::endl;
+				return false;
+			}
+			if (!parseFloatList(getValue(), options.sdfVolumes.back().transform, 12))
+				return false;
+		}
+		else if (std::strcmp(option, "--collision-mesh") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.collisionMeshes.emplace_back();
+			options.collisionMeshes.back().path = value;
+		}
+		else if (std::strcmp(option, "--collision-mesh-transform") == 0)
+		{
+			if (options.collisionMeshes.empty())
+			{
+				std::cerr << option << " applies to the preceding --collision-mesh" << std::endl;
+				return false;
+			}
+			if (!parseFloatList(getValue(), options.collisionMeshes.back().transform, 12))
+				return false;
+		}
+		else if (std::strcmp(option, "--heightfield") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.heightfieldPath = value;
+		}
+		else if (std::strcmp(option, "--heightfield-bounds") == 0)
+		{
+			if (!parseFloatList(getValue(), options.heightfieldBounds, 6))
+				return false;
+		}
+		else if (std::strcmp(option, "--heightfield-contact") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			if (std::strcmp(value, "bounce") == 0)
+			{
+				options.heightfieldContact = HeightfieldContact::Bounce;
+			}
+			else if (std::strcmp(value, "stick") == 0)
+			{
+				options.heightfieldContact = HeightfieldContact::Stick;
+			}
+			else if (std::strcmp(value, "kill") == 0)
+			{
+				options.heightfieldContact = HeightfieldContact::Kill;
+			}
+			else
+			{
+				std::cerr << "Invalid heightfield contact '" << value << "', expected bounce, stick or kill" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(option, "--restitution") == 0)
+		{
+			if (!parseFloat(getValue(), options.restitution))
+				return false;
+		}
+		else if (std::strcmp(option, "--friction") == 0)
+		{
+			if (!parseFloat(getValue(), options.friction))
+				return false;
+		}
+		else if (std::strcmp(option, "--cl-profile") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.clBuildProfile = value;
+		}
+		else if (std::strcmp(option, "--resource-dir") == 0)
+		{
+			const char* value = getValue();
+			if (value == nullptr)
+				return false;
+			options.resourceDirectory = value;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void printUsage(const char* executableName)
+{
+	std::cout << "Usage: " << executableName << " [options]" << std::endl
+		<< "  --load-snapshot <file>  start from a saved particle snapshot" << std::endl
+		<< "  --snapshot <file>       snapshot file used by F5 (save) and F9 (load)" << std::endl
+		<< "  --record <file>         record the particles to a cache file" << std::endl
+		<< "  --record-interval <n>   record every nth frame (default 1)" << std::endl
+		<< "  --record-slots <n>      readback buffers in flight before frames are dropped (default 4)" << std::endl
+		<< "  --play <file>           play a particle cache back instead of simulating" << std::endl
+		<< "  --play-start <n>        first recorded frame to play" << std::endl
+		<< "  --prefetch-frames <n>   recorded frames read ahead during playback (default 4)" << std::endl
+		<< "  --points <file>         spawn particles on a PLY or XYZ point cloud" << std::endl
+		<< "  --points-seed           also start with the particles alive on the point cloud" << std::endl
+		<< "  --shader-cache <dir>    GL program binary cache directory (default shader_cache)" << std::endl
+		<< "  --no-shader-cache       always compile the GL shaders" << std::endl
+		<< "  --particles <n>         number of particles (default 1000000)" << std::endl
+		<< "  --lifetime <min,max>    range of the particle lifetimes in seconds (default 4,6)" << std::endl
+		<< "  --size-over-life <s0,...>  particle sizes evenly spaced over the lifetime" << std::endl
+		<< "  --color-over-life <r,g,b,a,...>  particle colours evenly spaced over the lifetime" << std::endl
+		<< "  --seed <n>              fixed random seed" << std::endl
+		<< "  --benchmark <file>      scripted offscreen run, frame time percentiles written as JSON" << std::endl
+		<< "  --offscreen <w>x<h>     render into a framebuffer through EGL, without a window (Linux)" << std::endl
+		<< "  --frames <n>            exit after n rendered frames" << std::endl
+		<< "  --no-gl-sharing         copy the particles to GL through host memory instead of sharing buffers" << std::endl
+		<< "  --no-spirv              build the kernel from source even when SPIR-V is embedded" << std::endl
+		<< "  --cl-profile <name>     OpenCL build profile: precise (default), mad, relaxed, fast, native, half" << std::endl
+		<< "  --no-curl-noise         per particle white noise instead of the curl-noise turbulence" << std::endl
+		<< "  --curl-noise-strength <a> turbulence acceleration (default 60)" << std::endl
+		<< "  --vector-field <file>   force volume, Unreal FGA or Unity VF, up to 4" << std::endl
+		<< "  --vector-field-weight <w>  blend weight of the preceding field (default 1)" << std::endl
+		<< "  --vector-field-transform <m00,...,m23>  world to field space 3x4 matrix of the preceding field" << std::endl
+		<< "  --force-volume <type:values>  attractor:x,y,z,r,a  wind:x,y,z,hx,hy,hz,ax,ay,az  vortex:x,y,z,r,hh,a, repeatable" << std::endl
+		<< "  --force-volumes <file>  one force volume per line, same syntax" << std::endl
+		<< "  --collider <type:values>  plane:nx,ny,nz,h  sphere:x,y,z,r  box:x,y,z,hx,hy,hz  capsule:ax,ay,az,bx,by,bz,r" << std::endl
+		<< "  --sdf <file>            signed distance collision volume, Unity VF_F, up to 4" << std::endl
+		<< "  --sdf-transform <m00,...,m23>  world to field space 3x4 matrix of the preceding volume" << std::endl
+		<< "  --collision-mesh <file> triangle mesh collisions, OBJ or STL, repeatable" << std::endl
+		<< "  --collision-mesh-transform <m00,...,m23>  object to world 3x4 matrix of the preceding mesh" << std::endl
+		<< "  --heightfield <file>    terrain collision from a 16 bit PGM, float PFM or raw R16 height image" << std::endl
+		<< "  --heightfield-bounds <x0,y0,z0,x1,y1,z1>  world box of the terrain (default -64,-40,-64,64,-20,64)" << std::endl
+		<< "  --heightfield-contact <mode>  bounce (default), stick or kill on terrain contact" << std::endl
+		<< "  --restitution <r>       bounciness of the collisions, 0 to 1 (default 0.4)" << std::endl
+		<< "  --friction <f>          tangential velocity lost per contact, 0 to 1 (default 0.2)" << std::endl
+		<< "  --resource-dir <dir>    load cl/, shaders/ and data/ from disk instead of the embedded copies" << std::endl;
+}
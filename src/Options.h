@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// vector field volume file (FGA or VF) with its blend weight and world to field space transform
+struct VectorFieldSource
+{
+	std::string path;
+	float weight = 1.f;
+	// rows of a 3x4 affine matrix, applied before mapping the field bounds to the volume
+	float transform[12] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f };
+};
+
+// bounded force volume, values as given to --force-volume
+enum class ForceVolumeType
+{
+	// center xyz, radius, acceleration toward the center fading out at the radius, negative to repel
+	Attractor,
+	// center xyz, half extents xyz, acceleration xyz, axis aligned
+	Wind,
+	// center xyz, radius, half height, tangential acceleration around the vertical axis fading out at the radius
+	Vortex,
+};
+
+struct ForceVolumeSource
+{
+	ForceVolumeType type = ForceVolumeType::Attractor;
+	float values[9] = {};
+};
+
+// analytic collision primitive, values as given to --collider
+enum class ColliderType
+{
+	// normal xyz, height along the normal
+	Plane,
+	// center xyz, radius
+	Sphere,
+	// center xyz, half extents xyz, axis aligned
+	Box,
+	// segment start xyz, end xyz, radius
+	Capsule,
+};
+
+struct ColliderSource
+{
+	ColliderType type = ColliderType::Plane;
+	float values[7] = {};
+};
+
+// signed distance volume file (VF_F) and its world to field space transform
+struct SdfSource
+{
+	std::string path;
+	float transform[12] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f };
+};
+
+// triangle mesh file (OBJ or STL) and its object to world transform
+struct CollisionMeshSource
+{
+	std::string path;
+	float transform[12] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f };
+};
+
+// what happens to the particles reaching the terrain
+enum class HeightfieldContact
+{
+	Bounce,
+	Stick,
+	Kill,
+};
+
+// command line options
+struct Options
+{
+	// snapshot restored at startup instead of running initParticleState
+	std::string loadSnapshotPath;
+	// snapshot written with F5 and restored with F9
+	std::string snapshotPath = "particles.snapshot";
+
+	// particle cache recording
+	std::string recordPath;
+	unsigned int recordInterval = 1;
+	unsigned int recordSlots = 4;
+
+	// particle cache playback, replaces the simulation
+	std::string playPath;
+	unsigned int playStartFrame = 0;
+	unsigned int prefetchFrames = 4;
+
+	// point cloud (PLY or XYZ) used as spawn positions, and optionally as the initial state
+	std::string pointsPath;
+	bool seedFromPoints = false;
+
+	// linked GL program cache, disabled when empty
+	std::string shaderCacheDirectory = "shader_cache";
+
+	// number of simulated particles
+	unsigned int numParticles = 1000000;
+	// range of the lifetimes drawn at spawn, in seconds
+	float lifetime[2] = { 4.f, 6.f };
+	// appearance over the normalized age, keys evenly spaced from the spawn to the death and baked into 1D textures
+	// one size per key, one RGBA colour (4 values) per key
+	std::vector<float> sizeOverLife = { 0.12f, 0.22f, 0.2f, 0.16f, 0.06f };
+	std::vector<float> colorOverLife = { 1.f, 1.f, 1.f, 1.f, 1.f, 0.9f, 0.75f, 1.f, 1.f, 0.6f, 0.35f, 0.8f, 0.6f, 0.25f, 0.15f, 0.f };
+	// fixed seed for the kernel random streams, seeded from the clock otherwise
+	unsigned int seed = 0;
+	bool fixedSeed = false;
+
+	// benchmark run written as JSON: fixed time step, scripted camera, offscreen unless a size is given
+	std::string benchmarkPath;
+
+	// headless EGL rendering into a framebuffer object, disabled when 0
+	unsigned int offscreenWidth = 0;
+	unsigned int offscreenHeight = 0;
+	// stop after this many rendered frames, 0 runs until the window is closed
+	unsigned int maxFrames = 0;
+
+	// copy the particles through host memory even when cl_khr_gl_sharing is available
+	bool disableGLSharing = false;
+
+	// load the offline compiled SPIR-V kernel when it is embedded and the device supports it
+	bool useSpirv = true;
+
+	// OpenCL compiler option set, see src/BuildProfiles.h
+	std::string clBuildProfile = "precise";
+
+	// coherent turbulence sampled from a baked curl-noise volume instead of per particle white noise
+	// needs image support, the white noise is kept otherwise
+	bool curlNoise = true;
+	float curlNoiseStrength = 60.f;
+
+	// forces from vector field volumes, blended by weight
+	std::vector<VectorFieldSource> vectorFields;
+	// attractors, wind boxes and vortices, binned into a uniform grid so that each particle only evaluates the nearby ones
+	std::vector<ForceVolumeSource> forceVolumes;
+
+	// static collision geometry, analytic primitives and signed distance volumes
+	std::vector<ColliderSource> colliders;
+	std::vector<SdfSource> sdfVolumes;
+	// triangle meshes merged into one hierarchy, traced by a separate stage after the update
+	std::vector<CollisionMeshSource> collisionMeshes;
+	// terrain collision: a height image over the x/z bounds, its darkest value at the minimum y and its brightest at the maximum y
+	std::string heightfieldPath;
+	// min x, y, z, max x, y, z
+	float heightfieldBounds[6] = { -64.f, -40.f, -64.f, 64.f, -20.f, 64.f };
+	HeightfieldContact heightfieldContact = HeightfieldContact::Bounce;
+
+	// fraction of the normal velocity kept, and of the tangential velocity lost, on contact
+	float restitution = 0.4f;
+	float friction = 0.2f;
+
+	// development override loading the kernel, shaders and textures from disk instead of the embedded copies
+	std::string resourceDirectory;
+};
+
+bool parseOptions(int argc, char* argv[], Options& options);
+void printUsage(const char* executableName);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+// particle cache file layout:
+//   ParticleCacheHeader
+//   one chunk per recorded frame: ParticleCacheFrameHeader followed by numParticles CachedParticle
+//   ParticleCacheIndexEntry[numFrames]
+//   ParticleCacheFooter
+// chunks start on PARTICLE_CACHE_CHUNK_ALIGNMENT so they can be uploaded straight from a mapping
+
+#define PARTICLE_CACHE_MAGIC "CLGLCACH"
+#define PARTICLE_CACHE_FRAME_MAGIC 0x4D415246u // "FRAM"
+#define PARTICLE_CACHE_VERSION 2
+#define PARTICLE_CACHE_CHUNK_ALIGNMENT 4096
+
+struct ParticleCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numParticles;
+	uint32_t frameInterval;
+	uint32_t cachedParticleSize;
+};
+
+struct ParticleCacheFrameHeader
+{
+	uint32_t magic;
+	uint32_t frameIndex;
+	double simulationTime;
+	// positions are quantized to 16 bits inside these bounds
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t payloadSize;
+};
+
+// quantized render state of a particle
+struct CachedParticle
+{
+	uint16_t position[3];
+	uint8_t isAlive;
+	// normalized age quantized to 8 bits, 0 for dead particles, 1 to 255 over the lifetime
+	uint8_t age;
+};
+
+struct ParticleCacheIndexEntry
+{
+	uint64_t offset;
+	uint32_t frameIndex;
+	uint32_t reserved;
+	double simulationTime;
+};
+
+struct ParticleCacheFooter
+{
+	uint64_t indexOffset;
+	uint64_t numFrames;
+	char magic[8];
+};
+
+static_assert(sizeof(CachedParticle) == 8, "CachedParticle must stay tightly packed");
+static_assert(sizeof(ParticleCacheFrameHeader) % 8 == 0, "ParticleCacheFrameHeader must not need padding");
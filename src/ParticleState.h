@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include "CLUtils.h"
+
+// host side mirror of the ParticleState struct in cl/particle.cl
+// any change to one of them must be reflected in the other and bump PARTICLE_STATE_LAYOUT_VERSION
+struct ParticleState
+{
+	cl_float3 position;
+	cl_float3 velocity;
+	cl_float spawnTime;
+	cl_uchar isAlive;
+	cl_uchar padding[3];
+	cl_float lifetime;
+	cl_uchar padding2[4];
+	cl_float3 previousPosition;
+};
+
+#define PARTICLE_STATE_LAYOUT_VERSION 3
+
+static_assert(sizeof(ParticleState) == 64, "ParticleState must match the OpenCL struct size");
+static_assert(offsetof(ParticleState, velocity) == 16, "ParticleState::velocity offset mismatch");
+static_assert(offsetof(ParticleState, spawnTime) == 32, "ParticleState::spawnTime offset mismatch");
+static_assert(offsetof(ParticleState, isAlive) == 36, "ParticleState::isAlive offset mismatch");
+static_assert(offsetof(ParticleState, lifetime) == 40, "ParticleState::lifetime offset mismatch");
+static_assert(offsetof(ParticleState, previousPosition) == 48, "ParticleState::previousPosition offset mismatch");
@@ -0,0 +1,478 @@
+#include "PointCloud.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// run task(0) .. task(numTasks - 1) on up to numThreads threads
+template <class Task>
+static void parallelFor(size_t numTasks, unsigned int numThreads, const Task& task)
+{
+	std::atomic<size_t> nextTask(0);
+	auto worker = [&nextTask, numTasks, &task]()
+	{
+		for (size_t i = nextTask++; i < numTasks; i = nextTask++)
+		{
+			task(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const size_t numWorkers = std::min<size_t>(std::max(numThreads, 1u), numTasks);
+	for (size_t i = 1; i < numWorkers; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+static bool isSeparator(char c)
+{
+	return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+// a line holding an element, blank lines and # comments are skipped
+static bool isPointLine(const char* line, const char* lineEnd)
+{
+	while (line < lineEnd && isSeparator(*line))
+		++line;
+	return line < lineEnd && *line != '#';
+}
+
+// locale independent float parser that never reads past end
+static float parseFloat(const char*& p, const char* end)
+{
+	double sign = 1.0;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		sign = *p == '-' ? -1.0 : 1.0;
+		++p;
+	}
+
+	double value = 0.0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10.0 + (*p - '0');
+		++p;
+	}
+
+	if (p < end && *p == '.')
+	{
+		++p;
+		double scale = 0.1;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			value += (*p - '0') * scale;
+			scale *= 0.1;
+			++p;
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		int exponentSign = 1;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			exponentSign = *p == '-' ? -1 : 1;
+			++p;
+		}
+		int exponent = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			exponent = exponent * 10 + (*p - '0');
+			++p;
+		}
+		double power = 1.0;
+		for (int i = 0; i < exponent; ++i)
+			power *= 10.0;
+		value = exponentSign > 0 ? value * power : value / power;
+	}
+
+	return static_cast<float>(sign * value);
+}
+
+bool PointCloud::open(const std::string& filePath)
+{
+	close();
+
+	if (!file.open(filePath))
+	{
+		return false;
+	}
+
+	const unsigned int numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	const char* data = reinterpret_cast<const char*>(file.getData());
+	const bool isPly = file.getSize() >= 4 && std::memcmp(data, "ply", 3) == 0 && (data[3] == '\n' || data[3] == '\r');
+	if (isPly)
+	{
+		if (!parsePlyHeader(filePath))
+		{
+			close();
+			return false;
+		}
+
+		if (format == Format::PlyAscii)
+		{
+			const size_t numVertices = numPoints;
+			countAsciiPoints(numThreads);
+			if (numPoints < numVertices)
+			{
+				std::cerr << "Point cloud '" << filePath << "' is truncated" << std::endl;
+				close();
+				return false;
+			}
+			numPoints = numVertices;
+		}
+		else if (dataOffset + numPoints * vertexSize > file.getSize())
+		{
+			std::cerr << "Point cloud '" << filePath << "' is truncated" << std::endl;
+			close();
+			return false;
+		}
+	}
+	else
+	{
+		format = Format::Xyz;
+		dataOffset = 0;
+		countAsciiPoints(numThreads);
+	}
+
+	if (numPoints == 0)
+	{
+		std::cerr << "Point cloud '" << filePath << "' holds no point" << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void PointCloud::close()
+{
+	file.close();
+	numPoints = 0;
+	dataOffset = 0;
+	dataEnd = 0;
+	vertexSize = 0;
+	chunkOffsets.clear();
+	chunkFirstPoints.clear();
+}
+
+bool PointCloud::parsePlyHeader(const std::string& filePath)
+{
+	const char* data = reinterpret_cast<const char*>(file.getData());
+	const size_t size = file.getSize();
+
+	static const char endHeader[] = "end_header";
+	bool formatFound = false;
+	bool vertexElementFound = false;
+	bool inVertexElement = false;
+	bool hasPropertyList = false;
+	int axisFound[3] = { 0, 0, 0 };
+	unsigned int propertyIndex = 0;
+	size_t offset = 0;
+
+	while (offset < size)
+	{
+		const char* lineStart = data + offset;
+		const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', size - offset));
+		if (lineEnd == nullptr)
+			break;
+		offset = lineEnd - data + 1;
+
+		std::string line(lineStart, lineEnd);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		if (line == endHeader)
+		{
+			dataOffset = offset;
+			break;
+		}
+
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+
+		if (keyword == "format")
+		{
+			std::string formatName;
+			tokens >> formatName;
+			if (formatName == "ascii")
+				format = Format::PlyAscii;
+			else if (formatName == "binary_little_endian")
+				format = Format::PlyBinaryLittleEndian;
+			else if (formatName == "binary_big_endian")
+				format = Format::PlyBinaryBigEndian;
+			else
+			{
+				std::cerr << "Point cloud '" << filePath << "' has unknown PLY format " << formatName << std::endl;
+				return false;
+			}
+			formatFound = true;
+		}
+		else if (keyword == "element")
+		{
+			std::string elementName;
+			size_t count = 0;
+			tokens >> elementName >> count;
+			inVertexElement = elementName == "vertex";
+			if (inVertexElement)
+			{
+				vertexElementFound = true;
+				numPoints = count;
+			}
+			else if (!vertexElementFound)
+			{
+				std::cerr << "Point cloud '" << filePath << "': the vertex element must come first" << std::endl;
+				return false;
+			}
+		}
+		else if (keyword == "property" && inVertexElement)
+		{
+			std::string typeName;
+			std::string name;
+			tokens >> typeName >> name;
+
+			if (typeName == "list")
+			{
+				hasPropertyList = true;
+				++propertyIndex;
+				continue;
+			}
+
+			PropertyType type;
+			size_t typeSize;
+			if (typeName == "char" || typeName == "int8") { type = PropertyType::Int8; typeSize = 1; }
+			else if (typeName == "uchar" || typeName == "uint8") { type = PropertyType::Uint8; typeSize = 1; }
+			else if (typeName == "short" || typeName == "int16") { type = PropertyType::Int16; typeSize = 2; }
+			else if (typeName == "ushort" || typeName == "uint16") { type = PropertyType::Uint16; typeSize = 2; }
+			else if (typeName == "int" || typeName == "int32") { type = PropertyType::Int32; typeSize = 4; }
+			else if (typeName == "uint" || typeName == "uint32") { type = PropertyType::Uint32; typeSize = 4; }
+			else if (typeName == "float" || typeName == "float32") { type = PropertyType::Float32; typeSize = 4; }
+			else if (typeName == "double" || typeName == "float64") { type = PropertyType::Float64; typeSize = 8; }
+			else
+			{
+				std::cerr << "Point cloud '" << filePath << "' has unknown PLY property type " << typeName << std::endl;
+				return false;
+			}
+
+			const int axis = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+			if (axis >= 0)
+			{
+				// a list takes a count and that many values on each line, the columns after it are not fixed
+				if (hasPropertyList)
+				{
+					std::cerr << "Point cloud '" << filePath << "': list properties before the " << name << " property are not supported" << std::endl;
+					return false;
+				}
+				axisFound[axis] = 1;
+				propertyOffsets[axis] = vertexSize;
+				propertyTypes[axis] = type;
+				propertyColumns[axis] = propertyIndex;
+			}
+			vertexSize += typeSize;
+			++propertyIndex;
+		}
+	}
+
+	if (dataOffset == 0 || !formatFound || !vertexElementFound)
+	{
+		std::cerr << "Point cloud '" << filePath << "' has an invalid PLY header" << std::endl;
+		return false;
+	}
+
+	if (!axisFound[0] || !axisFound[1] || !axisFound[2])
+	{
+		std::cerr << "Point cloud '" << filePath << "' has no x, y and z vertex properties" << std::endl;
+		return false;
+	}
+
+	if (hasPropertyList && format != Format::PlyAscii)
+	{
+		std::cerr << "Point cloud '" << filePath << "': binary vertices with list properties are not supported" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool PointCloud::countAsciiPoints(unsigned int numThreads)
+{
+	const char* data = reinterpret_cast<const char*>(file.getData());
+	const size_t size = file.getSize();
+	dataEnd = size;
+
+	// split the data in chunks starting on a line
+	const size_t numChunks = static_cast<size_t>(numThreads) * 4;
+	const size_t chunkSize = std::max<size_t>((size - dataOffset) / numChunks, 1);
+	chunkOffsets.clear();
+	chunkOffsets.push_back(dataOffset);
+	for (size_t offset = dataOffset + chunkSize; offset < size; offset += chunkSize)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(data + offset, '\n', size - offset));
+		if (lineEnd == nullptr)
+			break;
+		const size_t chunkOffset = lineEnd - data + 1;
+		if (chunkOffset > chunkOffsets.back() && chunkOffset < size)
+		{
+			chunkOffsets.push_back(chunkOffset);
+			offset = chunkOffset;
+		}
+	}
+
+	// count the points of each chunk
+	std::vector<size_t> chunkNumPoints(chunkOffsets.size(), 0);
+	parallelFor(chunkOffsets.size(), numThreads, [this, data, size, &chunkNumPoints](size_t chunk)
+	{
+		const char* line = data + chunkOffsets[chunk];
+		const char* chunkEnd = data + (chunk + 1 < chunkOffsets.size() ? chunkOffsets[chunk + 1] : size);
+		size_t count = 0;
+		while (line < chunkEnd)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', chunkEnd - line));
+			if (lineEnd == nullptr)
+				lineEnd = chunkEnd;
+			if (isPointLine(line, lineEnd))
+				++count;
+			line = lineEnd + 1;
+		}
+		chunkNumPoints[chunk] = count;
+	});
+
+	chunkFirstPoints.resize(chunkOffsets.size());
+	numPoints = 0;
+	for (size_t chunk = 0; chunk < chunkOffsets.size(); ++chunk)
+	{
+		chunkFirstPoints[chunk] = numPoints;
+		numPoints += chunkNumPoints[chunk];
+	}
+
+	return true;
+}
+
+size_t PointCloud::read(float* output, size_t outputStride, size_t step, unsigned int numThreads)
+{
+	if (!file.isOpen())
+	{
+		return 0;
+	}
+
+	step = std::max<size_t>(step, 1);
+	if (format == Format::PlyBinaryLittleEndian || format == Format::PlyBinaryBigEndian)
+	{
+		return readBinary(output, outputStride, step, numThreads);
+	}
+	return readAscii(output, outputStride, step, numThreads);
+}
+
+size_t PointCloud::readBinary(float* output, size_t outputStride, size_t step, unsigned int numThreads) const
+{
+	const size_t numOutputPoints = (numPoints + step - 1) / step;
+	const size_t pointsPerTask = 1 << 16;
+	const size_t numTasks = (numOutputPoints + pointsPerTask - 1) / pointsPerTask;
+	const unsigned char* vertices = file.getData() + dataOffset;
+
+	parallelFor(numTasks, numThreads, [this, output, outputStride, step, numOutputPoints, pointsPerTask, vertices](size_t task)
+	{
+		const size_t end = std::min((task + 1) * pointsPerTask, numOutputPoints);
+		for (size_t i = task * pointsPerTask; i < end; ++i)
+		{
+			const unsigned char* vertex = vertices + i * step * vertexSize;
+			float* position = output + i * outputStride;
+			position[0] = readBinaryProperty(vertex, 0);
+			position[1] = readBinaryProperty(vertex, 1);
+			position[2] = readBinaryProperty(vertex, 2);
+		}
+	});
+
+	return numOutputPoints;
+}
+
+float PointCloud::readBinaryProperty(const unsigned char* vertex, int axis) const
+{
+	unsigned char bytes[8];
+	const PropertyType type = propertyTypes[axis];
+	const size_t typeSize = type == PropertyType::Float64 ? 8
+		: type == PropertyType::Int32 || type == PropertyType::Uint32 || type == PropertyType::Float32 ? 4
+		: type == PropertyType::Int16 || type == PropertyType::Uint16 ? 2
+		: 1;
+
+	std::memcpy(bytes, vertex + propertyOffsets[axis], typeSize);
+	if (format == Format::PlyBinaryBigEndian)
+	{
+		std::reverse(bytes, bytes + typeSize);
+	}
+
+	switch (type)
+	{
+	case PropertyType::Int8: { int8_t value; std::memcpy(&value, bytes, 1); return static_cast<float>(value); }
+	case PropertyType::Uint8: { uint8_t value; std::memcpy(&value, bytes, 1); return static_cast<float>(value); }
+	case PropertyType::Int16: { int16_t value; std::memcpy(&value, bytes, 2); return static_cast<float>(value); }
+	case PropertyType::Uint16: { uint16_t value; std::memcpy(&value, bytes, 2); return static_cast<float>(value); }
+	case PropertyType::Int32: { int32_t value; std::memcpy(&value, bytes, 4); return static_cast<float>(value); }
+	case PropertyType::Uint32: { uint32_t value; std::memcpy(&value, bytes, 4); return static_cast<float>(value); }
+	case PropertyType::Float32: { float value; std::memcpy(&value, bytes, 4); return value; }
+	case PropertyType::Float64: { double value; std::memcpy(&value, bytes, 8); return static_cast<float>(value); }
+	}
+	return 0.f;
+}
+
+size_t PointCloud::readAscii(float* output, size_t outputStride, size_t step, unsigned int numThreads) const
+{
+	const char* data = reinterpret_cast<const char*>(file.getData());
+	const unsigned int lastColumn = std::max(propertyColumns[0], std::max(propertyColumns[1], propertyColumns[2]));
+
+	parallelFor(chunkOffsets.size(), numThreads, [this, data, output, outputStride, step, lastColumn](size_t chunk)
+	{
+		const char* line = data + chunkOffsets[chunk];
+		const char* chunkEnd = data + (chunk + 1 < chunkOffsets.size() ? chunkOffsets[chunk + 1] : dataEnd);
+		size_t pointIndex = chunkFirstPoints[chunk];
+
+		while (line < chunkEnd && pointIndex < numPoints)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', chunkEnd - line));
+			if (lineEnd == nullptr)
+				lineEnd = chunkEnd;
+
+			if (isPointLine(line, lineEnd))
+			{
+				if (pointIndex % step == 0)
+				{
+					float* position = output + (pointIndex / step) * outputStride;
+					position[0] = position[1] = position[2] = 0.f;
+
+					const char* p = line;
+					for (unsigned int column = 0; column <= lastColumn && p < lineEnd; ++column)
+					{
+						while (p < lineEnd && isSeparator(*p))
+							++p;
+
+						const int axis = column == propertyColumns[0] ? 0 : column == propertyColumns[1] ? 1 : column == propertyColumns[2] ? 2 : -1;
+						if (axis >= 0)
+						{
+							position[axis] = parseFloat(p, lineEnd);
+						}
+						while (p < lineEnd && !isSeparator(*p))
+							++p;
+					}
+				}
+				++pointIndex;
+			}
+
+			line = lineEnd + 1;
+		}
+	});
+
+	return (numPoints + step - 1) / step;
+}
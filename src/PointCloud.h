@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// memory mapped point cloud reader for PLY (ascii, binary little and big endian) and XYZ files
+// the vertex positions are parsed in parallel chunks straight into the caller's buffer
+class PointCloud
+{
+public:
+	bool open(const std::string& filePath);
+	void close();
+
+	size_t getNumPoints() const { return numPoints; }
+
+	// write every step-th point as x, y, z at output + i * outputStride floats
+	// returns the number of points written
+	size_t read(float* output, size_t outputStride, size_t step, unsigned int numThreads);
+
+private:
+	enum class Format
+	{
+		Xyz,
+		PlyAscii,
+		PlyBinaryLittleEndian,
+		PlyBinaryBigEndian
+	};
+
+	enum class PropertyType
+	{
+		Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64
+	};
+
+	bool parsePlyHeader(const std::string& filePath);
+	bool countAsciiPoints(unsigned int numThreads);
+	size_t readBinary(float* output, size_t outputStride, size_t step, unsigned int numThreads) const;
+	size_t readAscii(float* output, size_t outputStride, size_t step, unsigned int numThreads) const;
+	float readBinaryProperty(const unsigned char* record, int axis) const;
+
+	MappedFile file;
+	Format format = Format::Xyz;
+	size_t numPoints = 0;
+
+	// start of the vertex data
+	size_t dataOffset = 0;
+	// end of the vertex data for ascii formats
+	size_t dataEnd = 0;
+
+	// binary vertex layout
+	size_t vertexSize = 0;
+	size_t propertyOffsets[3] = {};
+	PropertyType propertyTypes[3] = {};
+
+	// ascii vertex layout: column of x, y and z in a line
+	unsigned int propertyColumns[3] = { 0, 1, 2 };
+
+	// ascii chunks and the index of their first point
+	std::vector<size_t> chunkOffsets;
+	std::vector<size_t> chunkFirstPoints;
+};
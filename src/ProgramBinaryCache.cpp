@@ -0,0 +1,147 @@
+#include "ProgramBinaryCache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#define PROGRAM_BINARY_MAGIC "CLGLPBIN"
+
+struct ProgramBinaryHeader
+{
+	char magic[8];
+	uint32_t binaryFormat;
+	uint32_t binaryLength;
+};
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char* string)
+{
+	// include the terminator so that concatenations do not collide
+	return hashBytes(hash, string, string != nullptr ? std::strlen(string) + 1 : 0);
+}
+
+static uint64_t getCacheKey(const std::vector<std::string>& sources)
+{
+	uint64_t key = 14695981039346656037ULL;
+	key = hashString(key, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+	key = hashString(key, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+	key = hashString(key, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+	for (const std::string& source : sources)
+	{
+		key = hashString(key, source.c_str());
+	}
+	return key;
+}
+
+bool isProgramBinaryCacheSupported()
+{
+	if (!GLEW_ARB_get_program_binary)
+	{
+		return false;
+	}
+
+	GLint numBinaryFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
+	return numBinaryFormats > 0;
+}
+
+std::string getProgramBinaryCachePath(const std::string& cacheDirectory, const std::vector<std::string>& sources)
+{
+	char fileName[64];
+	std::snprintf(fileName, sizeof(fileName), "program-%016llx.bin", static_cast<unsigned long long>(getCacheKey(sources)));
+	return (std::filesystem::path(cacheDirectory) / fileName).string();
+}
+
+GLuint loadProgramBinary(const std::string& filePath)
+{
+	FILE* file = std::fopen(filePath.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return 0;
+	}
+
+	ProgramBinaryHeader header;
+	std::vector<unsigned char> binary;
+	bool success = std::fread(&header, sizeof(header), 1, file) == 1
+		&& std::memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) == 0;
+	if (success)
+	{
+		binary.resize(header.binaryLength);
+		success = !binary.empty() && std::fread(binary.data(), binary.size(), 1, file) == 1;
+	}
+	std::fclose(file);
+
+	if (!success)
+	{
+		std::cerr << "Warning: ignoring invalid program binary '" << filePath << "'" << std::endl;
+		return 0;
+	}
+
+	GLuint programId = glCreateProgram();
+	glProgramBinary(programId, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+	// the driver rejects binaries from another driver version
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+	if (!linkStatus)
+	{
+		std::cerr << "Warning: program binary '" << filePath << "' rejected by the driver, recompiling" << std::endl;
+		glDeleteProgram(programId);
+		return 0;
+	}
+
+	return programId;
+}
+
+bool saveProgramBinary(const std::string& filePath, GLuint programId)
+{
+	GLint binaryLength = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength <= 0)
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> binary(binaryLength);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(programId, binaryLength, nullptr, &binaryFormat, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(filePath).parent_path(), error);
+
+	FILE* file = std::fopen(filePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cerr << "Warning: could not write program binary '" << filePath << "'" << std::endl;
+		return false;
+	}
+
+	ProgramBinaryHeader header = {};
+	std::memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+	header.binaryFormat = binaryFormat;
+	header.binaryLength = static_cast<uint32_t>(binaryLength);
+
+	bool success = std::fwrite(&header, sizeof(header), 1, file) == 1
+		&& std::fwrite(binary.data(), binary.size(), 1, file) == 1;
+	success = std::fclose(file) == 0 && success;
+
+	if (!success)
+	{
+		std::cerr << "Warning: could not write program binary '" << filePath << "'" << std::endl;
+		std::remove(filePath.c_str());
+	}
+	return success;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// linked GL program cache based on glGetProgramBinary / glProgramBinary (GL_ARB_get_program_binary)
+// entries are keyed by the GL vendor, renderer and version and a hash of the shader sources
+
+bool isProgramBinaryCacheSupported();
+
+// cache file of a program for the current GL context
+std::string getProgramBinaryCachePath(const std::string& cacheDirectory, const std::vector<std::string>& sources);
+
+// returns a linked program, or 0 if the entry is missing or the driver rejects it
+GLuint loadProgramBinary(const std::string& filePath);
+
+// the program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+bool saveProgramBinary(const std::string& filePath, GLuint programId);
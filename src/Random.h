@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// host side PCG32 stream, same generator as in cl/particle.cl
+// used to produce the per frame kernel seeds so that the whole stream can be saved and restored
+struct Pcg32
+{
+	uint64_t state = 0;
+	uint64_t inc = 1;
+
+	void seed(uint64_t initState, uint64_t initSeq)
+	{
+		state = 0U;
+		inc = (initSeq << 1u) | 1u;
+		next();
+		state += initState;
+		next();
+	}
+
+	uint32_t next()
+	{
+		uint64_t oldState = state;
+		state = oldState * 6364136223846793005ULL + (inc | 1);
+		uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+		uint32_t rot = static_cast<uint32_t>(oldState >> 59u);
+		return (xorShifted >> rot) | (xorShifted << ((0u - rot) & 31));
+	}
+
+	// non negative seed for the kernels, same range as rand()
+	int32_t nextSeed()
+	{
+		return static_cast<int32_t>(next() >> 1);
+	}
+};
@@ -0,0 +1,65 @@
+#include "Resources.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "EmbeddedResources.h"
+
+static std::string initResourceDirectory()
+{
+	const char* directory = std::getenv("CLGLPARTICLES_RESOURCE_DIR");
+	return directory != nullptr ? directory : "";
+}
+
+static std::string resourceDirectory = initResourceDirectory();
+
+void setResourceDirectory(const std::string& directory)
+{
+	resourceDirectory = directory;
+}
+
+const std::string& getResourceDirectory()
+{
+	return resourceDirectory;
+}
+
+bool loadResource(const std::string& path, std::string& contents)
+{
+	if (!resourceDirectory.empty())
+	{
+		const std::string filePath = resourceDirectory + "/" + path;
+		std::ifstream file(filePath.c_str(), std::ifstream::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Unable to open file '" << filePath << "'" << std::endl;
+			return false;
+		}
+
+		std::stringstream buffer;
+		buffer << file.rdbuf();
+		contents = buffer.str();
+		return true;
+	}
+
+	if (loadEmbeddedResource(path, contents))
+	{
+		return true;
+	}
+
+	std::cerr << "Resource '" << path << "' is not embedded in the executable" << std::endl;
+	return false;
+}
+
+bool loadEmbeddedResource(const std::string& path, std::string& contents)
+{
+	for (const embedded::Resource& resource : embedded::resources)
+	{
+		if (path == resource.path)
+		{
+			contents.assign(reinterpret_cast<const char*>(resource.data), resource.size);
+			return true;
+		}
+	}
+	return false;
+}
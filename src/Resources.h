@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+// kernel, shader and texture files are embedded in the executable at build time
+// setting a resource directory is a development override loading them from disk instead
+// (also set by the CLGLPARTICLES_RESOURCE_DIR environment variable)
+void setResourceDirectory(const std::string& directory);
+const std::string& getResourceDirectory();
+
+// resource paths are relative to the repository root, e.g. "cl/particle.cl"
+// prints an error and returns false if the resource cannot be found
+bool loadResource(const std::string& path, std::string& contents);
+
+// quiet lookup of an embedded resource, ignores the resource directory
+// used for optional build artifacts such as the offline compiled SPIR-V kernel
+bool loadEmbeddedResource(const std::string& path, std::string& contents);
@@ -0,0 +1,642 @@
+#include "Simulation.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "CacheRecorder.h"
+#include "Colliders.h"
+#include "CurlNoise.h"
+#include "ForceVolumes.h"
+#include "Heightfield.h"
+#include "MeshBvh.h"
+#include "Snapshot.h"
+#include "VectorField.h"
+
+Simulation::~Simulation()
+{
+	stop();
+}
+
+bool Simulation::start(
+	const cl::Context& context,
+	const cl::Device& device,
+	const cl::Program& program,
+	bool glSharing,
+	const cl::Buffer& particleStateBuffer,
+	size_t numParticles,
+	float spawnRate,
+	const cl::Buffer& spawnPointsBuffer,
+	cl_uint numSpawnPoints,
+	double simulationTime,
+	const Pcg32& rng,
+	CacheRecorder* cacheRecorder,
+	const std::string& snapshotPath,
+	bool runThread,
+	bool profiling)
+{
+	stop();
+
+	if (!glSharing && !GLEW_ARB_buffer_storage)
+	{
+		std::cerr << "Copying the particles without GL sharing requires GL_ARB_buffer_storage" << std::endl;
+		return false;
+	}
+
+	this->glSharing = glSharing;
+	this->particleStateBuffer = particleStateBuffer;
+	this->globalWorkSize = cl::NDRange(numParticles);
+	this->numParticles = numParticles;
+	this->spawnRate = spawnRate;
+	pendingSpawns = 0.0;
+	this->simulationTime = simulationTime;
+	this->rng = rng;
+	this->cacheRecorder = cacheRecorder;
+	this->snapshotPath = snapshotPath;
+	this->profiling = profiling;
+	lastStepTimings = StepTimings();
+
+	cl_int code;
+
+	// per step event graph, falls back to an in-order queue where commands cannot overlap
+	cl_command_queue_properties queueProperties = device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+	if (profiling)
+	{
+		queueProperties |= CL_QUEUE_PROFILING_ENABLE;
+	}
+	commandQueue = cl::CommandQueue(context, device, queueProperties, &code);
+	if (!checkErrorCode(code, "cl::CommandQueue"))
+		return false;
+	stateReadEvents.clear();
+
+	// spawn kernel
+	spawnParticleKernel = cl::Kernel(program, "spawnParticle", &code);
+	if (!checkErrorCode(code, "cl::Kernel"))
+		return false;
+
+	size_t spawnParticleKernelWorkGroupSize = spawnParticleKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device, &code);
+	if (!checkErrorCode(code, "getWorkGroupInfo"))
+		return false;
+
+	code = spawnParticleKernel.setArg(0, particleStateBuffer);
+	code |= spawnParticleKernel.setArg(1, spawnParticleKernelWorkGroupSize * sizeof(cl_uchar), nullptr);
+	code |= spawnParticleKernel.setArg(5, spawnPointsBuffer);
+	code |= spawnParticleKernel.setArg(6, numSpawnPoints);
+	code |= spawnParticleKernel.setArg(7, lifetimeRange);
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	// update and death kernels
+	updateParticleStateKernel = cl::Kernel(program, "updateParticleState", &code);
+	if (!checkErrorCode(code, "cl::Kernel"))
+		return false;
+
+	code = updateParticleStateKernel.setArg(0, particleStateBuffer);
+	cl_uint updateArgIndex = 3;
+	if (curlNoiseVolume() != nullptr)
+	{
+		code |= updateParticleStateKernel.setArg(3, curlNoiseVolume);
+		code |= updateParticleStateKernel.setArg(5, curlNoiseStrength);
+		updateArgIndex = 6;
+	}
+	vectorFieldsEnabled = false;
+	if (vectorFields != nullptr && vectorFields->getNumFields() > 0)
+	{
+		// the images are bound once uploaded, the upload queue is not ordered with this one
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, vectorFields->getParamsBuffer());
+		vectorFieldImagesArgIndex = updateArgIndex;
+		for (size_t i = 0; i < vectorFields->getNumFields(); ++i)
+		{
+			code |= updateParticleStateKernel.setArg(updateArgIndex++, vectorFields->getPlaceholderImage());
+		}
+	}
+	if (forceVolumes != nullptr)
+	{
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, forceVolumes->getGridBuffer());
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, forceVolumes->getVolumesBuffer());
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, forceVolumes->getCellsBuffer());
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, forceVolumes->getIndicesBuffer());
+	}
+	if (colliders != nullptr && colliders->getNumColliders() > 0)
+	{
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, colliders->getCollidersBuffer());
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, static_cast<cl_int>(colliders->getNumColliders()));
+	}
+	if (colliders != nullptr && colliders->getNumSdfVolumes() > 0)
+	{
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, colliders->getSdfParamsBuffer());
+		for (size_t i = 0; i < colliders->getNumSdfVolumes(); ++i)
+		{
+			code |= updateParticleStateKernel.setArg(updateArgIndex++, colliders->getSdfVolume(i));
+		}
+	}
+	if (heightfield != nullptr)
+	{
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, heightfield->getParamsBuffer());
+		code |= updateParticleStateKernel.setArg(updateArgIndex++, heightfield->getImage());
+	}
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	if (meshBvh != nullptr)
+	{
+		collideParticlesWithMeshKernel = cl::Kernel(program, "collideParticlesWithMesh", &code);
+		if (!checkErrorCode(code, "cl::Kernel"))
+			return false;
+
+		code = collideParticlesWithMeshKernel.setArg(0, particleStateBuffer);
+		code |= collideParticlesWithMeshKernel.setArg(1, meshBvh->getNodesBuffer());
+		code |= collideParticlesWithMeshKernel.setArg(2, meshBvh->getTrianglesBuffer());
+		code |= collideParticlesWithMeshKernel.setArg(3, meshRestitution);
+		code |= collideParticlesWithMeshKernel.setArg(4, meshFriction);
+		if (!checkErrorCode(code, "setArg"))
+			return false;
+	}
+
+	checkParticleDeathKernel = cl::Kernel(program, "checkParticleDeath", &code);
+	if (!checkErrorCode(code, "cl::Kernel"))
+		return false;
+
+	code = checkParticleDeathKernel.setArg(0, particleStateBuffer);
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	// render records shared with GL, 16 bytes per particle instead of the whole state
+	packRenderStateKernel = cl::Kernel(program, "packRenderState", &code);
+	if (!checkErrorCode(code, "cl::Kernel"))
+		return false;
+
+	code = packRenderStateKernel.setArg(0, particleStateBuffer);
+	code |= packRenderStateKernel.setArg(2, static_cast<cl_float>(simulationTime));
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	const size_t slotSize = numParticles * sizeof(cl_float4);
+	glGenBuffers(NUM_SLOTS, slotBuffers);
+	for (unsigned int i = 0; i < NUM_SLOTS; ++i)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, slotBuffers[i]);
+		if (glSharing)
+		{
+			glBufferData(GL_ARRAY_BUFFER, slotSize, nullptr, GL_DYNAMIC_DRAW);
+			slotBuffersCl[i] = cl::BufferGL(context, CL_MEM_WRITE_ONLY, slotBuffers[i], &code);
+			if (!checkErrorCode(code, "cl::BufferGL"))
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				stop();
+				return false;
+			}
+		}
+		else
+		{
+			// written by the simulation thread through the mapping, coherent so that no flush is needed before drawing
+			const GLbitfield storageFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, slotSize, nullptr, storageFlags);
+			mappedSlots[i] = glMapBufferRange(GL_ARRAY_BUFFER, 0, slotSize, storageFlags);
+			if (mappedSlots[i] == nullptr)
+			{
+				std::cerr << "Could not map the particle render buffer" << std::endl;
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				stop();
+				return false;
+			}
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glFinish();
+
+	if (!glSharing)
+	{
+		packedRenderStateBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, slotSize, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Buffer"))
+		{
+			stop();
+			return false;
+		}
+	}
+
+	// the render thread starts with the initial state in the front slot
+	frontSlot = 0;
+	middleSlot = 1;
+	backSlot = 2;
+	if (glSharing)
+	{
+		if (!packRenderState(frontSlot, {}))
+		{
+			stop();
+			return false;
+		}
+	}
+	else
+	{
+		cl::Event transferEvent;
+		if (!transferRenderState(frontSlot, {}, &transferEvent) || !checkErrorCode(transferEvent.wait(), "wait"))
+		{
+			stop();
+			return false;
+		}
+	}
+
+	stopRequested = false;
+	failed = false;
+	numSteps = 0;
+	if (runThread)
+	{
+		thread = std::thread(&Simulation::threadMain, this);
+	}
+	return true;
+}
+
+bool Simulation::stepNow(float deltaTime)
+{
+	if (!step(deltaTime))
+	{
+		failed = true;
+		return false;
+	}
+	++numSteps;
+
+	if (profiling)
+	{
+		auto getDuration = [](const cl::Event& event)
+		{
+			if (event() == nullptr)
+			{
+				return 0.0;
+			}
+			event.wait();
+			const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+			const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			return static_cast<double>(end - start) * 1e-6;
+		};
+		lastStepTimings.spawn = getDuration(lastSpawnEvent);
+		lastStepTimings.update = getDuration(lastUpdateEvent);
+		lastStepTimings.collide = getDuration(lastCollideEvent);
+		lastStepTimings.death = getDuration(lastDeathEvent);
+		lastStepTimings.pack = getDuration(lastPackEvent);
+	}
+	return true;
+}
+
+void Simulation::setMeshCollision(const MeshBvh* meshBvh, float restitution, float friction)
+{
+	this->meshBvh = meshBvh;
+	meshRestitution = restitution;
+	meshFriction = friction;
+}
+
+void Simulation::setCurlNoise(const cl::Image3D& volume, float scale, const cl_float3& scrollSpeed, float strength)
+{
+	curlNoiseVolume = volume;
+	curlNoiseScale = scale;
+	curlNoiseScrollSpeed = scrollSpeed;
+	curlNoiseStrength = strength;
+}
+
+void Simulation::stop()
+{
+	if (thread.joinable())
+	{
+		stopRequested = true;
+		thread.join();
+	}
+
+	if (frontSlotFence != nullptr)
+	{
+		glDeleteSync(frontSlotFence);
+		frontSlotFence = nullptr;
+	}
+
+	for (cl::BufferGL& bufferCl : slotBuffersCl)
+	{
+		bufferCl = cl::BufferGL();
+	}
+
+	if (slotBuffers[0] != 0)
+	{
+		// deleting the buffers also unmaps them
+		glDeleteBuffers(NUM_SLOTS, slotBuffers);
+		for (GLuint& buffer : slotBuffers)
+		{
+			buffer = 0;
+		}
+	}
+	for (void*& mappedSlot : mappedSlots)
+	{
+		mappedSlot = nullptr;
+	}
+	packedRenderStateBuffer = cl::Buffer();
+	pendingTransferEvent = cl::Event();
+	lastSpawnEvent = cl::Event();
+	lastUpdateEvent = cl::Event();
+	lastCollideEvent = cl::Event();
+	lastDeathEvent = cl::Event();
+	lastPackEvent = cl::Event();
+
+	cacheRecorder = nullptr;
+	stateReadEvents.clear();
+}
+
+GLuint Simulation::acquireRenderBuffer()
+{
+	if (middleSlot.load(std::memory_order_acquire) & NEW_STEP_BIT)
+	{
+		// the simulation thread may write into the front slot as soon as it is handed back
+		if (frontSlotFence != nullptr)
+		{
+			while (glClientWaitSync(frontSlotFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+			{
+			}
+			glDeleteSync(frontSlotFence);
+			frontSlotFence = nullptr;
+		}
+
+		frontSlot = middleSlot.exchange(frontSlot, std::memory_order_acq_rel) & SLOT_INDEX_MASK;
+	}
+	return slotBuffers[frontSlot];
+}
+
+void Simulation::fenceRenderBuffer()
+{
+	if (frontSlotFence != nullptr)
+	{
+		glDeleteSync(frontSlotFence);
+	}
+	frontSlotFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Simulation::threadMain()
+{
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	while (!stopRequested)
+	{
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+		const float deltaTime = std::chrono::duration<float>(t2 - t1).count();
+		t1 = t2;
+
+		if (!step(deltaTime))
+		{
+			failed = true;
+			return;
+		}
+		++numSteps;
+	}
+
+	// the last transfer may still write into the mapped slot
+	if (pendingTransferEvent() != nullptr)
+	{
+		pendingTransferEvent.wait();
+	}
+}
+
+void Simulation::publish()
+{
+	// publish the back slot and take the previous middle slot to write the next step into
+	backSlot = middleSlot.exchange(backSlot | NEW_STEP_BIT, std::memory_order_acq_rel) & SLOT_INDEX_MASK;
+}
+
+bool Simulation::step(float deltaTime)
+{
+	cl_int code;
+
+	// snapshots hold the state at the end of the previous step, they map the buffer with nothing else in flight
+	const bool saveSnapshotNow = saveSnapshotRequested.exchange(false);
+	const bool loadSnapshotNow = loadSnapshotRequested.exchange(false);
+	if (saveSnapshotNow || loadSnapshotNow)
+	{
+		code = commandQueue.finish();
+		if (!checkErrorCode(code, "finish"))
+			return false;
+
+		if (saveSnapshotNow)
+		{
+			saveSnapshot(snapshotPath, commandQueue, particleStateBuffer, numParticles, simulationTime, rng);
+		}
+		if (loadSnapshotNow)
+		{
+			loadSnapshot(snapshotPath, commandQueue, particleStateBuffer, numParticles, simulationTime, rng);
+		}
+
+		code = commandQueue.finish();
+		if (!checkErrorCode(code, "finish"))
+			return false;
+	}
+
+	simulationTime += deltaTime;
+	const cl_float currentTimeSeconds = static_cast<cl_float>(simulationTime);
+
+	// the previous step's readers must be done before the state is written again
+	std::vector<cl::Event> waitEvents;
+	waitEvents.swap(stateReadEvents);
+
+	// spawn new particles
+	// the fraction of a particle left over is carried to the next step, steps can be much shorter than a spawn interval
+	pendingSpawns += static_cast<double>(spawnRate) * deltaTime;
+	const cl_int numParticlesToSpawn = static_cast<cl_int>(std::floor(pendingSpawns));
+	pendingSpawns -= numParticlesToSpawn;
+	lastSpawnEvent = cl::Event();
+	if (numParticlesToSpawn > 0)
+	{
+		code = spawnParticleKernel.setArg(2, numParticlesToSpawn);
+		code |= spawnParticleKernel.setArg(3, static_cast<cl_int>(rng.nextSeed()));
+		code |= spawnParticleKernel.setArg(4, currentTimeSeconds);
+		if (!checkErrorCode(code, "setArg"))
+			return false;
+
+		cl::Event spawnEvent;
+		code = commandQueue.enqueueNDRangeKernel(spawnParticleKernel, cl::NullRange, globalWorkSize, cl::NullRange, &waitEvents, &spawnEvent);
+		if (!checkErrorCode(code, "enqueueNDRangeKernel"))
+			return false;
+		waitEvents = { spawnEvent };
+		lastSpawnEvent = spawnEvent;
+	}
+
+	// the vector fields' images and weights are set once their volumes are uploaded
+	if (vectorFields != nullptr && !vectorFieldsEnabled && vectorFields->hasFailed())
+	{
+		std::cerr << "Vector field upload failed" << std::endl;
+		return false;
+	}
+	if (vectorFields != nullptr && !vectorFieldsEnabled && vectorFields->isUploaded())
+	{
+		for (size_t i = 0; i < vectorFields->getNumFields(); ++i)
+		{
+			code = updateParticleStateKernel.setArg(vectorFieldImagesArgIndex + static_cast<cl_uint>(i), vectorFields->getImage(i));
+			if (!checkErrorCode(code, "setArg"))
+				return false;
+		}
+
+		const std::vector<VectorFieldParams>& params = vectorFields->getParams();
+		cl::Event paramsEvent;
+		code = commandQueue.enqueueWriteBuffer(vectorFields->getParamsBuffer(), CL_FALSE, 0, params.size() * sizeof(VectorFieldParams), params.data(),
+			nullptr, &paramsEvent);
+		if (!checkErrorCode(code, "enqueueWriteBuffer"))
+			return false;
+		waitEvents.push_back(paramsEvent);
+		vectorFieldsEnabled = true;
+	}
+
+	// update the particles
+	code = updateParticleStateKernel.setArg(1, static_cast<cl_int>(rng.nextSeed()));
+	code |= updateParticleStateKernel.setArg(2, deltaTime);
+	if (curlNoiseVolume() != nullptr)
+	{
+		code |= updateParticleStateKernel.setArg(4, getCurlNoiseTransform(curlNoiseScale, curlNoiseScrollSpeed, simulationTime));
+	}
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	cl::Event updateEvent;
+	code = commandQueue.enqueueNDRangeKernel(updateParticleStateKernel, cl::NullRange, globalWorkSize, cl::NullRange, &waitEvents, &updateEvent);
+	if (!checkErrorCode(code, "enqueueNDRangeKernel"))
+		return false;
+
+	// trace the particles' moves through the collision mesh
+	std::vector<cl::Event> updateEvents = { updateEvent };
+	if (meshBvh != nullptr)
+	{
+		cl::Event collideEvent;
+		code = commandQueue.enqueueNDRangeKernel(collideParticlesWithMeshKernel, cl::NullRange, globalWorkSize, cl::NullRange, &updateEvents, &collideEvent);
+		if (!checkErrorCode(code, "enqueueNDRangeKernel"))
+			return false;
+		updateEvents = { collideEvent };
+		if (profiling)
+		{
+			lastCollideEvent = collideEvent;
+		}
+	}
+
+	// check the particles' death conditions, the ages packed for rendering are relative to the same time
+	code = checkParticleDeathKernel.setArg(1, currentTimeSeconds);
+	code |= packRenderStateKernel.setArg(2, currentTimeSeconds);
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	cl::Event deathEvent;
+	code = commandQueue.enqueueNDRangeKernel(checkParticleDeathKernel, cl::NullRange, globalWorkSize, cl::NullRange, &updateEvents, &deathEvent);
+	if (!checkErrorCode(code, "enqueueNDRangeKernel"))
+		return false;
+
+	// the render pack reads the final state, the recorder then reads the packed records
+	const std::vector<cl::Event> deathEvents = { deathEvent };
+	if (profiling)
+	{
+		lastUpdateEvent = updateEvent;
+		lastDeathEvent = deathEvent;
+	}
+	if (glSharing)
+	{
+		if (!packRenderState(backSlot, deathEvents))
+			return false;
+
+		publish();
+		return true;
+	}
+
+	// the previous step's copy overlapped with this step's kernels, publish it before starting the next one
+	if (pendingTransferEvent() != nullptr)
+	{
+		code = commandQueue.flush();
+		code |= pendingTransferEvent.wait();
+		if (!checkErrorCode(code, "wait"))
+			return false;
+
+		pendingTransferEvent = cl::Event();
+		publish();
+	}
+
+	if (!transferRenderState(backSlot, deathEvents, &pendingTransferEvent))
+		return false;
+
+	recordFrame(packedRenderStateBuffer);
+	code = commandQueue.flush();
+	return checkErrorCode(code, "flush");
+}
+
+bool Simulation::packRenderState(unsigned int slot, const std::vector<cl::Event>& waitEvents)
+{
+	// the render thread waited for GL to be done with the slot before handing it back
+	const std::vector<cl::Memory> glObjects = { slotBuffersCl[slot] };
+	cl::Event acquireEvent;
+	cl_int code = commandQueue.enqueueAcquireGLObjects(&glObjects, nullptr, &acquireEvent);
+	if (!checkErrorCode(code, "enqueueAcquireGLObjects"))
+		return false;
+
+	code = packRenderStateKernel.setArg(1, slotBuffersCl[slot]);
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	std::vector<cl::Event> packWaitEvents = waitEvents;
+	packWaitEvents.push_back(acquireEvent);
+	cl::Event packEvent;
+	code = commandQueue.enqueueNDRangeKernel(packRenderStateKernel, cl::NullRange, globalWorkSize, cl::NullRange, &packWaitEvents, &packEvent);
+	if (!checkErrorCode(code, "enqueueNDRangeKernel"))
+		return false;
+	stateReadEvents.push_back(packEvent);
+	lastPackEvent = packEvent;
+
+	// the recorder reads the records straight from the acquired slot, the release waits for its readback
+	std::vector<cl::Event> releaseWaitEvents = { packEvent };
+	cl::Event readEvent;
+	recordFrame(slotBuffersCl[slot], &readEvent);
+	if (readEvent() != nullptr)
+	{
+		releaseWaitEvents.push_back(readEvent);
+	}
+
+	cl::Event releaseEvent;
+	code = commandQueue.enqueueReleaseGLObjects(&glObjects, &releaseWaitEvents, &releaseEvent);
+	if (!checkErrorCode(code, "enqueueReleaseGLObjects"))
+		return false;
+
+	// GL may only read the slot once the release completed
+	code = releaseEvent.wait();
+	return checkErrorCode(code, "wait");
+}
+
+void Simulation::recordFrame(const cl::Buffer& renderStateBuffer, cl::Event* readEvent)
+{
+	if (!isRecording())
+		return;
+
+	// asynchronous readback on the recorder's queue, the recorder drops the step rather than waiting for disk
+	// the next pack only writes the records again once the readback is done, it waits for the state's readers
+	const std::vector<cl::Event> packEvents = { lastPackEvent };
+	cl::Event recorderReadEvent;
+	cacheRecorder->recordFrame(renderStateBuffer, simulationTime, &packEvents, &recorderReadEvent);
+	if (recorderReadEvent() != nullptr)
+	{
+		stateReadEvents.push_back(recorderReadEvent);
+	}
+	if (readEvent != nullptr)
+	{
+		*readEvent = recorderReadEvent;
+	}
+}
+
+bool Simulation::isRecording() const
+{
+	return cacheRecorder != nullptr && cacheRecorder->isOpen();
+}
+
+bool Simulation::transferRenderState(unsigned int slot, const std::vector<cl::Event>& waitEvents, cl::Event* transferEvent)
+{
+	// only the render records cross the bus, 16 bytes per particle instead of the whole state
+	// the packed buffer is free again since the previous transfer was waited for
+	cl_int code = packRenderStateKernel.setArg(1, packedRenderStateBuffer);
+	if (!checkErrorCode(code, "setArg"))
+		return false;
+
+	cl::Event packEvent;
+	code = commandQueue.enqueueNDRangeKernel(packRenderStateKernel, cl::NullRange, globalWorkSize, cl::NullRange, &waitEvents, &packEvent);
+	if (!checkErrorCode(code, "enqueueNDRangeKernel"))
+		return false;
+	stateReadEvents.push_back(packEvent);
+	lastPackEvent = packEvent;
+
+	// straight into the persistently mapped GL buffer, the render thread waited for GL to be done with the slot
+	const std::vector<cl::Event> packEvents = { packEvent };
+	code = commandQueue.enqueueReadBuffer(
+		packedRenderStateBuffer, CL_FALSE, 0, numParticles * sizeof(cl_float4), mappedSlots[slot], &packEvents, transferEvent);
+	return checkErrorCode(code, "enqueueReadBuffer");
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include "CLUtils.h"
+#include "Random.h"
+
+class CacheRecorder;
+class ColliderSet;
+class ForceVolumeSet;
+class Heightfield;
+class MeshBvh;
+class VectorFieldSet;
+
+// runs the particle simulation on its own thread so vsync and swap stalls do not throttle it
+// the authoritative state stays in a device buffer, each step is packed into one of three GL buffers
+// which are handed over to the render thread through a lock-free triple buffer
+// the GL buffers are shared with OpenCL when cl_khr_gl_sharing is available, otherwise they are persistently
+// mapped and the packed records are read back into them while the next step is simulated
+class Simulation
+{
+public:
+	// device time of the last step's kernels in milliseconds, requires profiling
+	struct StepTimings
+	{
+		double spawn = 0.0;
+		double update = 0.0;
+		// mesh collision stage, 0 without it
+		double collide = 0.0;
+		double death = 0.0;
+		double pack = 0.0;
+	};
+
+	Simulation() = default;
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+	~Simulation();
+
+	// requires the current GL context, the particle state must already be initialized
+	// the recorder belongs to the simulation thread until stop() returns, its readbacks overlap with the simulation kernels
+	// without GL sharing the context does not need to be created from the GL context, but GL_ARB_buffer_storage is required
+	bool start(
+		const cl::Context& context,
+		const cl::Device& device,
+		const cl::Program& program,
+		bool glSharing,
+		const cl::Buffer& particleStateBuffer,
+		size_t numParticles,
+		float spawnRate,
+		const cl::Buffer& spawnPointsBuffer,
+		cl_uint numSpawnPoints,
+		double simulationTime,
+		const Pcg32& rng,
+		CacheRecorder* cacheRecorder,
+		const std::string& snapshotPath,
+		bool runThread = true,
+		bool profiling = false);
+
+	// joins the simulation thread, requires the current GL context
+	void stop();
+
+	// range the spawned particles' lifetimes are drawn from, in seconds, set before start()
+	void setLifetimeRange(float minLifetime, float maxLifetime) { lifetimeRange = { { minLifetime, maxLifetime } }; }
+	// turbulence volume of a program built with PARTICLE_CURL_NOISE, set before start()
+	// scale maps world units to volume repetitions, the sampling offset scrolls by scrollSpeed volume units per second
+	void setCurlNoise(const cl::Image3D& volume, float scale, const cl_float3& scrollSpeed, float strength);
+	// force volumes of a program built with PARTICLE_VECTOR_FIELDS, set before start(), they take effect once uploaded
+	void setVectorFields(const VectorFieldSet* vectorFields) { this->vectorFields = vectorFields; }
+	// binned force volumes of a program built with PARTICLE_FORCE_VOLUMES, set before start()
+	void setForceVolumes(const ForceVolumeSet* forceVolumes) { this->forceVolumes = forceVolumes; }
+	// collision geometry of a program built with the ColliderSet build options, set before start()
+	void setColliders(const ColliderSet* colliders) { this->colliders = colliders; }
+	// terrain of a program built with PARTICLE_HEIGHTFIELD, set before start()
+	void setHeightfield(const Heightfield* heightfield) { this->heightfield = heightfield; }
+	// opt-in stage between the update and the death check, the program must be built with PARTICLE_MESH_COLLISION
+	// and the hierarchy built before start()
+	void setMeshCollision(const MeshBvh* meshBvh, float restitution, float friction);
+
+	// when started without the thread: runs one step from the calling thread, with fixed time steps for repeatable runs
+	// waits for the step's kernels when profiling
+	bool stepNow(float deltaTime);
+	const StepTimings& getLastStepTimings() const { return lastStepTimings; }
+
+	bool isRunning() const { return thread.joinable(); }
+	bool hasFailed() const { return failed; }
+
+	// snapshots are taken by the simulation thread between two steps
+	void requestSaveSnapshot() { saveSnapshotRequested = true; }
+	void requestLoadSnapshot() { loadSnapshotRequested = true; }
+
+	// render thread: buffer holding the latest published step, one float4 per particle (xyz position, w normalized age, -1 when dead)
+	GLuint acquireRenderBuffer();
+	// render thread: the simulation may write the acquired buffer again once this fence is signaled, call after drawing it
+	void fenceRenderBuffer();
+
+	uint64_t getNumSteps() const { return numSteps; }
+
+private:
+	bool step(float deltaTime);
+	bool packRenderState(unsigned int slot, const std::vector<cl::Event>& waitEvents);
+	bool transferRenderState(unsigned int slot, const std::vector<cl::Event>& waitEvents, cl::Event* transferEvent);
+	// reads back the render records of the last pack for the cache recorder, readEvent is left null when nothing is read
+	void recordFrame(const cl::Buffer& renderStateBuffer, cl::Event* readEvent = nullptr);
+	bool isRecording() const;
+	void publish();
+	void threadMain();
+
+	static const unsigned int NUM_SLOTS = 3;
+	static const unsigned int SLOT_INDEX_MASK = 0x3;
+	static const unsigned int NEW_STEP_BIT = 0x4;
+
+	// out-of-order when the device supports it, every command waits on its actual dependencies only
+	cl::CommandQueue commandQueue;
+	// commands still reading the particle state, the next step waits on them before writing it
+	std::vector<cl::Event> stateReadEvents;
+	cl::Buffer particleStateBuffer;
+	cl::NDRange globalWorkSize;
+	size_t numParticles = 0;
+	float spawnRate = 0.f;
+	double pendingSpawns = 0.0;
+	double simulationTime = 0.0;
+	Pcg32 rng;
+	CacheRecorder* cacheRecorder = nullptr;
+	std::string snapshotPath;
+
+	bool profiling = false;
+	cl::Event lastSpawnEvent;
+	cl::Event lastUpdateEvent;
+	cl::Event lastCollideEvent;
+	cl::Event lastDeathEvent;
+	cl::Event lastPackEvent;
+	StepTimings lastStepTimings;
+
+	cl::Kernel spawnParticleKernel;
+	cl::Kernel updateParticleStateKernel;
+	cl::Kernel collideParticlesWithMeshKernel;
+	cl::Kernel checkParticleDeathKernel;
+	cl::Kernel packRenderStateKernel;
+
+	cl_float2 lifetimeRange = { { 5.f, 5.f } };
+
+	cl::Image3D curlNoiseVolume;
+	float curlNoiseScale = 1.f;
+	cl_float3 curlNoiseScrollSpeed = {};
+	float curlNoiseStrength = 0.f;
+
+	const VectorFieldSet* vectorFields = nullptr;
+	bool vectorFieldsEnabled = false;
+	cl_uint vectorFieldImagesArgIndex = 0;
+
+	const ForceVolumeSet* forceVolumes = nullptr;
+
+	const ColliderSet* colliders = nullptr;
+	const Heightfield* heightfield = nullptr;
+
+	const MeshBvh* meshBvh = nullptr;
+	float meshRestitution = 0.f;
+	float meshFriction = 0.f;
+
+	bool glSharing = true;
+	GLuint slotBuffers[NUM_SLOTS] = {};
+	// GL sharing
+	cl::BufferGL slotBuffersCl[NUM_SLOTS];
+	// host copy, the transfer of a step is only waited for once the next step has been enqueued
+	// also the source of the cache recorder's readbacks, with GL sharing the recorder reads the acquired slot instead
+	cl::Buffer packedRenderStateBuffer;
+	void* mappedSlots[NUM_SLOTS] = {};
+	cl::Event pendingTransferEvent;
+
+	// triple buffer, the back slot is only touched by the simulation thread and the front slot by the render thread
+	// the middle slot holds NEW_STEP_BIT while it has not been picked up by the render thread
+	unsigned int backSlot = 0;
+	std::atomic<unsigned int> middleSlot{ 0 };
+	unsigned int frontSlot = 0;
+	GLsync frontSlotFence = nullptr;
+
+	std::thread thread;
+	std::atomic<bool> stopRequested{ false };
+	std::atomic<bool> failed{ false };
+	std::atomic<bool> saveSnapshotRequested{ false };
+	std::atomic<bool> loadSnapshotRequested{ false };
+	std::atomic<uint64_t> numSteps{ 0 };
+};
@@ -0,0 +1,130 @@
+#include "Snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "MappedFile.h"
+#include "ParticleState.h"
+
+bool saveSnapshot(
+	const std::string& filePath,
+	cl::CommandQueue& commandQueue,
+	const cl::Buffer& particleStateBuffer,
+	size_t numParticles,
+	double simulationTime,
+	const Pcg32& rng)
+{
+	SnapshotHeader header = {};
+	std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.layoutVersion = PARTICLE_STATE_LAYOUT_VERSION;
+	header.particleStateStructSize = sizeof(ParticleState);
+	header.numParticles = numParticles;
+	header.dataOffset = sizeof(SnapshotHeader);
+	header.simulationTime = simulationTime;
+	header.rngState = rng.state;
+	header.rngInc = rng.inc;
+
+	FILE* file = std::fopen(filePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cerr << "Could not open snapshot file '" << filePath << "' for writing" << std::endl;
+		return false;
+	}
+
+	const size_t dataSize = numParticles * sizeof(ParticleState);
+
+	cl_int code;
+	void* particles = commandQueue.enqueueMapBuffer(particleStateBuffer, CL_TRUE, CL_MAP_READ, 0, dataSize, nullptr, nullptr, &code);
+	if (!checkErrorCode(code, "enqueueMapBuffer"))
+	{
+		std::fclose(file);
+		return false;
+	}
+
+	bool success = std::fwrite(&header, sizeof(header), 1, file) == 1
+		&& std::fwrite(particles, dataSize, 1, file) == 1;
+
+	code = commandQueue.enqueueUnmapMemObject(particleStateBuffer, particles);
+	success = checkErrorCode(code, "enqueueUnmapMemObject") && success;
+
+	success = std::fclose(file) == 0 && success;
+
+	if (!success)
+	{
+		std::cerr << "Could not write snapshot file '" << filePath << "'" << std::endl;
+		return false;
+	}
+
+	std::cout << "Saved " << numParticles << " particles to '" << filePath << "'" << std::endl;
+	return true;
+}
+
+bool loadSnapshot(
+	const std::string& filePath,
+	cl::CommandQueue& commandQueue,
+	const cl::Buffer& particleStateBuffer,
+	size_t numParticles,
+	double& simulationTime,
+	Pcg32& rng)
+{
+	MappedFile file;
+	if (!file.open(filePath))
+	{
+		return false;
+	}
+
+	SnapshotHeader header;
+	if (file.getSize() < sizeof(header))
+	{
+		std::cerr << "Snapshot '" << filePath << "' is truncated" << std::endl;
+		return false;
+	}
+	std::memcpy(&header, file.getData(), sizeof(header));
+
+	if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+	{
+		std::cerr << "'" << filePath << "' is not a particle snapshot" << std::endl;
+		return false;
+	}
+
+	if (header.layoutVersion != PARTICLE_STATE_LAYOUT_VERSION || header.particleStateStructSize != sizeof(ParticleState))
+	{
+		std::cerr << "Snapshot '" << filePath << "' has layout version " << header.layoutVersion
+			<< ", expected " << PARTICLE_STATE_LAYOUT_VERSION << std::endl;
+		return false;
+	}
+
+	if (header.numParticles != numParticles)
+	{
+		std::cerr << "Snapshot '" << filePath << "' holds " << header.numParticles
+			<< " particles, expected " << numParticles << std::endl;
+		return false;
+	}
+
+	// the data must follow the header, the offset is checked first so that the sum cannot wrap around
+	const uint64_t dataSize = static_cast<uint64_t>(numParticles) * sizeof(ParticleState);
+	if (header.dataOffset < sizeof(header))
+	{
+		std::cerr << "Snapshot '" << filePath << "' has an invalid data offset " << header.dataOffset << std::endl;
+		return false;
+	}
+	if (header.dataOffset > file.getSize() || dataSize > file.getSize() - header.dataOffset)
+	{
+		std::cerr << "Snapshot '" << filePath << "' is truncated" << std::endl;
+		return false;
+	}
+
+	// blocking write: the mapping must stay valid until the upload is complete
+	cl_int code = commandQueue.enqueueWriteBuffer(particleStateBuffer, CL_TRUE, 0, static_cast<size_t>(dataSize), file.getData() + header.dataOffset);
+	if (!checkErrorCode(code, "enqueueWriteBuffer"))
+	{
+		return false;
+	}
+
+	simulationTime = header.simulationTime;
+	rng.state = header.rngState;
+	rng.inc = header.rngInc;
+
+	std::cout << "Loaded " << numParticles << " particles from '" << filePath << "'" << std::endl;
+	return true;
+}
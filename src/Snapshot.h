@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include "CLUtils.h"
+#include "Random.h"
+
+// binary particle state snapshot: a SnapshotHeader followed by the raw ParticleState array
+struct SnapshotHeader
+{
+	char magic[8];
+	uint32_t layoutVersion;
+	uint32_t particleStateStructSize;
+	uint64_t numParticles;
+	uint64_t dataOffset;
+	double simulationTime;
+	uint64_t rngState;
+	uint64_t rngInc;
+};
+
+#define SNAPSHOT_MAGIC "CLGLSNAP"
+
+// map the particle buffer for reading and write it to disk straight from the mapped pointer
+// the buffer must be usable by the queue (acquired if it is a GL buffer)
+bool saveSnapshot(
+	const std::string& filePath,
+	cl::CommandQueue& commandQueue,
+	const cl::Buffer& particleStateBuffer,
+	size_t numParticles,
+	double simulationTime,
+	const Pcg32& rng);
+
+// memory map a snapshot and upload it into the particle buffer without an intermediate copy
+bool loadSnapshot(
+	const std::string& filePath,
+	cl::CommandQueue& commandQueue,
+	const cl::Buffer& particleStateBuffer,
+	size_t numParticles,
+	double& simulationTime,
+	Pcg32& rng);
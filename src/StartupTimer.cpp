@@ -0,0 +1,61 @@
+#include "StartupTimer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static double toMilliseconds(StartupTimer::Clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+StartupTimer::Scope::Scope(StartupTimer& startupTimer, const char* phase) :
+	startupTimer(startupTimer),
+	phase(phase),
+	start(Clock::now())
+{
+}
+
+StartupTimer::Scope::~Scope()
+{
+	startupTimer.record(phase, start, Clock::now());
+}
+
+StartupTimer::StartupTimer() :
+	origin(Clock::now()),
+	mainThreadId(std::this_thread::get_id())
+{
+}
+
+void StartupTimer::record(const char* phase, Clock::time_point start, Clock::time_point end)
+{
+	const bool mainThread = std::this_thread::get_id() == mainThreadId;
+	std::lock_guard<std::mutex> lock(phasesMutex);
+	phases.push_back({ phase, start, end, mainThread });
+}
+
+double StartupTimer::getElapsedMilliseconds() const
+{
+	return toMilliseconds(Clock::now() - origin);
+}
+
+void StartupTimer::print() const
+{
+	std::vector<Phase> sortedPhases;
+	{
+		std::lock_guard<std::mutex> lock(phasesMutex);
+		sortedPhases = phases;
+	}
+	std::sort(sortedPhases.begin(), sortedPhases.end(), [](const Phase& a, const Phase& b) { return a.start < b.start; });
+
+	std::printf("Startup phases:\n");
+	std::printf("  %-32s %8s %10s %10s\n", "phase", "thread", "start ms", "took ms");
+	for (const Phase& phase : sortedPhases)
+	{
+		std::printf("  %-32s %8s %10.1f %10.1f\n",
+			phase.name.c_str(),
+			phase.mainThread ? "main" : "worker",
+			toMilliseconds(phase.start - origin),
+			toMilliseconds(phase.end - phase.start));
+	}
+	std::printf("Time to first frame: %.1f ms\n", getElapsedMilliseconds());
+}
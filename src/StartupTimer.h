@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// per phase startup timing, phases may be recorded from any thread
+class StartupTimer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// times the enclosing scope
+	class Scope
+	{
+	public:
+		Scope(StartupTimer& startupTimer, const char* phase);
+		~Scope();
+
+	private:
+		StartupTimer& startupTimer;
+		const char* phase;
+		Clock::time_point start;
+	};
+
+	StartupTimer();
+
+	void record(const char* phase, Clock::time_point start, Clock::time_point end);
+
+	double getElapsedMilliseconds() const;
+
+	// phases sorted by start time, with the thread they ran on
+	void print() const;
+
+private:
+	struct Phase
+	{
+		std::string name;
+		Clock::time_point start;
+		Clock::time_point end;
+		bool mainThread;
+	};
+
+	const Clock::time_point origin;
+	const std::thread::id mainThreadId;
+	mutable std::mutex phasesMutex;
+	std::vector<Phase> phases;
+};
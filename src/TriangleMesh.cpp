@@ -0,0 +1,171 @@
+#include "TriangleMesh.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "MappedFile.h"
+
+static const size_t STL_HEADER_SIZE = 84;
+static const size_t STL_TRIANGLE_SIZE = 50;
+
+static cl_float4 transformVertex(const float* transform, float x, float y, float z)
+{
+	if (transform == nullptr)
+		return { { x, y, z, 1.f } };
+
+	cl_float4 vertex;
+	for (int row = 0; row < 3; ++row)
+	{
+		const float* m = transform + row * 4;
+		vertex.s[row] = m[0] * x + m[1] * y + m[2] * z + m[3];
+	}
+	vertex.s[3] = 1.f;
+	return vertex;
+}
+
+// 84 byte header ending with the triangle count, then normal, three vertices and an attribute word per triangle
+static bool isBinaryStl(const MappedFile& file)
+{
+	if (file.getSize() < STL_HEADER_SIZE)
+		return false;
+
+	uint32_t numTriangles;
+	std::memcpy(&numTriangles, file.getData() + 80, sizeof(numTriangles));
+	return file.getSize() == STL_HEADER_SIZE + static_cast<size_t>(numTriangles) * STL_TRIANGLE_SIZE;
+}
+
+static void readBinaryStl(const MappedFile& file, const float* transform, std::vector<cl_float4>& triangles)
+{
+	const size_t numTriangles = (file.getSize() - STL_HEADER_SIZE) / STL_TRIANGLE_SIZE;
+	triangles.reserve(triangles.size() + numTriangles * 3);
+	for (size_t triangle = 0; triangle < numTriangles; ++triangle)
+	{
+		const unsigned char* record = file.getData() + STL_HEADER_SIZE + triangle * STL_TRIANGLE_SIZE;
+		for (int vertex = 0; vertex < 3; ++vertex)
+		{
+			float position[3];
+			std::memcpy(position, record + 12 + vertex * sizeof(position), sizeof(position));
+			triangles.push_back(transformVertex(transform, position[0], position[1], position[2]));
+		}
+	}
+}
+
+// OBJ and ASCII STL, one record per line
+static bool readTextMesh(const MappedFile& file, const std::string& filePath, const float* transform, std::vector<cl_float4>& triangles)
+{
+	const char* data = reinterpret_cast<const char*>(file.getData());
+	const size_t size = file.getSize();
+	std::vector<cl_float4> vertices;
+	std::vector<long> face;
+	std::string line;
+	size_t lineNumber = 0;
+	for (size_t offset = 0; offset < size; )
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(data + offset, '\n', size - offset));
+		const size_t lineLength = lineEnd != nullptr ? static_cast<size_t>(lineEnd - (data + offset)) : size - offset;
+		// the mapping is not null terminated
+		line.assign(data + offset, lineLength);
+		offset += lineLength + 1;
+		++lineNumber;
+
+		const char* cursor = line.c_str();
+		while (*cursor == ' ' || *cursor == '\t')
+			++cursor;
+
+		if ((cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t')) || std::strncmp(cursor, "vertex ", 7) == 0)
+		{
+			// STL vertices come three by three, in triangle order
+			const bool isStlVertex = cursor[1] == 'e';
+			cursor += isStlVertex ? 7 : 2;
+			float position[3];
+			for (float& value : position)
+			{
+				char* end = nullptr;
+				value = std::strtof(cursor, &end);
+				if (end == cursor)
+				{
+					std::cerr << filePath << ":" << lineNumber << ": invalid vertex" << std::endl;
+					return false;
+				}
+				cursor = end;
+			}
+
+			const cl_float4 vertex = transformVertex(transform, position[0], position[1], position[2]);
+			if (isStlVertex)
+			{
+				triangles.push_back(vertex);
+			}
+			else
+			{
+				vertices.push_back(vertex);
+			}
+		}
+		else if (cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t'))
+		{
+			// v, v/vt, v//vn or v/vt/vn, negative indices count back from the last vertex
+			face.clear();
+			cursor += 2;
+			while (true)
+			{
+				char* end = nullptr;
+				const long index = std::strtol(cursor, &end, 10);
+				if (end == cursor)
+					break;
+
+				const long resolvedIndex = index < 0 ? static_cast<long>(vertices.size()) + index : index - 1;
+				if (index == 0 || resolvedIndex < 0 || resolvedIndex >= static_cast<long>(vertices.size()))
+				{
+					std::cerr << filePath << ":" << lineNumber << ": invalid vertex index " << index << std::endl;
+					return false;
+				}
+				face.push_back(resolvedIndex);
+
+				cursor = end;
+				while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t')
+					++cursor;
+			}
+
+			for (size_t i = 2; i < face.size(); ++i)
+			{
+				triangles.push_back(vertices[face[0]]);
+				triangles.push_back(vertices[face[i - 1]]);
+				triangles.push_back(vertices[face[i]]);
+			}
+		}
+	}
+
+	if (triangles.size() % 3 != 0)
+	{
+		std::cerr << "'" << filePath << "' has an incomplete triangle" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool loadTriangleMesh(const std::string& filePath, const float* transform, std::vector<cl_float4>& triangles)
+{
+	MappedFile file;
+	if (!file.open(filePath))
+	{
+		std::cerr << "Unable to open mesh '" << filePath << "'" << std::endl;
+		return false;
+	}
+
+	const size_t firstVertex = triangles.size();
+	if (isBinaryStl(file))
+	{
+		readBinaryStl(file, transform, triangles);
+	}
+	else if (!readTextMesh(file, filePath, transform, triangles))
+	{
+		return false;
+	}
+
+	if (triangles.size() == firstVertex)
+	{
+		std::cerr << "'" << filePath << "' has no triangles" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CLUtils.h"
+
+// memory mapped triangle mesh reader for Wavefront OBJ (v and f records, polygons fanned into triangles)
+// and ASCII or binary STL, three vertices per triangle are appended to triangles, w is 1
+// transform, when given, is the 3x4 row-major object to world matrix applied to the vertices
+bool loadTriangleMesh(const std::string& filePath, const float* transform, std::vector<cl_float4>& triangles);
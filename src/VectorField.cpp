@@ -0,0 +1,343 @@
+#include "VectorField.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// slices converted and written per upload, two staging buffers alternate so that conversion overlaps the writes
+static const unsigned int SLICES_PER_UPLOAD = 8;
+
+// round to nearest even, overflows to infinity
+static cl_half toHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t floatExponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (floatExponent == 0xff)
+	{
+		return static_cast<cl_half>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+	}
+
+	const int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+	if (exponent >= 31)
+	{
+		return static_cast<cl_half>(sign | 0x7c00);
+	}
+
+	if (exponent <= 0)
+	{
+		// subnormal half
+		if (exponent < -10)
+			return static_cast<cl_half>(sign);
+
+		mantissa |= 0x800000;
+		const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			++half;
+		return static_cast<cl_half>(sign | half);
+	}
+
+	// a carry out of the mantissa correctly increments the exponent
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	const uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		++half;
+	return static_cast<cl_half>(half);
+}
+
+// FGA values are separated by commas and white space, the mapped text is not null terminated
+static bool readFgaNumber(const unsigned char* data, size_t size, size_t& offset, float& value)
+{
+	while (offset < size && (data[offset] == ',' || data[offset] == ' ' || data[offset] == '\t' || data[offset] == '\r' || data[offset] == '\n'))
+		++offset;
+
+	char token[64];
+	size_t length = 0;
+	while (offset < size && length + 1 < sizeof(token) && data[offset] != ',' && data[offset] != ' '
+		&& data[offset] != '\t' && data[offset] != '\r' && data[offset] != '\n')
+	{
+		token[length++] = static_cast<char>(data[offset++]);
+	}
+	token[length] = '\0';
+
+	char* end = nullptr;
+	value = std::strtof(token, &end);
+	return length > 0 && *end == '\0';
+}
+
+VectorFieldSet::~VectorFieldSet()
+{
+	if (uploadThread.joinable())
+	{
+		uploadThread.join();
+	}
+}
+
+bool VectorFieldSet::open(const std::vector<VectorFieldSource>& sources, const cl::Context& context, const cl::Device& device)
+{
+	if (sources.size() > MAX_FIELDS)
+	{
+		std::cerr << "At most " << MAX_FIELDS << " vector fields are supported" << std::endl;
+		return false;
+	}
+
+	this->context = context;
+	this->device = device;
+	fields = std::vector<Field>(sources.size());
+	params.resize(sources.size());
+
+	const cl_ulong maxAllocationSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+	const size_t maxImageSize[3] =
+	{
+		device.getInfo<CL_DEVICE_IMAGE3D_MAX_WIDTH>(),
+		device.getInfo<CL_DEVICE_IMAGE3D_MAX_HEIGHT>(),
+		device.getInfo<CL_DEVICE_IMAGE3D_MAX_DEPTH>(),
+	};
+
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		const VectorFieldSource& source = sources[i];
+		Field& field = fields[i];
+		field.path = source.path;
+		if (!field.file.open(source.path))
+		{
+			std::cerr << "Unable to open vector field '" << source.path << "'" << std::endl;
+			return false;
+		}
+
+		float boundsMin[3];
+		float boundsMax[3];
+		if (!readHeader(field, boundsMin, boundsMax))
+			return false;
+
+		const size_t numVoxels = static_cast<size_t>(field.size[0]) * field.size[1] * field.size[2];
+		if (field.size[0] > maxImageSize[0] || field.size[1] > maxImageSize[1] || field.size[2] > maxImageSize[2]
+			|| numVoxels * 4 * sizeof(cl_half) > maxAllocationSize)
+		{
+			std::cerr << "Vector field '" << source.path << "' is too large for the device" << std::endl;
+			return false;
+		}
+
+		cl_int code = CL_SUCCESS;
+		field.image = cl::Image3D(context, CL_MEM_READ_ONLY, cl::ImageFormat(CL_RGBA, CL_HALF_FLOAT),
+			field.size[0], field.size[1], field.size[2], 0, 0, nullptr, &code);
+		if (!checkErrorCode(code, "cl::Image3D"))
+			return false;
+
+		// normalized coordinate = (transform * position - boundsMin) / (boundsMax - boundsMin)
+		VectorFieldParams& fieldParams = params[i];
+		for (int row = 0; row < 3; ++row)
+		{
+			const float extent = boundsMax[row] - boundsMin[row];
+			const float inverseExtent = extent != 0.f ? 1.f / extent : 0.f;
+			for (int column = 0; column < 4; ++column)
+			{
+				fieldParams.rows[row].s[column] = source.transform[row * 4 + column] * inverseExtent;
+			}
+			fieldParams.rows[row].s[3] -= boundsMin[row] * inverseExtent;
+		}
+		fieldParams.weight = { { source.weight, 0.f, 0.f, 0.f } };
+
+		std::cout << "Vector field " << source.path << ": " << field.size[0] << "x" << field.size[1] << "x" << field.size[2]
+			<< ", weight " << source.weight << std::endl;
+	}
+
+	// zero weights until the volumes are uploaded
+	std::vector<VectorFieldParams> pendingParams = params;
+	for (VectorFieldParams& fieldParams : pendingParams)
+	{
+		fieldParams.weight.s[0] = 0.f;
+	}
+
+	cl_int code = CL_SUCCESS;
+	paramsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, std::max<size_t>(pendingParams.size(), 1) * sizeof(VectorFieldParams),
+		pendingParams.data(), &code);
+	if (!checkErrorCode(code, "cl::Buffer"))
+		return false;
+
+	// 3D images need a depth of at least 2
+	cl_half placeholderTexels[2 * 4] = {};
+	placeholderImage = cl::Image3D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cl::ImageFormat(CL_RGBA, CL_HALF_FLOAT),
+		1, 1, 2, 0, 0, placeholderTexels, &code);
+	if (!checkErrorCode(code, "cl::Image3D"))
+		return false;
+
+	uploadThread = std::thread(&VectorFieldSet::uploadMain, this);
+	return true;
+}
+
+bool VectorFieldSet::readHeader(Field& field, float boundsMin[3], float boundsMax[3])
+{
+	const unsigned char* data = field.file.getData();
+	const size_t size = field.file.getSize();
+
+	// VF_V, 3 uint16 sizes, then 3 floats per voxel with x varying fastest
+	if (size >= 10 && std::memcmp(data, "VF_", 3) == 0)
+	{
+		if (data[3] != 'V')
+		{
+			std::cerr << "'" << field.path << "' is a scalar VF file, vector fields need VF_V" << std::endl;
+			return false;
+		}
+
+		field.format = Format::Vf;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			uint16_t axisSize;
+			std::memcpy(&axisSize, data + 4 + axis * 2, sizeof(axisSize));
+			field.size[axis] = axisSize;
+			// one world unit per voxel, centered on the origin
+			boundsMin[axis] = -0.5f * axisSize;
+			boundsMax[axis] = 0.5f * axisSize;
+		}
+		field.dataOffset = 10;
+
+		const size_t numVoxels = static_cast<size_t>(field.size[0]) * field.size[1] * field.size[2];
+		if (numVoxels == 0 || size < field.dataOffset + numVoxels * 3 * sizeof(float))
+		{
+			std::cerr << "'" << field.path << "' is truncated" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// FGA: sizeX, sizeY, sizeZ, boundsMin xyz, boundsMax xyz, then vectors with x varying fastest
+	field.format = Format::Fga;
+	size_t offset = 0;
+	float header[9];
+	for (float& value : header)
+	{
+		if (!readFgaNumber(data, size, offset, value))
+		{
+			std::cerr << "'" << field.path << "' is neither an FGA nor a VF file" << std::endl;
+			return false;
+		}
+	}
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (header[axis] < 1.f)
+		{
+			std::cerr << "'" << field.path << "' has an empty grid" << std::endl;
+			return false;
+		}
+		field.size[axis] = static_cast<unsigned int>(header[axis]);
+		boundsMin[axis] = header[3 + axis];
+		boundsMax[axis] = header[6 + axis];
+	}
+	field.dataOffset = offset;
+
+	// every value takes at least a digit and a separator, the exact count is only known once the text is parsed
+	const size_t numValues = static_cast<size_t>(field.size[0]) * field.size[1] * field.size[2] * 3;
+	if (size - offset < numValues * 2 - 1)
+	{
+		std::cerr << "'" << field.path << "' is truncated" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void VectorFieldSet::uploadMain()
+{
+	for (Field& field : fields)
+	{
+		if (!upload(field))
+		{
+			failed = true;
+			return;
+		}
+		// the mapping is only needed for the upload
+		field.file.close();
+	}
+	uploaded = true;
+}
+
+bool VectorFieldSet::upload(Field& field)
+{
+	cl_int code = CL_SUCCESS;
+	cl::CommandQueue uploadQueue(context, device, 0, &code);
+	if (!checkErrorCode(code, "cl::CommandQueue"))
+		return false;
+
+	const unsigned char* data = field.file.getData();
+	const size_t size = field.file.getSize();
+	const size_t sliceVoxels = static_cast<size_t>(field.size[0]) * field.size[1];
+	// half float bits, std::vector drops the alignment attribute of cl_half
+	std::vector<uint16_t> staging[2];
+	cl::Event stagingEvents[2];
+	size_t offset = field.dataOffset;
+
+	// the staging buffers must outlive the writes reading them, on every return
+	auto fail = [&uploadQueue]()
+	{
+		uploadQueue.finish();
+		return false;
+	};
+
+	for (unsigned int firstSlice = 0, batch = 0; firstSlice < field.size[2]; firstSlice += SLICES_PER_UPLOAD, ++batch)
+	{
+		const unsigned int numSlices = std::min(SLICES_PER_UPLOAD, field.size[2] - firstSlice);
+		const size_t numVoxels = sliceVoxels * numSlices;
+
+		// the write of two batches ago used this staging buffer
+		std::vector<uint16_t>& halves = staging[batch % 2];
+		if (stagingEvents[batch % 2]() != nullptr)
+		{
+			code = stagingEvents[batch % 2].wait();
+			if (!checkErrorCode(code, "clWaitForEvents"))
+				return fail();
+		}
+		halves.resize(numVoxels * 4);
+
+		if (field.format == Format::Vf)
+		{
+			const size_t batchBytes = numVoxels * 3 * sizeof(float);
+			field.file.prefetch(offset + batchBytes, batchBytes);
+			for (size_t voxel = 0; voxel < numVoxels; ++voxel)
+			{
+				float vector[3];
+				std::memcpy(vector, data + offset + voxel * sizeof(vector), sizeof(vector));
+				halves[voxel * 4 + 0] = toHalf(vector[0]);
+				halves[voxel * 4 + 1] = toHalf(vector[1]);
+				halves[voxel * 4 + 2] = toHalf(vector[2]);
+				halves[voxel * 4 + 3] = 0;
+			}
+			offset += batchBytes;
+		}
+		else
+		{
+			for (size_t voxel = 0; voxel < numVoxels; ++voxel)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					float value;
+					if (!readFgaNumber(data, size, offset, value))
+					{
+						std::cerr << "'" << field.path << "' is truncated" << std::endl;
+						return fail();
+					}
+					halves[voxel * 4 + axis] = toHalf(value);
+				}
+				halves[voxel * 4 + 3] = 0;
+			}
+		}
+
+		const cl::array<cl::size_type, 3> origin = { 0, 0, firstSlice };
+		const cl::array<cl::size_type, 3> region = { field.size[0], field.size[1], numSlices };
+		code = uploadQueue.enqueueWriteImage(field.image, CL_FALSE, origin, region, 0, 0, halves.data(), nullptr, &stagingEvents[batch % 2]);
+		if (!checkErrorCode(code, "enqueueWriteImage"))
+			return fail();
+		code = uploadQueue.flush();
+		if (!checkErrorCode(code, "flush"))
+			return fail();
+	}
+
+	code = uploadQueue.finish();
+	return checkErrorCode(code, "finish");
+}
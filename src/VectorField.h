@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CLUtils.h"
+#include "MappedFile.h"
+#include "Options.h"
+
+// layout of the VectorField struct in cl/particle.cl
+struct VectorFieldParams
+{
+	// world position to normalized volume coordinates, rows of a 3x4 matrix
+	cl_float4 rows[3];
+	// x weight, 0 until the volume is uploaded
+	cl_float4 weight;
+};
+
+// 3D vector field volumes added as forces in updateParticleState (PARTICLE_VECTOR_FIELDS)
+// reads Unreal FGA text grids and Unity VF binary volumes (VF_V), stored as half float RGBA images
+// open() only maps the files and reads their headers, a worker thread converts and uploads the voxels
+// a few slices at a time on its own queue; the fields keep a zero weight until all of them are uploaded
+class VectorFieldSet
+{
+public:
+	// one image argument each, OpenCL 1.1 has no image arrays
+	static const unsigned int MAX_FIELDS = 4;
+
+	VectorFieldSet() = default;
+	VectorFieldSet(const VectorFieldSet&) = delete;
+	VectorFieldSet& operator=(const VectorFieldSet&) = delete;
+	// waits for the upload
+	~VectorFieldSet();
+
+	bool open(const std::vector<VectorFieldSource>& sources, const cl::Context& context, const cl::Device& device);
+
+	size_t getNumFields() const { return fields.size(); }
+	const cl::Image3D& getImage(size_t field) const { return fields[field].image; }
+	// zero volume to bind in place of the images while the upload queue may still write them
+	const cl::Image3D& getPlaceholderImage() const { return placeholderImage; }
+	// weights 0 until uploaded
+	const cl::Buffer& getParamsBuffer() const { return paramsBuffer; }
+	// final parameters to write once uploaded
+	const std::vector<VectorFieldParams>& getParams() const { return params; }
+
+	bool isUploaded() const { return uploaded; }
+	// the fields never get their weights, the caller reports the error
+	bool hasFailed() const { return failed; }
+
+private:
+	enum class Format { Fga, Vf };
+
+	struct Field
+	{
+		std::string path;
+		Format format = Format::Vf;
+		MappedFile file;
+		// first voxel value, FGA offsets are found while parsing
+		size_t dataOffset = 0;
+		unsigned int size[3] = {};
+		cl::Image3D image;
+	};
+
+	bool readHeader(Field& field, float boundsMin[3], float boundsMax[3]);
+	void uploadMain();
+	bool upload(Field& field);
+
+	std::vector<Field> fields;
+	std::vector<VectorFieldParams> params;
+	cl::Context context;
+	cl::Device device;
+	cl::Buffer paramsBuffer;
+	cl::Image3D placeholderImage;
+
+	std::thread uploadThread;
+	std::atomic<bool> uploaded{ false };
+	std::atomic<bool> failed{ false };
+};